@@ -0,0 +1,102 @@
+#include "config_file.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+static std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+static bool parseInt(const std::string& text, int min, int max, int& value) {
+    char* end = nullptr;
+    errno = 0;
+    long parsed = strtol(text.c_str(), &end, 10);
+    if (errno || end == text.c_str() || *end || parsed < min || parsed > max) {
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+// 校验规则与命令行选项一致
+static bool applySetting(const std::string& key, const std::string& value, DisplayConfig& config) {
+    int number;
+    if (key == "rotation") {
+        if (!parseInt(value, 0, 270, number) || number % 90) {
+            return false;
+        }
+        config.rotation_degrees = number;
+    } else if (key == "scale-mode") {
+        if (value == "stretch") {
+            config.scale_mode = DisplayConfig::SCALE_STRETCH;
+        } else if (value == "keep-aspect") {
+            config.scale_mode = DisplayConfig::SCALE_KEEP_ASPECT;
+        } else {
+            return false;
+        }
+    } else if (key == "quality") {
+        if (value == "fast") {
+            config.quality = DisplayConfig::QUALITY_FAST;
+        } else if (value == "good") {
+            config.quality = DisplayConfig::QUALITY_GOOD;
+        } else {
+            return false;
+        }
+    } else if (key == "max-fps" || key == "min-fps") {
+        if (!parseInt(value, 1, 240, number)) {
+            return false;
+        }
+        (key == "max-fps" ? config.governor.max_fps : config.governor.min_fps) = number;
+    } else if (key == "thermal-limit") {
+        if (!parseInt(value, 40, 125, number)) {
+            return false;
+        }
+        config.governor.thermal_limit_c = number;
+        config.governor.thermal_resume_c = number - 10;
+    } else if (key == "governor") {
+        if (value != "on" && value != "off") {
+            return false;
+        }
+        config.governor.enabled = (value == "on");
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool loadConfigFile(const std::string& path, DisplayConfig& config, std::string& error) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+    
+    // 先在副本上解析，整个文件有效时才替换
+    DisplayConfig parsed = config;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        
+        size_t eq = line.find('=');
+        std::string key = eq == std::string::npos ? line : trim(line.substr(0, eq));
+        std::string value = eq == std::string::npos ? std::string() : trim(line.substr(eq + 1));
+        if (!applySetting(key, value, parsed)) {
+            error = path + ":" + std::to_string(line_number) + ": invalid setting '" + line + "'";
+            return false;
+        }
+    }
+    
+    config = parsed;
+    return true;
+}
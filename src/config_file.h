@@ -0,0 +1,15 @@
+#pragma once
+
+#include "frame_copier.h"
+#include <string>
+
+// 配置文件：每行一个 "键 = 值"，#之后为注释，键名与命令行选项相同 (不带--)
+// 只包含运行时可以修改的设置，SIGHUP或控制命令reload时重新读取，不需要重启服务：
+//   rotation = 0|90|180|270
+//   scale-mode = stretch|keep-aspect
+//   quality = fast|good
+//   max-fps / min-fps = 1-240
+//   thermal-limit = 40-125
+//   governor = on|off
+// 任意一行无效时返回false并在error中给出文件名和行号，config保持不变
+bool loadConfigFile(const std::string& path, DisplayConfig& config, std::string& error);
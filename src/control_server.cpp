@@ -0,0 +1,276 @@
+#include "control_server.h"
+#include "logger.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// 请求只有一行，超过该长度的连接直接关闭
+static const size_t kMaxRequestSize = 4096;
+static const size_t kMaxClients = 16;
+static const auto kClientTimeout = std::chrono::seconds(5);
+
+static std::string escapeLabelValue(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static std::string formatValue(double value) {
+    if (std::isnan(value)) {
+        return "NaN";
+    }
+    if (std::isinf(value)) {
+        return value > 0 ? "+Inf" : "-Inf";
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.17g", value);
+    return buffer;
+}
+
+void MetricsWriter::gauge(const char* name, const char* help, double value, Labels labels) {
+    sample(name, help, "gauge", value, labels);
+}
+
+void MetricsWriter::counter(const char* name, const char* help, double value, Labels labels) {
+    sample(name, help, "counter", value, labels);
+}
+
+void MetricsWriter::sample(const char* name, const char* help, const char* type, double value, Labels labels) {
+    auto it = index_.find(name);
+    if (it == index_.end()) {
+        it = index_.emplace(name, families_.size()).first;
+        families_.push_back({name, help, type, std::string()});
+    }
+
+    std::string& samples = families_[it->second].samples;
+    samples += name;
+    if (labels.size()) {
+        samples += '{';
+        bool first = true;
+        for (const auto& [key, label] : labels) {
+            if (!first) {
+                samples += ',';
+            }
+            samples += key;
+            samples += "=\"";
+            samples += escapeLabelValue(label);
+            samples += '"';
+            first = false;
+        }
+        samples += '}';
+    }
+    samples += ' ';
+    samples += formatValue(value);
+    samples += '\n';
+}
+
+std::string MetricsWriter::text() const {
+    std::string text;
+    for (const Family& family : families_) {
+        text += "# HELP " + family.name + " " + family.help + "\n";
+        text += "# TYPE " + family.name + " " + family.type + "\n";
+        text += family.samples;
+    }
+    return text;
+}
+
+ControlServer::ControlServer() : loop_(nullptr), listen_fd_(-1) {
+}
+
+ControlServer::~ControlServer() {
+    cleanup();
+}
+
+bool ControlServer::initialize(const std::string& path, EventLoop* loop) {
+    struct sockaddr_un addr = {};
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        LOG_ERROR("Invalid control socket path: {}", path);
+        return false;
+    }
+
+    // 只删除上一次运行留下的套接字文件，不覆盖其他文件
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            LOG_ERROR("Control socket path {} exists and is not a socket", path);
+            return false;
+        }
+        unlink(path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create control socket: {}", strerror(errno));
+        return false;
+    }
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        LOG_ERROR("Failed to listen on control socket {}: {}", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    // 控制命令会改变运行状态，只允许属主和属组访问
+    chmod(path.c_str(), 0660);
+
+    if (!loop->addFd(fd, [this]() { return onAccept(); })) {
+        close(fd);
+        unlink(path.c_str());
+        return false;
+    }
+
+    loop_ = loop;
+    listen_fd_ = fd;
+    path_ = path;
+    LOG_INFO("Control socket listening on {}", path);
+    return true;
+}
+
+void ControlServer::cleanup() {
+    while (!clients_.empty()) {
+        closeClient(clients_.begin()->first);
+    }
+    if (listen_fd_ >= 0) {
+        loop_->removeFd(listen_fd_);
+        close(listen_fd_);
+        unlink(path_.c_str());
+        listen_fd_ = -1;
+    }
+}
+
+bool ControlServer::onAccept() {
+    expireClients();
+
+    bool accepted = false;
+    while (true) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            break;
+        }
+        if (clients_.size() >= kMaxClients ||
+            !loop_->addFd(fd, [this, fd]() { return onClientReadable(fd); })) {
+            close(fd);
+            continue;
+        }
+        clients_[fd].accepted = std::chrono::steady_clock::now();
+        accepted = true;
+    }
+    return accepted;
+}
+
+bool ControlServer::onClientReadable(int fd) {
+    auto it = clients_.find(fd);
+    if (it == clients_.end()) {
+        return false;
+    }
+
+    std::string& request = it->second.request;
+    char buffer[512];
+    bool eof = false;
+    while (true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            request.append(buffer, n);
+            if (request.size() > kMaxRequestSize) {
+                closeClient(fd);
+                return true;
+            }
+            continue;
+        }
+        if (n == 0) {
+            eof = true;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closeClient(fd);
+            return true;
+        }
+        break;
+    }
+
+    // 等到一整行 (或对端关闭写端) 再处理
+    size_t newline = request.find('\n');
+    if (newline == std::string::npos && !eof) {
+        return true;
+    }
+
+    std::string line = request.substr(0, newline);
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+
+    // 回复通常只有几KB，远小于Unix套接字的发送缓冲区，一次写完
+    std::string response = handleRequest(line);
+    ssize_t written = write(fd, response.data(), response.size());
+    if (written != (ssize_t)response.size()) {
+        LOG_WARN("Control socket reply truncated ({} of {} bytes)", written, response.size());
+    }
+    closeClient(fd);
+    return true;
+}
+
+void ControlServer::closeClient(int fd) {
+    loop_->removeFd(fd);
+    close(fd);
+    clients_.erase(fd);
+}
+
+void ControlServer::expireClients() {
+    // 连接后一直不发送请求的客户端
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = clients_.begin(); it != clients_.end();) {
+        int fd = it->first;
+        bool expired = now - it->second.accepted > kClientTimeout;
+        ++it;
+        if (expired) {
+            closeClient(fd);
+        }
+    }
+}
+
+std::string ControlServer::handleRequest(const std::string& line) {
+    // HTTP GET：只看请求行，其余的头部不需要
+    if (line.compare(0, 4, "GET ") == 0) {
+        std::istringstream stream(line.substr(4));
+        std::string target;
+        stream >> target;
+        if (target == "/metrics" && metrics_provider_) {
+            std::string body = metrics_provider_();
+            return "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                   std::to_string(body.size()) + "\r\n\r\n" + body;
+        }
+        return "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+    }
+
+    std::vector<std::string> args;
+    std::istringstream stream(line);
+    std::string arg;
+    while (stream >> arg) {
+        args.push_back(arg);
+    }
+
+    if (args.empty() || args[0] == "metrics") {
+        return metrics_provider_ ? metrics_provider_() : std::string();
+    }
+    if (!command_handler_) {
+        return "error: commands not supported\n";
+    }
+
+    LOG_INFO("Control command: {}", line);
+    return command_handler_(args);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "event_loop.h"
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Prometheus文本格式 (0.0.4) 的输出：同一指标的样本按族归并输出，HELP/TYPE只出现一次
+class MetricsWriter {
+public:
+    using Labels = std::initializer_list<std::pair<const char*, std::string>>;
+
+    void gauge(const char* name, const char* help, double value, Labels labels = {});
+    void counter(const char* name, const char* help, double value, Labels labels = {});
+
+    std::string text() const;
+
+private:
+    struct Family {
+        std::string name;
+        std::string help;
+        const char* type;
+        std::string samples;
+    };
+
+    std::vector<Family> families_;
+    std::map<std::string, size_t> index_;
+
+    void sample(const char* name, const char* help, const char* type, double value, Labels labels);
+};
+
+// 本地控制套接字 (Unix域，SOCK_STREAM)：客户端发送一行请求，守护进程回复后关闭连接
+//   metrics (或空行)        Prometheus文本格式的指标
+//   GET /metrics HTTP/1.x   同上，带HTTP头 (curl --unix-socket)
+//   其他                    按空白分割后交给命令处理函数
+// 在事件循环线程中非阻塞处理，不创建额外线程
+class ControlServer {
+public:
+    using MetricsProvider = std::function<std::string()>;
+    using CommandHandler = std::function<std::string(const std::vector<std::string>& args)>;
+
+    ControlServer();
+    ~ControlServer();
+
+    bool initialize(const std::string& path, EventLoop* loop);
+    void cleanup();
+
+    void setMetricsProvider(MetricsProvider provider) { metrics_provider_ = provider; }
+    void setCommandHandler(CommandHandler handler) { command_handler_ = handler; }
+
+private:
+    struct Client {
+        std::string request;
+        std::chrono::steady_clock::time_point accepted;
+    };
+
+    EventLoop* loop_;
+    int listen_fd_;
+    std::string path_;
+    std::map<int, Client> clients_;
+    MetricsProvider metrics_provider_;
+    CommandHandler command_handler_;
+
+    bool onAccept();
+    bool onClientReadable(int fd);
+    void closeClient(int fd);
+    void expireClients();
+    std::string handleRequest(const std::string& line);
+};
@@ -1,13 +1,29 @@
 #include "display_manager.h"
+#include "config_file.h"
 #include "logger.h"
+#include <cstdlib>
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <future>
 #include <iomanip>
 #include <set>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+// 热插拔事件合并窗口：插拔时udev通常在几十毫秒内连续发出多个change事件
+static const auto kHotplugSettle = std::chrono::milliseconds(100);
+static const auto kCaptureVBlankTimeout = std::chrono::milliseconds(100);  // 主显示器CRTC关闭时不再等待vblank
 
 DisplayManager::DisplayManager()
-    : running_(false), copy_enabled_(false), primary_display_(nullptr) {
+    : primary_display_(nullptr), hw_clone_count_(0), topology_generation_(0), frame_generation_(0),
+      present_generation_(0), capture_drops_(0), pacing_timer_(-1), hotplug_timer_(-1),
+      pacing_interval_(0), present_pending_(false),
+      reconfigure_count_(0), reconfigure_last_ms_(0), reconfigure_max_ms_(0),
+      running_(false), copy_enabled_(false), start_time_(std::chrono::steady_clock::now()),
+      first_frame_pending_(true), first_frame_ms_(-1), first_frame_boot_ms_(-1) {
+    present_track_ = FrameTrace::track("Present");
 }
 
 DisplayManager::~DisplayManager() {
@@ -15,54 +31,121 @@ DisplayManager::~DisplayManager() {
 }
 
 bool DisplayManager::initialize() {
+    auto init_start = std::chrono::steady_clock::now();
+    
+    // 逐帧跟踪的缓冲区在启动时一次分配，记录时不分配内存
+    FrameTrace::initialize(display_config_.trace);
+    
+    // RGA助手 (dma-heap/udmabuf) 不依赖DRM，与DRM初始化 (连接器探测最慢) 并行
+    // 提前返回时future的析构会等待其完成
+    rga_helper_ = std::make_shared<RGAHelper>();
+    std::future<bool> rga_ready = std::async(std::launch::async, [this]() {
+        return rga_helper_->initialize();
+    });
+    
+    // 按EDID缓存的显示器配置，已知显示器启动时不强制探测
+    profile_store_ = std::make_shared<DisplayProfileStore>();
+    profile_store_->load(display_config_.profile_cache);
+    
     // 创建DRM管理器
     drm_manager_ = std::make_shared<DRMManager>();
-    if (!drm_manager_->initialize()) {
+    drm_manager_->setKmsBackend(display_config_.kms_backend);
+    drm_manager_->setModeSelection(display_config_.mode_selection);
+    drm_manager_->setProfileStore(profile_store_);
+    if (!drm_manager_->initialize(display_config_.drm_device.c_str())) {
         LOG_ERROR("Failed to initialize DRM manager");
         return false;
     }
     
-    // 创建RGA助手
-    rga_helper_ = std::make_shared<RGAHelper>();
-    if (!rga_helper_->initialize()) {
+    if (!rga_ready.get()) {
         LOG_ERROR("Failed to initialize RGA helper");
         return false;
     }
     
+    // udev监视器和GBM设备都只依赖DRM fd，并行创建
+    hotplug_detector_ = std::make_shared<HotplugDetector>();
+    std::future<bool> hotplug_ready = std::async(std::launch::async, [this]() {
+        return hotplug_detector_->initialize(drm_manager_->getFd(), drm_manager_->getCardName());
+    });
+    
     // 创建帧复制器
     frame_copier_ = std::make_shared<FrameCopier>(drm_manager_, rga_helper_);
     if (!frame_copier_->initialize()) {
         LOG_ERROR("Failed to initialize frame copier");
         return false;
     }
+    frame_copier_->setConfig(display_config_);
     
-    // 创建热插拔检测器
-    hotplug_detector_ = std::make_shared<HotplugDetector>();
-    if (!hotplug_detector_->initialize()) {
+    // 翻转完成后释放缓冲区 (事件只在捕获线程中分发)
+    drm_manager_->setPageFlipCallback(
+        [this](const PageFlipEvent& event) {
+            onPageFlipEvent(event);
+        }
+    );
+    
+    // 配置显示器之前等待udev监视器启用，之后的热插拔事件在run之后按顺序分发
+    if (!hotplug_ready.get()) {
         LOG_ERROR("Failed to initialize hotplug detector");
         return false;
     }
     
     // 设置热插拔回调
     hotplug_detector_->setCallback(
-        [this](const std::string& connector_name, HotplugEvent event) {
-            onHotplugEvent(connector_name, event);
+        [this](uint32_t connector_id, const std::string& connector_name, HotplugEvent event) {
+            onHotplugEvent(connector_id, connector_name, event);
         }
     );
     
+    // DRM扫描早于监视器启用，期间的插拔没有事件：按当前状态补记，事件循环启动后作为一批热插拔处理
+    for (uint32_t connector_id : drm_manager_->findChangedConnectors()) {
+        LOG_INFO("Connector {} changed state before the hotplug monitor was ready", connector_id);
+        hotplug_burst_.connectors.insert(connector_id);
+        if (hotplug_burst_.events++ == 0) {
+            hotplug_burst_.first_event = std::chrono::steady_clock::now();
+        }
+    }
+    
+    // 快速启动：先捕获一帧DSI画面，已连接的副显示器modeset时直接显示镜像内容，
+    // 不必等到流水线启动后的第一次翻转
+    if (display_config_.fast_boot) {
+        DisplayInfo* primary = drm_manager_->getPrimaryDisplay();
+        if (!primary || !frame_copier_->captureFrame(primary, boot_frame_)) {
+            LOG_WARN("Fast boot: failed to capture the first DSI frame, secondary displays start blank");
+        }
+    }
+    
     // 初始化显示器状态
     updateDisplays();
+    boot_frame_.reset();
     
     // 初始化复制状态
     updateCopyState();
     
-    LOG_INFO("Display manager initialized successfully");
+    // 启动时没有副显示器就没有首帧可统计
+    if (secondary_display_ids_.empty()) {
+        first_frame_pending_ = false;
+        LOG_INFO("No secondary display at startup, time to first frame not measured");
+    }
+    
+    LOG_INFO("Display manager initialized successfully in {} ms",
+             std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - init_start).count());
     return true;
 }
 
 void DisplayManager::cleanup() {
     stop();
     
+    // 停止工作线程并释放所有状态槽 (销毁显示器缓冲区)，必须在清理帧复制器之前
+    stopOutputWorkers();
+    output_workers_.clear();
+    frame_topology_.reset();
+    present_topology_.reset();
+    std::atomic_store(&topology_, std::shared_ptr<const OutputTopology>());
+    
+    control_server_.cleanup();
+    event_loop_.cleanup();
+    FrameTrace::cleanup();
+    
     if (hotplug_detector_) {
         hotplug_detector_->cleanup();
         hotplug_detector_.reset();
@@ -91,11 +174,38 @@ void DisplayManager::run() {
     
     running_ = true;
     
-    // 启动热插拔监控
+    // 在fork之后锁定内存 (mlockall不会被子进程继承)，之后分配的缓冲区也会被预先映射
+    if (display_config_.realtime.lock_memory) {
+        lockProcessMemory();
+    }
+    
+    // 事件循环的fd在fork之后创建
+    if (!setupEventLoop()) {
+        LOG_ERROR("Failed to set up event loop");
+        running_ = false;
+        return;
+    }
+    if (FrameTrace::enabled() && !display_config_.trace.on_signal) {
+        FrameTrace::start();
+    }
+    capture_stats_.start = std::chrono::steady_clock::now();
+    capture_stats_.bytes_saved_start = frame_copier_->getBytesSaved();
+    capture_stats_.drops_start = capture_drops_;
+    
+    reportFirstFrame();
+    
+    // initialize中创建的工作线程在这里启动：fork只复制调用线程，守护进程中必须在fork之后创建线程
+    for (const auto& [connector_id, worker] : output_workers_) {
+        worker->start();
+    }
+    
+    // 启动热插拔监控 (udev事件由捕获线程的事件循环分发)
     hotplug_detector_->start();
     
-    // 启动帧复制线程
+    // 启动帧捕获线程、呈现线程和重新配置线程 (之后启用的显示器在启用时启动工作线程)
+    reconfigure_thread_ = std::thread(&DisplayManager::reconfigureLoop, this);
     copy_thread_ = std::thread(&DisplayManager::copyLoop, this);
+    present_thread_ = std::thread(&DisplayManager::presentLoop, this);
     
     LOG_INFO("Display manager started");
 }
@@ -112,40 +222,209 @@ void DisplayManager::stop() {
         hotplug_detector_->stop();
     }
     
-    // 等待复制线程结束
+    // 等待正在进行的重新配置结束 (宽限期等待会因running_为false而提前返回)
+    {
+        std::lock_guard<std::mutex> lock(reconfigure_mutex_);
+    }
+    reconfigure_cond_.notify_one();
+    if (reconfigure_thread_.joinable()) {
+        reconfigure_thread_.join();
+    }
+    
+    // 等待捕获线程和呈现线程结束，之后不会再有帧投递给工作线程
+    event_loop_.stop();
     if (copy_thread_.joinable()) {
         copy_thread_.join();
     }
+    control_server_.cleanup();
+    notifyPresenter();
+    if (present_thread_.joinable()) {
+        present_thread_.join();
+    }
+    stopOutputWorkers();
+    
+    // 退出时写出正在记录的跟踪窗口
+    if (FrameTrace::active()) {
+        toggleTrace();
+    }
+    
+    // 保存运行中得到的变换参数和校准结果
+    for (const auto& [connector_id, worker] : output_workers_) {
+        recordProfile(worker->slot());
+    }
     
     LOG_INFO("Display manager stopped");
 }
 
+void DisplayManager::wait() {
+    // 收到SIGINT/SIGTERM后事件循环退出
+    if (copy_thread_.joinable()) {
+        copy_thread_.join();
+    }
+}
+
+void DisplayManager::setStartTime(std::chrono::steady_clock::time_point start) {
+    start_time_ = start;
+    first_frame_pending_ = true;
+}
+
+void DisplayManager::markFirstFrame(const char* path) {
+    // 只统计启动后的第一帧 (任意线程调用，只输出一次)
+    if (!first_frame_pending_.exchange(false)) {
+        return;
+    }
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time_);
+    first_frame_ms_.store(elapsed.count(), std::memory_order_relaxed);
+    
+    // CLOCK_BOOTTIME包含内核启动和systemd排队的时间，即开机到副显示器出现画面的时间
+    struct timespec boot;
+    clock_gettime(CLOCK_BOOTTIME, &boot);
+    int64_t boot_ms = (int64_t)boot.tv_sec * 1000 + boot.tv_nsec / 1000000;
+    first_frame_boot_ms_.store(boot_ms, std::memory_order_relaxed);
+    first_frame_path_ = path;
+    
+    // initialize中点亮的第一帧 (快速启动、硬件克隆) 发生在守护进程fork之前，由run在继续运行的进程中报告
+    if (running_) {
+        reportFirstFrame();
+    }
+}
+
+void DisplayManager::reportFirstFrame() {
+    if (!first_frame_path_) {
+        return;
+    }
+    LOG_INFO("Time to first frame: {} ms from process start, {} ms from kernel boot ({}, PID {})",
+             first_frame_ms_.load(std::memory_order_relaxed), first_frame_boot_ms_.load(std::memory_order_relaxed),
+             first_frame_path_, getpid());
+    first_frame_path_ = nullptr;
+}
+
 void DisplayManager::setDisplayConfig(const DisplayConfig& config) {
+    // 在initialize之前调用时，配置会在创建帧复制器时生效
+    display_config_ = config;
+    governor_.setConfig(config.governor);
     if (frame_copier_) {
         frame_copier_->setConfig(config);
-        LOG_INFO("Display configuration updated: scale={}, rotation={}°, quality={}, debug={}", 
-                (config.scale_mode == DisplayConfig::SCALE_STRETCH ? "stretch" : "keep-aspect"),
-                config.rotation_degrees,
-                (config.quality == DisplayConfig::QUALITY_FAST ? "fast" : "good"),
-                (config.enable_debug ? "enabled" : "disabled"));
+    }
+    
+    LOG_INFO("Display configuration updated: scale={}, rotation={}°, quality={}, format={}, debug={}", 
+            (config.scale_mode == DisplayConfig::SCALE_STRETCH ? "stretch" : "keep-aspect"),
+            config.rotation_degrees,
+            (config.quality == DisplayConfig::QUALITY_FAST ? "fast" : "good"),
+            outputFormatName(config.output_format),
+            (config.enable_debug ? "enabled" : "disabled"));
+    for (const auto& [name, format] : config.display_formats) {
+        LOG_INFO("  Output format override: {} -> {}", name, outputFormatName(format));
+    }
+    LOG_INFO("  Governor: {} ({}-{} FPS, thermal limit {}°C)",
+             config.governor.enabled ? "enabled" : "disabled", config.governor.min_fps,
+             config.governor.max_fps, config.governor.thermal_limit_c);
+    if (config.realtime.priority > 0 || config.realtime.lock_memory) {
+        LOG_INFO("  Real-time: SCHED_FIFO priority {}, CPUs {}, memory {}",
+                 config.realtime.priority, formatCpuList(resolveCpus(config.realtime)),
+                 config.realtime.lock_memory ? "locked" : "unlocked");
     }
 }
 
-void DisplayManager::onHotplugEvent(const std::string& connector_name, HotplugEvent event) {
-    std::lock_guard<std::mutex> lock(display_mutex_);
-    
-    LOG_INFO("Processing hotplug event: {} {}", connector_name, 
+void DisplayManager::onHotplugEvent(uint32_t connector_id, const std::string& connector_name, HotplugEvent event) {
+    // 在捕获线程的事件循环中调用，只记录事件，不做任何阻塞操作
+    LOG_INFO("Hotplug event: {} {}", connector_name, 
              (event == HotplugEvent::CONNECTED ? "connected" : "disconnected"));
     
-    // 重新扫描显示器
-    drm_manager_->scanDisplays();
-    updateDisplays();
+    // 一个窗口内的事件合并为一次重新配置，窗口从第一个事件开始计时，连续的事件不会无限推迟
+    hotplug_burst_.connectors.insert(connector_id);
+    if (hotplug_burst_.events++ == 0) {
+        hotplug_burst_.first_event = std::chrono::steady_clock::now();
+        event_loop_.setTimer(hotplug_timer_, kHotplugSettle, false);
+    }
+}
+
+bool DisplayManager::onHotplugSettled() {
+    if (hotplug_burst_.events == 0) {
+        return false;
+    }
     
-    // 更新复制状态
+    // 交给重新配置线程；它仍在处理上一批时合并到下一批，保留最早的事件时间
+    {
+        std::lock_guard<std::mutex> lock(reconfigure_mutex_);
+        if (queued_burst_.events == 0) {
+            queued_burst_.first_event = hotplug_burst_.first_event;
+        }
+        queued_burst_.events += hotplug_burst_.events;
+        queued_burst_.connectors.insert(hotplug_burst_.connectors.begin(), hotplug_burst_.connectors.end());
+    }
+    reconfigure_cond_.notify_one();
+    
+    hotplug_burst_ = HotplugBurst();
+    return true;
+}
+
+void DisplayManager::reconfigureLoop() {
+    LOG_INFO("Display reconfiguration thread started");
+    
+    // 普通优先级：modeset、sleep和重试都在这里，不影响实时的捕获和呈现线程
+    while (running_) {
+        HotplugBurst burst;
+        {
+            std::unique_lock<std::mutex> lock(reconfigure_mutex_);
+            reconfigure_cond_.wait(lock, [this] { return queued_burst_.events > 0 || !running_; });
+            burst = queued_burst_;
+            queued_burst_ = HotplugBurst();
+        }
+        
+        if (running_) {
+            reconfigure(burst);
+        }
+    }
+    
+    LOG_INFO("Display reconfiguration thread stopped");
+}
+
+void DisplayManager::reconfigure(const HotplugBurst& burst) {
+    auto start = std::chrono::steady_clock::now();
+    
+    // 重新扫描显示器 (只强制探测状态变化的连接器)，新配置在旁边构建好之后一次发布
+    drm_manager_->rescanDisplays(burst.connectors);
+    updateDisplays(&burst.connectors);
     updateCopyState();
+    
+    auto done = std::chrono::steady_clock::now();
+    auto ms = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+    };
+    LOG_INFO("Display reconfiguration: {} hotplug event(s) coalesced, {} ms from first event "
+             "({} ms settle and queueing, {} ms rescan and modeset)",
+             burst.events, ms(done - burst.first_event), ms(start - burst.first_event), ms(done - start));
+    
+    uint64_t total_ms = ms(done - burst.first_event);
+    reconfigure_last_ms_.store(total_ms, std::memory_order_relaxed);
+    if (total_ms > reconfigure_max_ms_.load(std::memory_order_relaxed)) {
+        reconfigure_max_ms_.store(total_ms, std::memory_order_relaxed);
+    }
+    reconfigure_count_.fetch_add(1, std::memory_order_relaxed);
 }
 
-void DisplayManager::updateDisplays() {
+bool DisplayManager::outputChanged(const DisplayInfo& display) const {
+    // 硬件克隆：仍然挂在主CRTC上即可
+    if (hw_clone_ids_.count(display.connector_id)) {
+        return !primary_display_ || display.crtc_id != primary_display_->crtc_id;
+    }
+    
+    // 没有工作线程 (上次启用失败) 时重新尝试启用
+    auto it = output_workers_.find(display.connector_id);
+    if (it == output_workers_.end()) {
+        return true;
+    }
+    
+    const DisplayInfo& active = it->second->slot().display;
+    return active.crtc_id != display.crtc_id || active.plane_id != display.plane_id ||
+           active.mode.clock != display.mode.clock || active.mode.hdisplay != display.mode.hdisplay ||
+           active.mode.vdisplay != display.mode.vdisplay || active.mode.htotal != display.mode.htotal ||
+           active.mode.vtotal != display.mode.vtotal || active.mode.flags != display.mode.flags;
+}
+
+void DisplayManager::updateDisplays(const std::set<uint32_t>* changed_connectors) {
     auto displays = drm_manager_->getDisplays();
     
     // 查找主显示器
@@ -157,6 +436,8 @@ void DisplayManager::updateDisplays() {
     // 智能更新副显示器列表，只处理状态变化的显示器
     std::set<uint32_t> old_secondary_ids(secondary_display_ids_.begin(), secondary_display_ids_.end());
     std::set<uint32_t> new_secondary_ids;
+    std::vector<RetiredOutput> retired;
+    std::vector<std::pair<DisplayInfo*, bool>> enabling;  // (显示器, 是否需要先复位CRTC)
     
     for (auto& display : displays) {
         if (!display.is_primary && isSecondaryDisplay(display.name)) {
@@ -169,186 +450,983 @@ void DisplayManager::updateDisplays() {
             if (should_enable && !was_enabled) {
                 // 新连接的显示器，启用它
                 LOG_INFO("New display connected: {}", display.name);
-                enableSecondaryDisplay(&display);
+                enabling.push_back({&display, true});
             } else if (!should_enable && was_enabled) {
                 // 断开连接的显示器，禁用它
                 LOG_INFO("Display disconnected: {}", display.name);
-                disableSecondaryDisplay(&display);
-            } else if (should_enable && was_enabled) {
-                // 显示器重新连接，可能需要重新创建缓冲区
+                retireSecondaryDisplay(&display, retired);
+            } else if (should_enable && was_enabled &&
+                       ((changed_connectors && changed_connectors->count(display.connector_id)) ||
+                        outputChanged(display))) {
+                // 本批热插拔中重新插拔过 (可能换了显示器)，或模式/CRTC发生变化：重新创建缓冲区
                 LOG_INFO("Display reconnected, refreshing buffers: {}", display.name);
-                disableSecondaryDisplay(&display);
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-                enableSecondaryDisplay(&display);
+                retireSecondaryDisplay(&display, retired);
+                enabling.push_back({&display, false});
             }
-            // 对于已经正确配置的显示器，不做任何操作避免黑屏
+            // 其余已经正确配置的显示器不做任何操作：不摘下、不modeset，避免其他输出的插拔使其黑屏
+        }
+    }
+    
+    // 移除的显示器一次从拓扑中摘下，只等待一个宽限期
+    if (!retired.empty()) {
+        publishTopology();
+        synchronizeTopology();
+        for (auto& output : retired) {
+            disableSecondaryDisplay(output);
         }
+        retired.clear();
+    }
+    
+    // 新显示器的缓冲区、modeset和工作线程都准备好之后一次加入拓扑
+    for (const auto& [display, reset_crtc] : enabling) {
+        enableSecondaryDisplay(display, reset_crtc);
     }
     
     secondary_display_ids_.assign(new_secondary_ids.begin(), new_secondary_ids.end());
     
-    LOG_INFO("Updated displays: {} secondary displays found", secondary_display_ids_.size());
+    publishTopology();
+    
+    LOG_INFO("Updated displays: {} secondary displays found, {} in hardware clone mode", 
+             secondary_display_ids_.size(), hw_clone_ids_.size());
+    for (const auto& display : displays) {
+        if (hw_clone_ids_.count(display.connector_id)) {
+            LOG_INFO("  {}: hardware clone of {}", display.name, 
+                     primary_display_ ? primary_display_->name : "primary");
+        }
+    }
 }
 
-void DisplayManager::enableSecondaryDisplay(DisplayInfo* display) {
+void DisplayManager::enableSecondaryDisplay(DisplayInfo* display, bool reset_crtc) {
     if (!display || !display->connected) {
         return;
     }
+    auto start = std::chrono::steady_clock::now();
 
     LOG_INFO("Enabling secondary display: {}", display->name);
     LOG_DEBUG("Display details: connector_id={}, encoder_id={}, crtc_id={}, mode={}x{}@{}Hz", 
               display->connector_id, display->encoder_id, display->crtc_id,
               display->mode.hdisplay, display->mode.vdisplay, display->mode.vrefresh);
     
-    // 首先禁用显示器以清理之前的状态
-    drm_manager_->disableDisplay(display);
+    // 硬件克隆：不需要缓冲区和逐帧复制
+    if (enableHardwareClone(display)) {
+        return;
+    }
+    if (primary_display_ && display->crtc_id == primary_display_->crtc_id) {
+        LOG_ERROR("{} is still attached to the primary CRTC", display->name);
+        return;
+    }
+    
+    // legacy路径：首先禁用显示器以清理之前的状态 (重新连接时刚刚禁用过，不再重复)
+    // 沿用固件模式时CRTC已经处于目标模式，禁用反而会黑屏
+    if (!drm_manager_->isAtomic() && reset_crtc && !display->boot_mode) {
+        drm_manager_->disableDisplay(display);
+        
+        // 等待硬件准备就绪
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
     
-    // 等待硬件准备就绪
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // 已知显示器沿用上次的格式、变换参数和校准结果
+    DisplayProfile profile;
+    bool known = display->edid_hash && profile_store_->find(display->edid_hash, profile);
+    if (known) {
+        LOG_INFO("Using cached profile for {} (EDID {:016x})", display->name, display->edid_hash);
+    }
     
-    // 创建显示器缓冲区
-    if (!frame_copier_->createBuffersForDisplay(display)) {
+    // 创建显示器状态槽和缓冲区 (失败返回时由槽的析构释放)
+    std::shared_ptr<OutputSlot> slot = frame_copier_->createOutputSlot(*display, known ? &profile : nullptr);
+    if (!slot) {
         LOG_ERROR("Failed to create buffers for {}", display->name);
         return;
     }
 
     // 获取当前缓冲区的framebuffer ID
-    GBMBuffer* buffer = frame_copier_->getCurrentBuffer(display);
+    GBMBuffer* buffer = slot->swapchain.getScanoutBuffer();
     if (!buffer || !buffer->fb_id) {
         LOG_ERROR("Failed to get framebuffer for {}", display->name);
-        frame_copier_->destroyBuffersForDisplay(display);
         return;
     }
+    uint32_t fb_id = buffer->fb_id;
+    
+    // 快速启动：modeset的缓冲区预先写入启动时捕获的DSI帧，点亮时就是镜像画面
+    bool boot_frame = false;
+    if (boot_frame_) {
+        uint32_t rendered = frame_copier_->renderToDisplay(boot_frame_.buffer(), *slot);
+        if (rendered) {
+            fb_id = rendered;
+            boot_frame = true;
+        }
+    }
 
-    // 启用显示器，带重试机制
-    bool enabled = false;
-    for (int retry = 0; retry < 3; retry++) {
-        if (drm_manager_->setCRTCWithFramebuffer(display, buffer->fb_id)) {
-            enabled = true;
-            break;
+    if (drm_manager_->isAtomic()) {
+        // atomic路径：先TEST_ONLY校验，再一次性modeset，无需sleep和重试
+        if (!drm_manager_->testDisplayConfig(display, fb_id) ||
+            !drm_manager_->setCRTCWithFramebuffer(display, fb_id)) {
+            LOG_ERROR("Failed to enable display {} (atomic)", display->name);
+            return;
         }
-        LOG_WARN("Failed to enable display {} (attempt {}/3), retrying...", display->name, retry + 1);
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    } else {
+        // 启用显示器，带重试机制
+        bool enabled = false;
+        for (int retry = 0; retry < 3; retry++) {
+            if (drm_manager_->setCRTCWithFramebuffer(display, fb_id)) {
+                enabled = true;
+                break;
+            }
+            LOG_WARN("Failed to enable display {} (attempt {}/3), retrying...", display->name, retry + 1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        
+        if (!enabled) {
+            LOG_ERROR("Failed to enable display {} after 3 attempts", display->name);
+            return;
+        }
+    }
+
+    if (boot_frame) {
+        {
+            std::lock_guard<std::mutex> lock(slot->mutex);
+            slot->swapchain.markScanout(fb_id);
+        }
+        markFirstFrame("boot frame");
     }
     
-    if (!enabled) {
-        LOG_ERROR("Failed to enable display {} after 3 attempts", display->name);
-        frame_copier_->destroyBuffersForDisplay(display);
-        return;
+    // 工作线程启动之前记录选定的模式和格式
+    recordProfile(*slot);
+    
+    // 发布后该槽由显示器自己的工作线程使用
+    auto worker = std::make_shared<OutputWorker>(slot, frame_copier_, [this]() { notifyPresenter(); });
+    if (running_) {
+        worker->start();  // initialize中启用的显示器由run启动 (守护进程fork之后)
     }
+    output_workers_[display->connector_id] = worker;
 
-    LOG_INFO("Successfully enabled display {}", display->name);
+    // 交换链缓存命中时不需要分配缓冲区，启用时间主要是一次modeset
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    uint64_t lookups = frame_copier_->getSwapchainCacheLookups();
+    LOG_INFO("Successfully enabled display {} in {} ms{}{} (swapchain cache hit rate {:.0f}%, {}/{})",
+             display->name, elapsed.count(),
+             display->boot_mode ? ", kept boot mode" : "", boot_frame ? ", showing the boot frame" : "",
+             lookups ? 100.0 * frame_copier_->getSwapchainCacheHits() / lookups : 0.0,
+             frame_copier_->getSwapchainCacheHits(), lookups);
 }
 
-void DisplayManager::disableSecondaryDisplay(DisplayInfo* display) {
+bool DisplayManager::enableHardwareClone(DisplayInfo* display) {
+    if (!primary_display_ || !primary_display_->crtc_id) {
+        return false;
+    }
+    
+    bool attached = (display->crtc_id == primary_display_->crtc_id);
+    {
+        // 共享CRTC时无法旋转或缩放，只有rotation为0时才使用
+        // 检查旋转到登记克隆之间持有锁，控制命令和配置重载不能在此期间设置旋转
+        std::lock_guard<std::mutex> lock(clone_rotation_mutex_);
+        bool allowed = display_config_.hw_clone && frame_copier_->getRotation() == 0;
+        if (allowed && drm_manager_->canClone(primary_display_, display)) {
+            if (attached || drm_manager_->attachClone(primary_display_, display)) {
+                hw_clone_ids_.insert(display->connector_id);
+                hw_clone_count_.store(hw_clone_ids_.size(), std::memory_order_relaxed);
+                markFirstFrame("hardware clone");
+                LOG_INFO("{} running in hardware clone mode (shares CRTC {} with {})",
+                         display->name, primary_display_->crtc_id, primary_display_->name);
+                return true;
+            }
+            LOG_WARN("Hardware clone of {} failed, using copy pipeline", display->name);
+        }
+    }
+    
+    // 之前留下的克隆 (或刚被摘下的克隆)：重新扫描，为其分配独立的CRTC
+    if (attached && !drm_manager_->detachClone(primary_display_, display)) {
+        return false;
+    }
+    if (!attached && display->crtc_id) {
+        return false;
+    }
+    drm_manager_->scanDisplays();
+    primary_display_ = drm_manager_->getPrimaryDisplay();
+    DisplayInfo* rescanned = drm_manager_->getDisplayByName(display->name);
+    if (rescanned) {
+        *display = *rescanned;
+    }
+    return false;
+}
+
+void DisplayManager::retireSecondaryDisplay(DisplayInfo* display, std::vector<RetiredOutput>& retired) {
     if (!display) {
         return;
     }
     
     LOG_INFO("Disabling secondary display: {}", display->name);
     
+    // 硬件克隆的显示器共享主CRTC，只能摘下连接器，不能关闭CRTC
+    bool was_clone = hw_clone_ids_.erase(display->connector_id);
+    hw_clone_count_.store(hw_clone_ids_.size(), std::memory_order_relaxed);
+    if (was_clone || (primary_display_ && display->crtc_id == primary_display_->crtc_id)) {
+        drm_manager_->detachClone(primary_display_, display);
+        LOG_INFO("Successfully disabled display {}", display->name);
+        return;
+    }
+    
+    // 先从拓扑中移除，等捕获和呈现线程放弃旧快照之后再停止工作线程
+    RetiredOutput output;
+    output.display = *display;
+    auto it = output_workers_.find(display->connector_id);
+    if (it != output_workers_.end()) {
+        output.worker = it->second;
+        output_workers_.erase(it);
+    }
+    retired.push_back(output);
+}
+
+void DisplayManager::disableSecondaryDisplay(RetiredOutput& output) {
+    // 已经不在任何线程的快照中，之后不会再有该CRTC的翻转
+    if (output.worker) {
+        output.worker->stop();
+        recordProfile(output.worker->slot());
+    }
+    
     // 禁用显示器
-    drm_manager_->disableDisplay(display);
+    drm_manager_->disableDisplay(&output.display);
     
     // 销毁显示器缓冲区
-    frame_copier_->destroyBuffersForDisplay(display);
+    output.worker.reset();
     
-    LOG_INFO("Successfully disabled display {}", display->name);
+    LOG_INFO("Successfully disabled display {}", output.display.name);
 }
 
 void DisplayManager::copyLoop() {
-    LOG_INFO("Frame copy loop started");
+    LOG_INFO("Frame capture loop started");
+    applyThreadScheduling(display_config_.realtime, "Capture", true);
     
-    const auto target_frame_time = std::chrono::microseconds(16667); // 60 FPS = 16.667ms per frame (提高目标帧率)
-    auto last_frame_time = std::chrono::steady_clock::now();
-    int frame_count = 0;
-    auto fps_start_time = last_frame_time;
+    // DRM事件、热插拔、帧节拍和信号都在这里分发，直到收到退出信号或stop()
+    event_loop_.run();
     
-    while (running_) {
-        auto frame_start = std::chrono::steady_clock::now();
-        
-        // 只有当有活跃的副显示器时才进行复制
-        if (copy_enabled_.load()) {
-            copyFrameToSecondaryDisplays();
+    LOG_INFO("Frame capture loop stopped");
+}
+
+bool DisplayManager::setupEventLoop() {
+    if (!event_loop_.initialize()) {
+        return false;
+    }
+    
+    // 翻转完成事件释放可重用的缓冲区，主显示器的vblank事件触发捕获
+    drm_manager_->setVBlankCallback([this](uint64_t) {
+        onCaptureVBlank();
+    });
+    bool ok = event_loop_.addFd(drm_manager_->getFd(), [this]() {
+        return drm_manager_->handleEvents();
+    });
+    
+    // 热插拔事件
+    ok = ok && event_loop_.addFd(hotplug_detector_->getFd(), [this]() {
+        return hotplug_detector_->processEvents();
+    });
+    
+    // 热插拔合并窗口 (单次定时器)
+    hotplug_timer_ = event_loop_.createTimer([this](uint64_t) {
+        return onHotplugSettled();
+    });
+    ok = ok && hotplug_timer_ >= 0;
+    // initialize中补记的热插拔
+    if (ok && hotplug_burst_.events > 0) {
+        event_loop_.setTimer(hotplug_timer_, kHotplugSettle, false);
+    }
+    
+    // 帧节拍：只在有需要复制的副显示器时启用，间隔由调节器决定
+    pacing_timer_ = event_loop_.createTimer([this](uint64_t expirations) {
+        return onFrameTick(expirations);
+    });
+    ok = ok && pacing_timer_ >= 0;
+    
+    // 退出信号 (已在main中屏蔽，由signalfd同步接收)
+    ok = ok && event_loop_.addSignals({SIGINT, SIGTERM}, [this](int signo) {
+        LOG_INFO("Received signal {}, shutting down...", signo);
+        event_loop_.stop();
+    });
+    
+    // SIGUSR1：输出本周期到目前为止的各阶段耗时，不重置
+    ok = ok && event_loop_.addSignals({SIGUSR1}, [this](int) {
+        reportStageTimings(false);
+    });
+    
+    // SIGHUP (systemctl reload)：重新读取配置文件
+    ok = ok && event_loop_.addSignals({SIGHUP}, [this](int) {
+        reloadConfig();
+    });
+    
+    // SIGUSR2：开始/结束一个逐帧跟踪窗口，结束时写出Chrome trace
+    if (FrameTrace::enabled()) {
+        ok = ok && event_loop_.addSignals({SIGUSR2}, [this](int) {
+            toggleTrace();
+        });
+    }
+    
+    // 控制套接字是可选的，创建失败时只记录警告
+    if (ok && !display_config_.control_socket.empty()) {
+        control_server_.setMetricsProvider([this]() { return formatMetrics(); });
+        control_server_.setCommandHandler([this](const std::vector<std::string>& args) {
+            return handleControlCommand(args);
+        });
+        if (!control_server_.initialize(display_config_.control_socket, &event_loop_)) {
+            LOG_WARN("Control socket disabled");
+        }
+    }
+    
+    event_loop_.setPrepareCallback([this]() { prepareFrameLoop(); });
+    return ok;
+}
+
+void DisplayManager::prepareFrameLoop() {
+    // 每次等待前确认拓扑版本 (热插拔处理可能在等待宽限期)
+    acquireFrameTopology();
+    updatePacingTimer();
+}
+
+void DisplayManager::updatePacingTimer() {
+    // 帧率变化或复制启停时才重新设置定时器
+    auto interval = copy_enabled_.load() ? governor_.frameInterval() : std::chrono::microseconds(0);
+    if (interval != pacing_interval_) {
+        event_loop_.setTimer(pacing_timer_, interval);
+        pacing_interval_ = interval;
+        capture_stats_.last_tick = std::chrono::steady_clock::time_point();
+    }
+}
+
+bool DisplayManager::onFrameTick(uint64_t expirations) {
+    auto now = std::chrono::steady_clock::now();
+    CaptureStats& stats = capture_stats_;
+    
+    // 帧间隔抖动：只统计连续的节拍，定时器重新设置后的第一帧不计入
+    if (stats.last_tick != std::chrono::steady_clock::time_point()) {
+        stats.jitter.add(std::chrono::duration_cast<std::chrono::microseconds>(now - stats.last_tick).count());
+    }
+    stats.last_tick = now;
+    stats.missed_ticks += expirations - 1;
+    
+    if (!copy_enabled_.load()) {
+        return false;
+    }
+    
+    // 在DSI的下一个vblank之后捕获，确保framebuffer已经翻转完成；事件随DRM fd分发，不阻塞事件循环
+    if (capture_vblank_requested_ != std::chrono::steady_clock::time_point()) {
+        // 上一次请求的事件还没到 (CRTC关闭时永远不会到)，超时后放弃，直接捕获
+        if (now - capture_vblank_requested_ < kCaptureVBlankTimeout) {
+            stats.missed_ticks++;
+            return true;
+        }
+        capture_vblank_requested_ = std::chrono::steady_clock::time_point();
+    } else {
+        const OutputTopology* topology = frame_topology_.get();
+        if (topology && topology->has_primary && drm_manager_->requestVBlankEvent(&topology->primary)) {
+            capture_vblank_requested_ = now;
+            return true;
+        }
+    }
+    
+    captureAndPost(now);
+    return true;
+}
+
+void DisplayManager::onCaptureVBlank() {
+    if (capture_vblank_requested_ == std::chrono::steady_clock::time_point()) {
+        return;  // 已超时放弃的请求
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    frame_copier_->captureStages().record(PipelineStage::VBLANK_WAIT,
+        std::chrono::duration_cast<std::chrono::microseconds>(now - capture_vblank_requested_).count());
+    capture_vblank_requested_ = std::chrono::steady_clock::time_point();
+    
+    if (copy_enabled_.load()) {
+        captureAndPost(now);
+    }
+}
+
+void DisplayManager::captureAndPost(std::chrono::steady_clock::time_point now) {
+    CaptureStats& stats = capture_stats_;
+    copyFrameToSecondaryDisplays();
+    stats.frames++;
+    
+    // 调节器按窗口评估，质量变化由工作线程在下一帧生效
+    if (governor_.windowElapsed() && governor_.update(frame_copier_->takeTransformPeakUs())) {
+        frame_copier_->setFastQuality(governor_.useFastQuality());
+    }
+    
+    // 每5分钟报告一次 (减少日志频率)
+    if (now - stats.start >= std::chrono::seconds(300)) {
+        reportCaptureStats(now);
+    }
+}
+
+void DisplayManager::reportCaptureStats(std::chrono::steady_clock::time_point now) {
+    CaptureStats& stats = capture_stats_;
+    double seconds = std::chrono::duration<double>(now - stats.start).count();
+    
+    // 各显示器的帧率和丢帧由其工作线程单独报告
+    uint64_t bytes_saved = frame_copier_->getBytesSaved() - stats.bytes_saved_start;
+    LOG_INFO("Capture rate: {:.1f} FPS (avg over {:.0f}s), {} captures dropped, {} missed ticks, scanout bandwidth saved: {:.1f} MB/s", 
+             stats.frames / seconds, seconds, capture_drops_ - stats.drops_start, stats.missed_ticks,
+             bytes_saved / (1024.0 * 1024.0) / seconds);
+    
+    // 与不启用实时调度时的结果对比，评估SCHED_FIFO/绑核/mlock的效果
+    LOG_INFO("Capture interval: mean {:.0f} us, jitter (stddev) {:.0f} us, min {} us, max {} us ({}, CPUs {}{})",
+             stats.jitter.meanUs(), stats.jitter.stddevUs(), stats.jitter.minUs(), stats.jitter.maxUs(),
+             display_config_.realtime.priority > 0 ? "SCHED_FIFO" : "SCHED_OTHER",
+             formatCpuList(resolveCpus(display_config_.realtime)),
+             display_config_.realtime.lock_memory ? ", mlocked" : "");
+    
+    // 空闲唤醒：事件循环醒来但没有任何实际工作
+    uint64_t wakeups = event_loop_.wakeups() - stats.wakeups_start;
+    uint64_t idle_wakeups = event_loop_.idleWakeups() - stats.idle_wakeups_start;
+    LOG_INFO("Event loop: {:.1f} wakeups/s, {:.2f} idle wakeups/s", wakeups / seconds, idle_wakeups / seconds);
+    
+    const GovernorMetrics& governor = governor_.metrics();
+    LOG_INFO("Governor: {} FPS, quality {}, change ratio {:.2f}, capture {} us, transform {} us, {}°C{}, {} decisions",
+             governor.fps, governor.fast_quality ? "fast" : "configured", governor.change_ratio,
+             governor.capture_us, governor.transform_us, governor.temperature_c,
+             governor.cpufreq_throttled ? " (cpufreq throttled)" : "", governor.decisions);
+    
+    KmsStats kms = drm_manager_->getKmsStats();
+    if (drm_manager_->isAtomic() && kms.commit_count > 0) {
+        LOG_INFO("Atomic KMS: {} tests (avg {} us, max {} us), {} commits (avg {} us, max {} us, {} failed)",
+                 kms.test_count, kms.test_count ? kms.test_total_us / kms.test_count : 0,
+                 kms.test_max_us, kms.commit_count, kms.commit_total_us / kms.commit_count,
+                 kms.commit_max_us, kms.commit_failures);
+    }
+    
+    // 副显示器各阶段的耗时由其工作线程随帧率一起报告
+    const OutputTopology* topology = frame_topology_.get();
+    if (topology && topology->has_primary) {
+        frame_copier_->captureStages().report(topology->primary.name, true);
+    }
+    
+    stats.start = now;
+    stats.frames = 0;
+    stats.missed_ticks = 0;
+    stats.bytes_saved_start += bytes_saved;
+    stats.drops_start = capture_drops_;
+    stats.wakeups_start += wakeups;
+    stats.idle_wakeups_start += idle_wakeups;
+    stats.jitter.reset();
+}
+
+bool DisplayManager::toggleTrace() {
+    if (!FrameTrace::active()) {
+        FrameTrace::start();
+        return true;
+    }
+    
+    // 记录已停止，写文件 (几MB) 造成的停顿不会出现在跟踪中
+    FrameTrace::stop();
+    return FrameTrace::dump(display_config_.trace.file) >= 0;
+}
+
+static const char* scaleModeName(DisplayConfig::ScaleMode mode) {
+    return mode == DisplayConfig::SCALE_STRETCH ? "stretch" : "keep-aspect";
+}
+
+static const char* qualityName(DisplayConfig::Quality quality) {
+    return quality == DisplayConfig::QUALITY_FAST ? "fast" : "good";
+}
+
+bool DisplayManager::setTransformSettings(const TransformSettings& settings, std::string& error) {
+    // 硬件克隆共享主CRTC，无法旋转；需要重新插拔或重启后改为复制路径
+    std::lock_guard<std::mutex> lock(clone_rotation_mutex_);
+    if (settings.rotation_degrees != 0 && hw_clone_count_.load(std::memory_order_relaxed) > 0) {
+        error = "hardware clone active, rotation must stay 0";
+        return false;
+    }
+    frame_copier_->setSettings(settings);
+    return true;
+}
+
+bool DisplayManager::reloadConfig() {
+    const std::string& path = display_config_.config_file;
+    if (path.empty()) {
+        LOG_WARN("Configuration reload requested, but no configuration file is set");
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    
+    // 以当前生效的设置为基础 (控制命令可能修改过)，文件中没有的键保持不变
+    TransformSettings current = frame_copier_->currentSettings();
+    DisplayConfig config = display_config_;
+    config.rotation_degrees = current.rotation_degrees;
+    config.scale_mode = current.scale_mode;
+    config.quality = current.quality;
+    
+    std::string error;
+    if (!loadConfigFile(path, config, error)) {
+        LOG_ERROR("Configuration reload failed, keeping the current settings: {}", error);
+        return false;
+    }
+    
+    TransformSettings settings;
+    settings.rotation_degrees = config.rotation_degrees;
+    settings.scale_mode = config.scale_mode;
+    settings.quality = config.quality;
+    // 硬件克隆时旋转保持不变，其余设置照常生效 (与enableHardwareClone互斥，直到新设置发布)
+    std::unique_lock<std::mutex> clone_lock(clone_rotation_mutex_);
+    if (settings.rotation_degrees != current.rotation_degrees && settings.rotation_degrees != 0 &&
+        hw_clone_count_.load(std::memory_order_relaxed) > 0) {
+        LOG_WARN("Keeping rotation {}°: hardware clone active", current.rotation_degrees);
+        settings.rotation_degrees = current.rotation_degrees;
+    }
+    
+    // 只列出变化的设置；缓冲区和模式都不受影响，不需要modeset
+    std::string changes;
+    auto changed = [&changes](const std::string& change) {
+        changes += (changes.empty() ? "" : ", ") + change;
+    };
+    if (settings.rotation_degrees != current.rotation_degrees) {
+        changed("rotation " + std::to_string(settings.rotation_degrees));
+    }
+    if (settings.scale_mode != current.scale_mode) {
+        changed(std::string("scale-mode ") + scaleModeName(settings.scale_mode));
+    }
+    if (settings.quality != current.quality) {
+        changed(std::string("quality ") + qualityName(settings.quality));
+    }
+    if (!changes.empty()) {
+        frame_copier_->setSettings(settings);
+    }
+    clone_lock.unlock();
+    
+    // 调节器只在捕获线程中使用，直接替换配置
+    const GovernorConfig& old_governor = display_config_.governor;
+    const GovernorConfig& new_governor = config.governor;
+    if (new_governor.enabled != old_governor.enabled || new_governor.max_fps != old_governor.max_fps ||
+        new_governor.min_fps != old_governor.min_fps || new_governor.thermal_limit_c != old_governor.thermal_limit_c) {
+        governor_.setConfig(new_governor);
+        frame_copier_->setFastQuality(governor_.useFastQuality());
+        changed("governor " + std::string(new_governor.enabled ? "on" : "off") + " " +
+                std::to_string(new_governor.min_fps) + "-" + std::to_string(new_governor.max_fps) + " FPS, " +
+                std::to_string(new_governor.thermal_limit_c) + "°C");
+    }
+    
+    display_config_.rotation_degrees = settings.rotation_degrees;
+    display_config_.scale_mode = settings.scale_mode;
+    display_config_.quality = settings.quality;
+    display_config_.governor = new_governor;
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    LOG_INFO("Configuration reloaded from {} in {} us: {}", path, elapsed.count(),
+             changes.empty() ? "no changes" : changes + " (applied at the next frame, no modeset)");
+    return true;
+}
+
+void DisplayManager::reportStageTimings(bool reset) {
+    const OutputTopology* topology = frame_topology_.get();
+    if (!topology) {
+        return;
+    }
+    
+    LOG_INFO("Stage timings (current report period):");
+    if (topology->has_primary) {
+        frame_copier_->captureStages().report(topology->primary.name, reset);
+    }
+    for (const auto& worker : topology->outputs) {
+        worker->slot().stages.report(worker->slot().display.name, reset);
+    }
+}
+
+std::string DisplayManager::formatMetrics() {
+    // 在捕获线程中执行：捕获统计、调节器和事件循环计数器都属于本线程，其余为原子量或持锁读取
+    MetricsWriter metrics;
+    auto now = std::chrono::steady_clock::now();
+    
+    metrics.gauge("rk3588_display_info", "Backends in use (value is always 1)", 1,
+                  {{"kms", drm_manager_->isAtomic() ? "atomic" : "legacy"},
+                   {"buffers", bufferBackendName(rga_helper_->getBufferBackend())}});
+    
+    metrics.counter("rk3588_display_captured_frames_total", "Frames captured from the primary display",
+                    frame_copier_->getCaptureCount());
+    metrics.counter("rk3588_display_capture_dropped_total", "Captures dropped because all capture buffers were busy",
+                    capture_drops_);
+    
+    // 阶段耗时取当前报告周期 (5分钟或SIGUSR1/stages命令重置之前) 的直方图
+    auto stageGauges = [&](const std::string& name, StageHistograms& stages) {
+        for (size_t i = 0; i < (size_t)PipelineStage::COUNT; i++) {
+            LatencyHistogram::Snapshot snapshot = stages.snapshot((PipelineStage)i, false);
+            if (!snapshot.count) {
+                continue;
+            }
+            const char* stage = pipelineStageName((PipelineStage)i);
+            const char* help = "Pipeline stage latency in the current report period (microseconds)";
+            metrics.gauge("rk3588_display_stage_latency_us", help, snapshot.percentileUs(0.50),
+                          {{"display", name}, {"stage", stage}, {"quantile", "0.5"}});
+            metrics.gauge("rk3588_display_stage_latency_us", help, snapshot.percentileUs(0.99),
+                          {{"display", name}, {"stage", stage}, {"quantile", "0.99"}});
+            metrics.gauge("rk3588_display_stage_latency_us", help, snapshot.max_us,
+                          {{"display", name}, {"stage", stage}, {"quantile", "1"}});
+        }
+    };
+    
+    const OutputTopology* topology = frame_topology_.get();
+    if (topology && topology->has_primary) {
+        stageGauges(topology->primary.name, frame_copier_->captureStages());
+    }
+    
+    std::map<uint32_t, ScrapeBaseline> baselines;
+    if (topology) {
+        for (const auto& worker : topology->outputs) {
+            OutputSlot& slot = worker->slot();
+            const std::string& name = slot.display.name;
+            uint64_t presented = worker->presentedFrames();
             
-            // 非阻塞的等待页面翻转事件
-            drm_manager_->waitForPageFlipEvents(1); // 只等待1ms，不阻塞
+            // 帧率按两次读取之间的差值计算，第一次读取时没有
+            ScrapeBaseline& baseline = baselines[worker->connectorId()];
+            baseline.presented = presented;
+            baseline.time = now;
+            auto previous = scrape_baselines_.find(worker->connectorId());
+            if (previous != scrape_baselines_.end() && now > previous->second.time &&
+                presented >= previous->second.presented) {
+                double seconds = std::chrono::duration<double>(now - previous->second.time).count();
+                metrics.gauge("rk3588_display_fps", "Presented frames per second since the previous scrape",
+                              (presented - previous->second.presented) / seconds, {{"display", name}});
+            }
+            
+            metrics.counter("rk3588_display_presented_frames_total", "Frames submitted for scanout",
+                            presented, {{"display", name}});
+            metrics.counter("rk3588_display_dropped_frames_total", "Frames skipped by latest-frame-wins or full queues",
+                            worker->droppedFrames(), {{"display", name}});
             
-            frame_count++;
+            uint64_t flips, stalls;
+            size_t depth;
+            {
+                std::lock_guard<std::mutex> lock(slot.mutex);
+                flips = slot.stats.flips;
+                stalls = slot.swapchain.starvationStalls();
+                depth = slot.swapchain.depth();
+            }
+            metrics.counter("rk3588_display_flips_total", "Completed page flips", flips, {{"display", name}});
+            metrics.counter("rk3588_display_swapchain_starvation_total",
+                            "Frames skipped because no swapchain buffer was free", stalls, {{"display", name}});
+            metrics.gauge("rk3588_display_swapchain_buffers", "Swapchain depth", depth, {{"display", name}});
+            stageGauges(name, slot.stages);
+        }
+    }
+    scrape_baselines_.swap(baselines);
+    
+    metrics.gauge("rk3588_display_hw_clones", "Displays sharing the primary CRTC",
+                  hw_clone_count_.load(std::memory_order_relaxed));
+    metrics.counter("rk3588_display_swapchain_cache_hits_total", "Swapchain cache hits on display enable",
+                    frame_copier_->getSwapchainCacheHits());
+    metrics.counter("rk3588_display_swapchain_cache_lookups_total", "Swapchain cache lookups on display enable",
+                    frame_copier_->getSwapchainCacheLookups());
+    metrics.counter("rk3588_display_scanout_bytes_saved_total", "Scanout bytes saved by low-bandwidth output formats",
+                    frame_copier_->getBytesSaved());
+    
+    int64_t first_frame_ms = first_frame_ms_.load(std::memory_order_relaxed);
+    if (first_frame_ms >= 0) {
+        metrics.gauge("rk3588_display_startup_first_frame_ms", "Time from process start to the first mirrored frame",
+                      first_frame_ms);
+    }
+    int64_t first_frame_boot_ms = first_frame_boot_ms_.load(std::memory_order_relaxed);
+    if (first_frame_boot_ms >= 0) {
+        metrics.gauge("rk3588_display_boot_first_frame_ms", "Time from kernel boot to the first mirrored frame",
+                      first_frame_boot_ms);
+    }
+    
+    metrics.counter("rk3588_display_reconfigurations_total", "Hotplug reconfigurations",
+                    reconfigure_count_.load(std::memory_order_relaxed));
+    metrics.gauge("rk3588_display_reconfiguration_last_ms", "Last reconfiguration time from first hotplug event",
+                  reconfigure_last_ms_.load(std::memory_order_relaxed));
+    metrics.gauge("rk3588_display_reconfiguration_max_ms", "Longest reconfiguration time from first hotplug event",
+                  reconfigure_max_ms_.load(std::memory_order_relaxed));
+    
+    const GovernorMetrics& governor = governor_.metrics();
+    metrics.gauge("rk3588_display_governor_fps", "Capture rate chosen by the governor", governor.fps);
+    metrics.gauge("rk3588_display_governor_fast_quality", "Governor forced fast quality",
+                  governor.fast_quality ? 1 : 0);
+    metrics.gauge("rk3588_display_temperature_celsius", "SoC temperature seen by the governor",
+                  governor.temperature_c);
+    metrics.gauge("rk3588_display_rotation_degrees", "Current rotation", frame_copier_->getRotation());
+    
+    metrics.counter("rk3588_display_event_loop_wakeups_total", "Capture event loop wakeups", event_loop_.wakeups());
+    metrics.counter("rk3588_display_event_loop_idle_wakeups_total", "Capture event loop wakeups without work",
+                    event_loop_.idleWakeups());
+    
+    KmsStats kms = drm_manager_->getKmsStats();
+    metrics.counter("rk3588_display_kms_commits_total", "Atomic KMS commits", kms.commit_count);
+    metrics.counter("rk3588_display_kms_commit_failures_total", "Failed atomic KMS commits", kms.commit_failures);
+    metrics.counter("rk3588_display_log_dropped_total", "Log records dropped because the queue was full",
+                    Logger::getDroppedCount());
+    
+    return metrics.text();
+}
+
+std::string DisplayManager::handleControlCommand(const std::vector<std::string>& args) {
+    const std::string& command = args[0];
+    const OutputTopology* topology = frame_topology_.get();
+    
+    // 请求各显示器的工作线程在下一帧重新校准 (可以按连接器名只校准一个)
+    auto recalibrate = [&](const std::string& name) {
+        size_t count = 0;
+        if (topology) {
+            for (const auto& worker : topology->outputs) {
+                if (name.empty() || worker->slot().display.name == name) {
+                    worker->slot().recalibrate.store(true, std::memory_order_relaxed);
+                    count++;
+                }
+            }
+        }
+        return count;
+    };
+    
+    if (command == "rotation" && args.size() == 2) {
+        int rotation = atoi(args[1].c_str());
+        if (args[1] != std::to_string(rotation) ||
+            (rotation != 0 && rotation != 90 && rotation != 180 && rotation != 270)) {
+            return "error: rotation must be 0, 90, 180 or 270\n";
+        }
+        TransformSettings settings = frame_copier_->currentSettings();
+        settings.rotation_degrees = rotation;
+        std::string error;
+        if (!setTransformSettings(settings, error)) {
+            return "error: " + error + "\n";
+        }
+        LOG_INFO("Rotation changed to {}°", rotation);
+        return "ok\n";
+    }
+    
+    if (command == "quality" && args.size() == 2) {
+        TransformSettings settings = frame_copier_->currentSettings();
+        if (args[1] == "fast") {
+            settings.quality = DisplayConfig::QUALITY_FAST;
+        } else if (args[1] == "good") {
+            settings.quality = DisplayConfig::QUALITY_GOOD;
         } else {
-            // 没有副显示器时，降低CPU占用
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            return "error: quality must be fast or good\n";
         }
-        
-        // 每30秒报告一次FPS (减少日志频率)
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - fps_start_time);
-        if (elapsed.count() >= 300 && copy_enabled_.load()) {
-            double fps = (double)frame_count / elapsed.count();
-            LOG_INFO("Frame rate: {:.1f} FPS (avg over {}s)", fps, elapsed.count());
-            frame_count = 0;
-            fps_start_time = now;
+        std::string error;
+        if (!setTransformSettings(settings, error)) {
+            return "error: " + error + "\n";
         }
-        
-        // 精确的帧率控制（仅在复制启用时）
-        if (copy_enabled_.load()) {
-            auto frame_end = std::chrono::steady_clock::now();
-            auto frame_duration = std::chrono::duration_cast<std::chrono::microseconds>(frame_end - frame_start);
-            
-            if (frame_duration < target_frame_time) {
-                auto sleep_time = target_frame_time - frame_duration;
-                std::this_thread::sleep_for(sleep_time);
-            }
+        LOG_INFO("Quality changed to {}", args[1]);
+        return "ok\n";
+    }
+    
+    if (command == "reload" && args.size() == 1) {
+        return reloadConfig() ? "ok\n" : "error: reload failed, see the log\n";
+    }
+    
+    if (command == "recalibrate" && args.size() <= 2) {
+        std::string name = args.size() == 2 ? args[1] : std::string();
+        if (!recalibrate(name) && !name.empty()) {
+            return "error: no active output " + name + "\n";
         }
-        
-        last_frame_time = frame_start;
+        return "ok\n";
+    }
+    
+    if (command == "trace" && args.size() == 2 && (args[1] == "start" || args[1] == "stop")) {
+        if (!FrameTrace::enabled()) {
+            return "error: tracing not enabled (start with --trace FILE)\n";
+        }
+        if (FrameTrace::active() == (args[1] == "start")) {
+            return "ok\n";
+        }
+        return toggleTrace() ? "ok\n" : "error: failed to write " + display_config_.trace.file + "\n";
+    }
+    
+    if (command == "stages" && args.size() == 1) {
+        reportStageTimings(false);
+        return "ok\n";
+    }
+    
+    if (command == "help") {
+        return "metrics\n"
+               "rotation 0|90|180|270\n"
+               "quality fast|good\n"
+               "reload\n"
+               "recalibrate [connector]\n"
+               "trace start|stop\n"
+               "stages\n";
     }
     
-    LOG_INFO("Frame copy loop stopped");
+    return "error: unknown command (try help)\n";
 }
 
 void DisplayManager::copyFrameToSecondaryDisplays() {
-    std::lock_guard<std::mutex> lock(display_mutex_);
-    
-    if (!primary_display_ || !primary_display_->connected) {
+    // 只使用本线程持有的快照：不加锁、不复制显示器列表、不查map
+    const OutputTopology* topology = frame_topology_.get();
+    if (!topology || !topology->has_primary || !topology->primary.connected || topology->outputs.empty()) {
         return;
     }
     
-    // 检查是否有连接的副显示器
-    bool has_active_secondary = false;
-    auto displays = drm_manager_->getDisplays();
-    for (uint32_t connector_id : secondary_display_ids_) {
-        for (auto& display : displays) {
-            if (display.connector_id == connector_id && display.connected) {
-                has_active_secondary = true;
-                break;
+    // 只有走复制路径的显示器需要捕获，零拷贝镜像的显示器只需要节拍
+    bool needs_capture = false;
+    for (const auto& worker : topology->outputs) {
+        needs_capture |= worker->needsCapture();
+    }
+    
+    // 帧按引用计数共享给所有工作线程，最后一个工作线程用完后捕获缓冲区才被重用
+    ScopedTraceSpan trace_span(frame_copier_->captureStages().traceTrack(), "frame");
+    FrameRef frame;
+    if (needs_capture) {
+        if (frame_copier_->captureFrame(&topology->primary, frame)) {
+            trace_span.setFrame(frame.get()->sequence);
+            // 降帧期间内容开始变化：按恢复后的帧率重新设置节拍，不等旧的长间隔到期
+            if (governor_.onCapture(frame.get()->changed, frame_copier_->getLastCaptureUs())) {
+                updatePacingTimer();
             }
+        } else {
+            capture_drops_++;
         }
-        if (has_active_secondary) break;
     }
     
-    if (!has_active_secondary) {
+    // 主显示器信息与快照共享生命周期，不复制
+    std::shared_ptr<const DisplayInfo> primary(frame_topology_, &topology->primary);
+    for (const auto& worker : topology->outputs) {
+        worker->post(frame, primary);
+    }
+}
+
+void DisplayManager::presentLoop() {
+    LOG_INFO("Frame present loop started");
+    applyThreadScheduling(display_config_.realtime, "Present", true);
+    
+    while (running_) {
+        {
+            // 只在有帧渲染完成或拓扑变化时唤醒
+            std::unique_lock<std::mutex> lock(present_mutex_);
+            present_cond_.wait(lock, [this] { return present_pending_ || !running_; });
+            present_pending_ = false;
+        }
+        
+        acquirePresentTopology();
+        presentFrames();
+    }
+    
+    LOG_INFO("Frame present loop stopped");
+}
+
+void DisplayManager::presentFrames() {
+    const OutputTopology* topology = present_topology_.get();
+    if (!topology) {
         return;
     }
     
-    // 从主显示器捕获帧
-    FrameBuffer source_frame;
-    if (!frame_copier_->captureFrame(primary_display_, source_frame)) {
+    present_flips_.clear();
+    present_workers_.clear();
+    
+    // 每个显示器只取最新渲染完成的帧，落后时更旧的帧被丢弃
+    for (const auto& worker : topology->outputs) {
+        uint32_t fb_id = worker->takeLatest();
+        if (fb_id) {
+            present_flips_.push_back({&worker->slot().display, fb_id});
+            present_workers_.push_back(worker.get());
+        }
+    }
+    
+    if (present_flips_.empty()) {
         return;
     }
     
-    // 复制到所有连接的副显示器
-    for (uint32_t connector_id : secondary_display_ids_) {
-        for (auto& display : displays) {
-            if (display.connector_id == connector_id && display.connected) {
-                frame_copier_->copyToDisplay(source_frame, &display);
-                break;
-            }
+    // 所有副显示器的翻转统一提交 (atomic下为一次非阻塞提交)，提交耗时计入每个参与的显示器
+    auto submit_start = std::chrono::steady_clock::now();
+    drm_manager_->commitPageFlips(present_flips_);
+    auto submit_end = std::chrono::steady_clock::now();
+    uint64_t submit_us = std::chrono::duration_cast<std::chrono::microseconds>(submit_end - submit_start).count();
+    FrameTrace::span(present_track_, pipelineStageName(PipelineStage::FLIP_SUBMIT), submit_start, submit_end);
+    for (size_t i = 0; i < present_flips_.size(); i++) {
+        present_workers_[i]->slot().stages.record(PipelineStage::FLIP_SUBMIT, submit_us);
+        present_workers_[i]->onPresented(present_flips_[i]);
+    }
+}
+
+void DisplayManager::notifyPresenter() {
+    {
+        std::lock_guard<std::mutex> lock(present_mutex_);
+        present_pending_ = true;
+    }
+    present_cond_.notify_one();
+}
+
+void DisplayManager::stopOutputWorkers() {
+    for (const auto& [connector_id, worker] : output_workers_) {
+        worker->stop();
+    }
+}
+
+void DisplayManager::onPageFlipEvent(const PageFlipEvent& event) {
+    // 在捕获线程中调用，当前快照只有几个工作线程，线性查找
+    if (!frame_topology_) {
+        return;
+    }
+    if (event.fb_id) {
+        markFirstFrame("first page flip");
+    }
+    
+    for (const auto& worker : frame_topology_->outputs) {
+        if (worker->connectorId() == event.connector_id) {
+            frame_copier_->onPageFlipComplete(worker->slot(), event);
+            return;
+        }
+    }
+}
+
+void DisplayManager::recordProfile(const OutputSlot& slot) {
+    if (!slot.display.edid_hash) {
+        return;
+    }
+    
+    DisplayProfile profile;
+    frame_copier_->fillProfile(slot, profile);
+    profile_store_->update(slot.display.edid_hash, profile);
+}
+
+void DisplayManager::publishTopology() {
+    auto topology = std::make_shared<OutputTopology>();
+    if (primary_display_) {
+        topology->has_primary = true;
+        topology->primary = *primary_display_;
+    }
+    for (const auto& [connector_id, worker] : output_workers_) {
+        topology->outputs.push_back(worker);
+    }
+    
+    std::atomic_store(&topology_, std::shared_ptr<const OutputTopology>(topology));
+    topology_generation_.fetch_add(1, std::memory_order_release);
+    notifyPresenter();
+}
+
+void DisplayManager::synchronizeTopology() {
+    // RCU宽限期：等待捕获和呈现线程切换到最新快照，旧快照中的工作线程此后不会再收到帧或被提交
+    uint64_t target = topology_generation_.load(std::memory_order_acquire);
+    event_loop_.wakeup();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    
+    while (running_ && (frame_generation_.load(std::memory_order_acquire) < target ||
+                        present_generation_.load(std::memory_order_acquire) < target)) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            LOG_WARN("Pipeline threads did not pick up display topology {} in time", target);
+            break;
         }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void DisplayManager::acquireFrameTopology() {
+    uint64_t generation = topology_generation_.load(std::memory_order_acquire);
+    if (generation == frame_generation_.load(std::memory_order_relaxed)) {
+        return;
     }
     
-    // 释放源帧缓冲区
-    rga_helper_->freeBuffer(source_frame);
+    frame_topology_ = std::atomic_load(&topology_);
+    if (frame_topology_) {
+        frame_copier_->reserveCaptureFrames(frame_topology_->outputs.size());
+    }
+    frame_generation_.store(generation, std::memory_order_release);
+}
+
+void DisplayManager::acquirePresentTopology() {
+    uint64_t generation = topology_generation_.load(std::memory_order_acquire);
+    if (generation == present_generation_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    
+    present_topology_ = std::atomic_load(&topology_);
+    present_generation_.store(generation, std::memory_order_release);
 }
 
 bool DisplayManager::isSecondaryDisplay(const std::string& name) {
@@ -368,8 +1446,12 @@ DisplayInfo* DisplayManager::findDisplayByName(const std::string& name) {
 }
 
 bool DisplayManager::hasActiveSecondaryDisplays() {
+    // 硬件克隆的显示器不需要复制线程
     auto displays = drm_manager_->getDisplays();
     for (uint32_t connector_id : secondary_display_ids_) {
+        if (hw_clone_ids_.count(connector_id)) {
+            continue;
+        }
         for (auto& display : displays) {
             if (display.connector_id == connector_id && display.connected) {
                 return true;
@@ -383,7 +1465,9 @@ void DisplayManager::updateCopyState() {
     bool should_copy = hasActiveSecondaryDisplays();
     bool was_copying = copy_enabled_.load();
     
+    // 事件循环在下一次等待前启停帧节拍
     copy_enabled_.store(should_copy);
+    event_loop_.wakeup();
     
     if (should_copy && !was_copying) {
         LOG_INFO("Frame copying enabled - secondary displays connected");
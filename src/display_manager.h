@@ -1,14 +1,60 @@
 #pragma once
 
+#include "control_server.h"
 #include "drm_manager.h"
+#include "event_loop.h"
 #include "hotplug_detector.h"
 #include "frame_copier.h"
+#include "output_worker.h"
 #include "rga_helper.h"
 #include <memory>
 #include <vector>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <set>
+#include <map>
+
+// 捕获线程和呈现线程使用的不可变拓扑快照 (RCU风格：重新配置线程构建新快照后原子发布)
+struct OutputTopology {
+    bool has_primary = false;
+    DisplayInfo primary;
+    std::vector<std::shared_ptr<OutputWorker>> outputs;  // 需要逐帧处理的副显示器，密集排列
+};
+
+// 合并的一批热插拔事件
+struct HotplugBurst {
+    uint32_t events = 0;
+    std::set<uint32_t> connectors;                      // 状态变化的连接器
+    std::chrono::steady_clock::time_point first_event;  // 用于统计端到端的重新配置延迟
+};
+
+// 已从拓扑中摘下、等待宽限期结束后关闭的副显示器
+struct RetiredOutput {
+    DisplayInfo display;
+    std::shared_ptr<OutputWorker> worker;
+};
+
+// 捕获线程的周期统计 (每个报告周期重置)
+struct CaptureStats {
+    uint64_t frames = 0;
+    uint64_t missed_ticks = 0;                     // 处理太慢而合并的定时器节拍
+    uint64_t bytes_saved_start = 0;
+    uint64_t drops_start = 0;
+    uint64_t wakeups_start = 0;
+    uint64_t idle_wakeups_start = 0;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point last_tick;
+    IntervalJitter jitter;
+};
+
+// 上一次读取指标时各显示器的提交帧数，用于计算两次读取之间的帧率
+struct ScrapeBaseline {
+    uint64_t presented = 0;
+    std::chrono::steady_clock::time_point time;
+};
 
 class DisplayManager {
 public:
@@ -21,37 +67,147 @@ public:
     void run();
     void stop();
     
+    // 阻塞直到事件循环收到退出信号
+    void wait();
+    
     // 配置管理
     void setDisplayConfig(const DisplayConfig& config);
     
+    // 进程启动时间，用于统计从启动到第一帧镜像画面的时间 (默认为构造时间)
+    void setStartTime(std::chrono::steady_clock::time_point start);
+    
 private:
     std::shared_ptr<DRMManager> drm_manager_;
     std::shared_ptr<FrameCopier> frame_copier_;
     std::shared_ptr<RGAHelper> rga_helper_;
     std::shared_ptr<HotplugDetector> hotplug_detector_;
+    std::shared_ptr<DisplayProfileStore> profile_store_;
+    
+    DisplayConfig display_config_;
     
     DisplayInfo* primary_display_;
     std::vector<uint32_t> secondary_display_ids_;  // Store connector IDs instead of pointers
+    std::set<uint32_t> hw_clone_ids_;              // 以硬件克隆方式共享主CRTC的副显示器
+    std::atomic<size_t> hw_clone_count_;           // hw_clone_ids_的大小，供控制命令读取
+    std::mutex clone_rotation_mutex_;              // 启用硬件克隆与设置旋转互斥 (重新配置线程/捕获线程)
+    std::map<uint32_t, std::shared_ptr<OutputWorker>> output_workers_;  // connector_id -> 工作线程 (重新配置线程)
+    
+    // 已发布的拓扑，通过std::atomic_load/atomic_store访问；generation变化时各线程才重新获取
+    std::shared_ptr<const OutputTopology> topology_;
+    std::atomic<uint64_t> topology_generation_;
+    std::atomic<uint64_t> frame_generation_;       // 捕获线程已切换到的快照版本
+    std::atomic<uint64_t> present_generation_;     // 呈现线程已切换到的快照版本
+    
+    // 以下只由捕获线程访问
+    std::shared_ptr<const OutputTopology> frame_topology_;
+    uint64_t capture_drops_;                       // 捕获缓冲区全部被占用而丢弃的帧
+    FrameGovernor governor_;                       // 决定捕获帧率和渲染质量
+    EventLoop event_loop_;                         // DRM事件、udev、帧节拍和信号
+    int pacing_timer_;                             // 帧节拍timerfd
+    int hotplug_timer_;                            // 热插拔合并窗口timerfd
+    HotplugBurst hotplug_burst_;                   // 当前窗口内的热插拔事件
+    std::chrono::microseconds pacing_interval_;    // 当前节拍间隔，0表示停止
+    std::chrono::steady_clock::time_point capture_vblank_requested_;  // 等待主显示器vblank事件的节拍，空表示没有请求
+    CaptureStats capture_stats_;
+    ControlServer control_server_;                 // 本地控制套接字 (在事件循环中处理)
+    std::map<uint32_t, ScrapeBaseline> scrape_baselines_;
+    
+    // 以下只由呈现线程访问，每次提交复用，不分配内存
+    std::shared_ptr<const OutputTopology> present_topology_;
+    std::vector<PageFlipRequest> present_flips_;
+    std::vector<OutputWorker*> present_workers_;
+    uint32_t present_track_;                       // 逐帧跟踪中翻转提交的轨道
+    
+    // 呈现线程的唤醒 (工作线程渲染完成或拓扑变化时)
+    std::mutex present_mutex_;
+    std::condition_variable present_cond_;
+    bool present_pending_;
+    
+    // 重新配置线程：合并后的热插拔事件在这里处理，不阻塞帧路径
+    std::mutex reconfigure_mutex_;
+    std::condition_variable reconfigure_cond_;
+    HotplugBurst queued_burst_;
+    std::thread reconfigure_thread_;
+    
+    // 重新配置耗时 (从第一个热插拔事件到发布)，由重新配置线程写入
+    std::atomic<uint64_t> reconfigure_count_;
+    std::atomic<uint64_t> reconfigure_last_ms_;
+    std::atomic<uint64_t> reconfigure_max_ms_;
     
     std::atomic<bool> running_;
     std::atomic<bool> copy_enabled_;  // 控制是否需要复制帧
+    
+    // 启动指标
+    std::chrono::steady_clock::time_point start_time_;
+    std::atomic<bool> first_frame_pending_;
+    std::atomic<int64_t> first_frame_ms_;  // 未统计时为-1
+    std::atomic<int64_t> first_frame_boot_ms_;  // 从内核启动 (CLOCK_BOOTTIME) 算起
+    const char* first_frame_path_ = nullptr;    // 已测得、尚未输出的第一帧来源
+    FrameRef boot_frame_;  // 快速启动时预先捕获的DSI帧，只在initialize点亮显示器期间持有
     std::thread copy_thread_;
-    std::mutex display_mutex_;
+    std::thread present_thread_;
     
     // 回调函数
-    void onHotplugEvent(const std::string& connector_name, HotplugEvent event);
+    void onHotplugEvent(uint32_t connector_id, const std::string& connector_name, HotplugEvent event);
+    void onPageFlipEvent(const PageFlipEvent& event);
+    bool onHotplugSettled();
+    
+    // 热插拔重新配置：重新扫描、构建新配置后一次发布
+    void reconfigureLoop();
+    void reconfigure(const HotplugBurst& burst);
+    
+    // 拓扑发布：重新配置线程修改显示器之后调用，synchronizeTopology等待捕获和呈现线程放弃旧快照
+    void publishTopology();
+    void synchronizeTopology();
+    void acquireFrameTopology();
+    void acquirePresentTopology();
     
     // 显示器管理
-    void updateDisplays();
-    void enableSecondaryDisplay(DisplayInfo* display);
-    void disableSecondaryDisplay(DisplayInfo* display);
+    // changed_connectors为热插拔中状态变化的连接器：只有它们和模式/CRTC变化的副显示器会被重新配置
+    void updateDisplays(const std::set<uint32_t>* changed_connectors = nullptr);
+    bool outputChanged(const DisplayInfo& display) const;
+    void enableSecondaryDisplay(DisplayInfo* display, bool reset_crtc = true);
+    void retireSecondaryDisplay(DisplayInfo* display, std::vector<RetiredOutput>& retired);
+    void disableSecondaryDisplay(RetiredOutput& output);
+    bool enableHardwareClone(DisplayInfo* display);
+    void recordProfile(const OutputSlot& slot);
+    void markFirstFrame(const char* path);
+    void reportFirstFrame();
     
-    // 主循环
+    // 流水线：捕获线程 -> 各显示器工作线程 (变换) -> 呈现线程
     void copyLoop();
+    void presentLoop();
     
-    // 帧复制逻辑
+    // 捕获线程的事件循环：每次等待前更新节拍，定时器到期时请求主显示器的vblank事件，事件到达后捕获一帧
+    bool setupEventLoop();
+    void prepareFrameLoop();
+    void updatePacingTimer();
+    bool onFrameTick(uint64_t expirations);
+    void onCaptureVBlank();
+    void captureAndPost(std::chrono::steady_clock::time_point now);
+    void reportCaptureStats(std::chrono::steady_clock::time_point now);
+    void reportStageTimings(bool reset);
+    
+    // 开始逐帧跟踪，或结束当前窗口并写出文件
+    bool toggleTrace();
+    
+    // 重新读取配置文件 (SIGHUP或控制命令reload)：只发布变化的设置，各显示器在下一帧边界生效，不modeset
+    bool reloadConfig();
+    // 发布新的旋转/缩放/质量，硬件克隆时拒绝非0旋转
+    bool setTransformSettings(const TransformSettings& settings, std::string& error);
+    
+    // 控制套接字：在捕获线程中生成指标和执行命令
+    std::string formatMetrics();
+    std::string handleControlCommand(const std::vector<std::string>& args);
+    
+    // 捕获一帧并投递给所有副显示器的工作线程
     void copyFrameToSecondaryDisplays();
     
+    // 所有渲染完成的帧合并为一次翻转提交
+    void presentFrames();
+    void notifyPresenter();
+    void stopOutputWorkers();
+    
     // 工具函数
     bool isSecondaryDisplay(const std::string& name);
     DisplayInfo* findDisplayByName(const std::string& name);
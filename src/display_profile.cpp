@@ -0,0 +1,193 @@
+#include "display_profile.h"
+#include "logger.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* kProfileHeader = "# rk3588-multi-display profiles v1";
+
+uint64_t hashEdid(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return size ? hash : 0;
+}
+
+bool DisplayProfileStore::load(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    profiles_.clear();
+    
+    if (path_.empty()) {
+        return true;
+    }
+    
+    std::ifstream file(path_);
+    if (!file.is_open()) {
+        LOG_INFO("No display profile cache at {}, starting empty", path_);
+        return true;
+    }
+    
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        
+        uint64_t edid_hash = 0;
+        DisplayProfile profile;
+        if (!parse(line, edid_hash, profile)) {
+            LOG_WARN("Ignoring malformed display profile at {}:{}", path_, line_number);
+            continue;
+        }
+        profiles_[edid_hash] = profile;
+    }
+    
+    LOG_INFO("Loaded {} display profiles from {}", profiles_.size(), path_);
+    return true;
+}
+
+bool DisplayProfileStore::find(uint64_t edid_hash, DisplayProfile& profile) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = profiles_.find(edid_hash);
+    if (it == profiles_.end()) {
+        return false;
+    }
+    profile = it->second;
+    return true;
+}
+
+void DisplayProfileStore::update(uint64_t edid_hash, const DisplayProfile& profile) {
+    if (!edid_hash) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = profiles_.find(edid_hash);
+    if (it != profiles_.end() && format(edid_hash, it->second) == format(edid_hash, profile)) {
+        return;
+    }
+    
+    profiles_[edid_hash] = profile;
+    if (!path_.empty()) {
+        save();
+    }
+}
+
+size_t DisplayProfileStore::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return profiles_.size();
+}
+
+// 文件或目录 (rename的目录项) 落盘
+static bool syncPath(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+bool DisplayProfileStore::save() {
+    // 缓存目录不存在时创建 (只创建最后一级)
+    size_t slash = path_.find_last_of('/');
+    if (slash != std::string::npos && slash > 0) {
+        mkdir(path_.substr(0, slash).c_str(), 0755);
+    }
+    
+    std::string temp_path = path_ + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        if (!file.is_open()) {
+            LOG_WARN("Failed to write display profile cache {}: {}", temp_path, strerror(errno));
+            return false;
+        }
+        
+        file << kProfileHeader << "\n";
+        for (const auto& [edid_hash, profile] : profiles_) {
+            file << format(edid_hash, profile) << "\n";
+        }
+        if (!file.good()) {
+            LOG_WARN("Failed to write display profile cache {}", temp_path);
+            return false;
+        }
+    }
+    
+    // rename之前落盘，否则掉电后rename可能先于数据生效，留下空文件
+    if (!syncPath(temp_path)) {
+        LOG_WARN("Failed to sync display profile cache {}: {}", temp_path, strerror(errno));
+        return false;
+    }
+    
+    // rename是原子的，崩溃时不会留下不完整的缓存
+    if (rename(temp_path.c_str(), path_.c_str()) != 0) {
+        LOG_WARN("Failed to replace display profile cache {}: {}", path_, strerror(errno));
+        return false;
+    }
+    syncPath(slash != std::string::npos && slash > 0 ? path_.substr(0, slash) : ".");
+    
+    LOG_DEBUG("Saved {} display profiles to {}", profiles_.size(), path_);
+    return true;
+}
+
+std::string DisplayProfileStore::format(uint64_t edid_hash, const DisplayProfile& profile) {
+    // 字段顺序：EDID哈希、模式 (drmModeModeInfo)、格式、变换参数、镜像校准
+    const drmModeModeInfo& mode = profile.mode;
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)edid_hash);
+    
+    std::ostringstream line;
+    line << hash << " "
+         << mode.clock << " " << mode.hdisplay << " " << mode.hsync_start << " " << mode.hsync_end << " "
+         << mode.htotal << " " << mode.hskew << " " << mode.vdisplay << " " << mode.vsync_start << " "
+         << mode.vsync_end << " " << mode.vtotal << " " << mode.vscan << " " << mode.vrefresh << " "
+         << mode.flags << " " << mode.type << " " << (mode.name[0] ? mode.name : "-") << " "
+         << profile.requested_format << " " << profile.output_format << " "
+         << profile.rotation_degrees << " " << profile.scale_mode << " "
+         << profile.plan_src_width << " " << profile.plan_src_height << " "
+         << profile.plan_x << " " << profile.plan_y << " " << profile.plan_width << " " << profile.plan_height << " "
+         << (profile.mirror_rejected ? 1 : 0) << " " << profile.mirror_src_width << " " << profile.mirror_src_height;
+    return line.str();
+}
+
+bool DisplayProfileStore::parse(const std::string& line, uint64_t& edid_hash, DisplayProfile& profile) {
+    std::istringstream stream(line);
+    std::string hash, name;
+    drmModeModeInfo& mode = profile.mode;
+    int mirror_rejected = 0;
+    
+    stream >> hash
+           >> mode.clock >> mode.hdisplay >> mode.hsync_start >> mode.hsync_end
+           >> mode.htotal >> mode.hskew >> mode.vdisplay >> mode.vsync_start
+           >> mode.vsync_end >> mode.vtotal >> mode.vscan >> mode.vrefresh
+           >> mode.flags >> mode.type >> name
+           >> profile.requested_format >> profile.output_format
+           >> profile.rotation_degrees >> profile.scale_mode
+           >> profile.plan_src_width >> profile.plan_src_height
+           >> profile.plan_x >> profile.plan_y >> profile.plan_width >> profile.plan_height
+           >> mirror_rejected >> profile.mirror_src_width >> profile.mirror_src_height;
+    if (stream.fail() || hash.size() != 16 || !mode.hdisplay || !mode.vdisplay) {
+        return false;
+    }
+    
+    edid_hash = strtoull(hash.c_str(), nullptr, 16);
+    if (name != "-") {
+        strncpy(mode.name, name.c_str(), sizeof(mode.name) - 1);
+        mode.name[sizeof(mode.name) - 1] = '\0';
+    }
+    profile.mirror_rejected = mirror_rejected != 0;
+    return edid_hash != 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <xf86drmMode.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+// 按EDID哈希缓存的显示器配置，已知的显示器启动或重新连接时直接使用，不再强制探测
+struct DisplayProfile {
+    drmModeModeInfo mode = {};      // 选定的模式
+    
+    // 输出格式协商结果，只在请求的格式与当前配置一致时使用
+    uint32_t requested_format = 0;
+    uint32_t output_format = 0;
+    
+    // 变换参数，只在旋转角度和缩放模式与当前配置一致时使用
+    int rotation_degrees = 0;
+    int scale_mode = 0;
+    uint32_t plan_src_width = 0, plan_src_height = 0;
+    uint32_t plan_x = 0, plan_y = 0, plan_width = 0, plan_height = 0;
+    
+    // 零拷贝镜像校准：驱动拒绝的源尺寸 (下次不再尝试)
+    bool mirror_rejected = false;
+    uint32_t mirror_src_width = 0, mirror_src_height = 0;
+};
+
+// EDID内容的64位FNV-1a哈希，0表示没有EDID
+uint64_t hashEdid(const void* data, size_t size);
+
+// 磁盘上的配置缓存 (每行一个显示器)，可被重新配置线程和主线程访问
+class DisplayProfileStore {
+public:
+    // 文件不存在时从空缓存开始；path为空时只在内存中缓存
+    bool load(const std::string& path);
+    
+    bool find(uint64_t edid_hash, DisplayProfile& profile);
+    
+    // 内容变化时写回磁盘 (先写临时文件再rename)
+    void update(uint64_t edid_hash, const DisplayProfile& profile);
+    
+    size_t size();
+    
+private:
+    std::mutex mutex_;
+    std::string path_;
+    std::map<uint64_t, DisplayProfile> profiles_;
+    
+    bool save();
+    static std::string format(uint64_t edid_hash, const DisplayProfile& profile);
+    static bool parse(const std::string& line, uint64_t& edid_hash, DisplayProfile& profile);
+};
@@ -5,9 +5,11 @@
 #include <cstring>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
 
 DRMManager::DRMManager() 
-    : drm_fd_(-1), resources_(nullptr) {
+    : drm_fd_(-1), resources_(nullptr), requested_backend_(KmsBackend::AUTO),
+      boot_scan_(false), atomic_enabled_(false) {
 }
 
 DRMManager::~DRMManager() {
@@ -21,6 +23,13 @@ bool DRMManager::initialize(const char* device_path) {
         LOG_ERROR("Failed to open DRM device: {}", device_path);
         return false;
     }
+    
+    // 连接器名称使用实际的设备节点名 (card0、card1...)
+    card_name_ = device_path;
+    size_t slash = card_name_.find_last_of('/');
+    if (slash != std::string::npos) {
+        card_name_ = card_name_.substr(slash + 1);
+    }
 
     // 检查DRM设备能力
     if (!probeDrmDevice()) {
@@ -28,6 +37,9 @@ bool DRMManager::initialize(const char* device_path) {
         drm_fd_ = -1;
         return false;
     }
+    
+    // 启用atomic modesetting (不支持时使用legacy接口)
+    setupAtomic();
 
     // 获取DRM资源
     resources_ = drmModeGetResources(drm_fd_);
@@ -38,8 +50,16 @@ bool DRMManager::initialize(const char* device_path) {
         return false;
     }
 
+    // 属性ID在启动时一次性查询，之后只读 (工作线程和重新配置线程都会使用)
+    if (atomic_enabled_) {
+        loadAtomicProperties();
+    }
+
     // 扫描显示器
-    if (!scanDisplays()) {
+    boot_scan_ = true;
+    bool scanned = scanDisplays();
+    boot_scan_ = false;
+    if (!scanned) {
         LOG_ERROR("Failed to scan displays");
         cleanup();
         return false;
@@ -50,6 +70,18 @@ bool DRMManager::initialize(const char* device_path) {
 
 void DRMManager::cleanup() {
     displays_.clear();
+    connector_ids_.clear();
+    
+    if (drm_fd_ >= 0) {
+        for (const auto& [crtc_id, blob_id] : mode_blobs_) {
+            drmModeDestroyPropertyBlob(drm_fd_, blob_id);
+        }
+    }
+    mode_blobs_.clear();
+    connector_props_.clear();
+    crtc_props_.clear();
+    plane_props_.clear();
+    atomic_enabled_ = false;
     
     if (resources_) {
         drmModeFreeResources(resources_);
@@ -70,21 +102,43 @@ bool DRMManager::probeDrmDevice() {
         return false;
     }
     
+    // 暴露主plane，用于格式协商
+    if (drmSetClientCap(drm_fd_, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) < 0) {
+        LOG_WARN("DRM device doesn't support universal planes, format negotiation limited");
+    }
+    
     return true;
 }
 
 bool DRMManager::scanDisplays() {
+    return scanConnectors(nullptr);
+}
+
+bool DRMManager::rescanDisplays(const std::set<uint32_t>& changed_connectors) {
+    return scanConnectors(&changed_connectors);
+}
+
+bool DRMManager::scanConnectors(const std::set<uint32_t>* changed_connectors) {
+    refreshConnectorList();
     displays_.clear();
     
-    for (int i = 0; i < resources_->count_connectors; i++) {
-        uint32_t connector_id = resources_->connectors[i];
+    for (uint32_t connector_id : connector_ids_) {
+        // 强制探测会读取EDID，可能耗时几十毫秒，只对状态变化的连接器进行
+        ConnectorProbe probe = !changed_connectors ? ConnectorProbe::IF_UNKNOWN
+                             : changed_connectors->count(connector_id) ? ConnectorProbe::FORCE
+                             : ConnectorProbe::CACHED;
         DisplayInfo info;
         
-        if (getConnectorInfo(connector_id, info)) {
+        if (getConnectorInfo(connector_id, probe, info)) {
             displays_.push_back(info);
         }
     }
     
+    // 查找每个CRTC的主plane
+    for (auto& display : displays_) {
+        display.plane_id = display.crtc_id ? findPrimaryPlane(display.crtc_index) : 0;
+    }
+    
     // 设置主显示器 (DSI-1)
     for (auto& display : displays_) {
         if (display.name.find("DSI-1") != std::string::npos) {
@@ -93,28 +147,62 @@ bool DRMManager::scanDisplays() {
         }
     }
     
+    // 副显示器的模式依赖主显示器的分辨率和刷新率
+    selectSecondaryModes();
+    if (boot_scan_ && mode_selection_.adopt_boot_mode) {
+        adoptBootModes();
+    }
+    
     LOG_INFO("Found {} displays:", displays_.size());
     for (const auto& display : displays_) {
-        LOG_INFO("  {} ({}x{}) - {}{}", 
+        LOG_INFO("  {} ({}x{}) - {}{}{}{}", 
                 display.name, display.width, display.height,
                 (display.connected ? "connected" : "disconnected"),
-                (display.is_primary ? " [PRIMARY]" : ""));
+                (display.is_primary ? " [PRIMARY]" : ""),
+                (display.from_profile ? " [cached profile]" : ""),
+                (display.boot_mode ? " [boot mode]" : ""));
     }
     
     return !displays_.empty();
 }
 
-bool DRMManager::getConnectorInfo(uint32_t connector_id, DisplayInfo& info) {
-    drmModeConnector* connector = drmModeGetConnector(drm_fd_, connector_id);
-    if (!connector) {
-        return false;
+std::set<uint32_t> DRMManager::findChangedConnectors() {
+    std::set<uint32_t> changed;
+    for (const auto& display : displays_) {
+        drmModeConnector* connector = drmModeGetConnectorCurrent(drm_fd_, display.connector_id);
+        if (!connector) {
+            continue;
+        }
+        if ((connector->connection == DRM_MODE_CONNECTED) != display.connected) {
+            changed.insert(display.connector_id);
+        }
+        drmModeFreeConnector(connector);
+    }
+    return changed;
+}
+
+void DRMManager::refreshConnectorList() {
+    drmModeRes* resources = drmModeGetResources(drm_fd_);
+    if (!resources) {
+        LOG_WARN("Failed to refresh DRM connector list, using the previous one");
+        return;
     }
     
-    info.connector_id = connector_id;
-    info.connected = (connector->connection == DRM_MODE_CONNECTED);
-    info.is_primary = false;
+    connector_ids_.assign(resources->connectors, resources->connectors + resources->count_connectors);
+    drmModeFreeResources(resources);
     
-    // 生成连接器名称
+    // 新出现的连接器 (MST) 补充查询atomic属性，只在重新配置线程中修改
+    if (atomic_enabled_) {
+        for (uint32_t connector_id : connector_ids_) {
+            if (!connector_props_.count(connector_id)) {
+                auto ids = getPropertyIds(connector_id, DRM_MODE_OBJECT_CONNECTOR);
+                connector_props_[connector_id].crtc_id = ids["CRTC_ID"];
+            }
+        }
+    }
+}
+
+std::string formatConnectorName(const std::string& card_name, const drmModeConnector* connector) {
     const char* connector_type_names[] = {
         "Unknown", "VGA", "DVII", "DVID", "DVIA", "Composite", "SVIDEO",
         "LVDS", "Component", "9PinDIN", "DisplayPort", "HDMIA", "HDMIB",
@@ -126,10 +214,72 @@ bool DRMManager::getConnectorInfo(uint32_t connector_id, DisplayInfo& info) {
         type_name = connector_type_names[connector->connector_type];
     }
     
-    info.name = "card0-" + type_name + "-" + std::to_string(connector->connector_type_id);
+    return card_name + "-" + type_name + "-" + std::to_string(connector->connector_type_id);
+}
+
+uint64_t DRMManager::getEdidHash(uint32_t connector_id) {
+    bool found = false;
+    uint32_t blob_id = (uint32_t)getPropertyValue(connector_id, DRM_MODE_OBJECT_CONNECTOR, "EDID", &found);
+    if (!found || !blob_id) {
+        return 0;
+    }
+    
+    drmModePropertyBlobRes* blob = drmModeGetPropertyBlob(drm_fd_, blob_id);
+    if (!blob) {
+        return 0;
+    }
+    uint64_t hash = hashEdid(blob->data, blob->length);
+    drmModeFreePropertyBlob(blob);
+    return hash;
+}
+
+bool DRMManager::findProfile(drmModeConnector* connector, DisplayInfo& info, DisplayProfile& profile) {
+    info.edid_hash = 0;
+    if (!connector || connector->connection != DRM_MODE_CONNECTED) {
+        return false;
+    }
+    info.edid_hash = getEdidHash(connector->connector_id);
+    return profiles_ && info.edid_hash && profiles_->find(info.edid_hash, profile);
+}
+
+bool DRMManager::getConnectorInfo(uint32_t connector_id, ConnectorProbe probe, DisplayInfo& info) {
+    // 热插拔合并窗口内拔出再插入另一台显示器时，内核缓存的EDID仍是之前那台的，必须重新探测
+    drmModeConnector* connector = probe == ConnectorProbe::FORCE
+        ? drmModeGetConnector(drm_fd_, connector_id)
+        : drmModeGetConnectorCurrent(drm_fd_, connector_id);
+    DisplayProfile profile;
+    bool profiled = findProfile(connector, info, profile);
     
-    // 查找最佳模式
-    drmModeModeInfo* best_mode = findBestMode(connector);
+    // 启动时内核已经读到已知显示器的EDID则直接使用缓存的配置，只有未知显示器才强制探测
+    if (probe == ConnectorProbe::IF_UNKNOWN && !profiled) {
+        if (connector) {
+            drmModeFreeConnector(connector);
+        }
+        connector = drmModeGetConnector(drm_fd_, connector_id);
+        profiled = findProfile(connector, info, profile);
+    }
+    if (!connector) {
+        return false;
+    }
+    
+    // 缓存的模式必须仍在连接器的模式列表中 (EDID哈希碰撞或显示器固件更新时放弃缓存)
+    if (profiled && connector->count_modes > 0 && !hasMode(connector, profile.mode)) {
+        LOG_INFO("Cached mode {}x{}@{} is not offered by {}, selecting a new one",
+                 profile.mode.hdisplay, profile.mode.vdisplay, profile.mode.vrefresh,
+                 formatConnectorName(card_name_, connector));
+        profiled = false;
+    }
+    
+    info.connector_id = connector_id;
+    info.connected = (connector->connection == DRM_MODE_CONNECTED);
+    info.is_primary = false;
+    info.from_profile = profiled;
+    
+    // 生成连接器名称
+    info.name = formatConnectorName(card_name_, connector);
+    
+    // 已知显示器使用缓存的模式 (内核不要求模式在探测得到的列表中)，否则查找最佳模式
+    drmModeModeInfo* best_mode = profiled ? &profile.mode : findBestMode(connector);
     if (best_mode) {
         info.mode = *best_mode;
         info.width = best_mode->hdisplay;
@@ -142,12 +292,16 @@ bool DRMManager::getConnectorInfo(uint32_t connector_id, DisplayInfo& info) {
     // 查找编码器和CRTC
     info.encoder_id = 0;
     info.crtc_id = 0;
+    info.crtc_index = 0;
+    info.plane_id = 0;
     
     if (connector->encoder_id) {
         drmModeEncoder* encoder = drmModeGetEncoder(drm_fd_, connector->encoder_id);
         if (encoder) {
             info.encoder_id = encoder->encoder_id;
             info.crtc_id = encoder->crtc_id;
+            int index = getCrtcIndex(encoder->crtc_id);
+            info.crtc_index = index >= 0 ? index : 0;
             drmModeFreeEncoder(encoder);
         }
     }
@@ -172,6 +326,7 @@ bool DRMManager::getConnectorInfo(uint32_t connector_id, DisplayInfo& info) {
                         if (!crtc_in_use) {
                             info.encoder_id = encoder->encoder_id;
                             info.crtc_id = crtc_id;
+                            info.crtc_index = j;
                             break;
                         }
                     }
@@ -186,6 +341,18 @@ bool DRMManager::getConnectorInfo(uint32_t connector_id, DisplayInfo& info) {
     return true;
 }
 
+bool DRMManager::hasMode(const drmModeConnector* connector, const drmModeModeInfo& mode) {
+    for (int i = 0; i < connector->count_modes; i++) {
+        const drmModeModeInfo& candidate = connector->modes[i];
+        if (candidate.clock == mode.clock && candidate.hdisplay == mode.hdisplay &&
+            candidate.vdisplay == mode.vdisplay && candidate.htotal == mode.htotal &&
+            candidate.vtotal == mode.vtotal && candidate.flags == mode.flags) {
+            return true;
+        }
+    }
+    return false;
+}
+
 drmModeModeInfo* DRMManager::findBestMode(drmModeConnector* connector) {
     if (!connector || connector->count_modes == 0) {
         return nullptr;
@@ -210,6 +377,742 @@ drmModeModeInfo* DRMManager::findBestMode(drmModeConnector* connector) {
     return best;
 }
 
+// 每秒需要变换的像素数：每帧写满整个目标，帧率不超过主显示器的刷新率
+static uint64_t modeThroughput(const drmModeModeInfo& mode, uint32_t source_refresh) {
+    uint32_t refresh = mode.vrefresh ? std::min<uint32_t>(mode.vrefresh, source_refresh) : source_refresh;
+    return (uint64_t)mode.hdisplay * mode.vdisplay * refresh;
+}
+
+static uint64_t distance(uint64_t a, uint64_t b) {
+    return a > b ? a - b : b - a;
+}
+
+void DRMManager::selectSecondaryModes() {
+    const DisplayInfo* primary = getPrimaryDisplay();
+    if (mode_selection_.policy != ModePolicy::EFFICIENT || !primary || !primary->width) {
+        return;
+    }
+    
+    uint64_t source_pixels = (uint64_t)primary->width * primary->height;
+    uint32_t source_refresh = primary->mode.vrefresh ? primary->mode.vrefresh : 60;
+    
+    for (auto& display : displays_) {
+        // 配置缓存中的模式已经是上次选择的结果
+        if (display.is_primary || !display.connected || !display.width || display.from_profile) {
+            continue;
+        }
+        
+        // 只读取刚探测过的模式列表，不再触发一次探测
+        drmModeConnector* connector = drmModeGetConnectorCurrent(drm_fd_, display.connector_id);
+        if (!connector) {
+            continue;
+        }
+        
+        const drmModeModeInfo* mode = findEfficientMode(connector, source_pixels, source_refresh);
+        if (mode) {
+            drmModeModeInfo preferred = display.mode;
+            display.mode = *mode;
+            display.width = mode->hdisplay;
+            display.height = mode->vdisplay;
+            
+            LOG_INFO("Mode for {}: {}x{}@{} ({:.2f} MP/frame, {:.1f} MP/s transform), preferred {}x{}@{} costs {:.2f} MP/frame",
+                     display.name, mode->hdisplay, mode->vdisplay, mode->vrefresh,
+                     mode->hdisplay * mode->vdisplay / 1e6, modeThroughput(*mode, source_refresh) / 1e6,
+                     preferred.hdisplay, preferred.vdisplay, preferred.vrefresh,
+                     preferred.hdisplay * preferred.vdisplay / 1e6);
+        }
+        drmModeFreeConnector(connector);
+    }
+}
+
+void DRMManager::adoptBootModes() {
+    const DisplayInfo* primary = getPrimaryDisplay();
+    uint32_t source_refresh = primary && primary->mode.vrefresh ? primary->mode.vrefresh : 60;
+    
+    for (auto& display : displays_) {
+        // 只考虑固件已经点亮、且不是与DSI共享的CRTC (共享的由硬件克隆处理)
+        if (display.is_primary || !display.connected || !display.crtc_id ||
+            (primary && display.crtc_id == primary->crtc_id)) {
+            continue;
+        }
+        
+        drmModeCrtc* crtc = drmModeGetCrtc(drm_fd_, display.crtc_id);
+        if (!crtc) {
+            continue;
+        }
+        drmModeModeInfo mode = crtc->mode;
+        bool lit = crtc->mode_valid && crtc->buffer_id && mode.hdisplay && mode.vdisplay;
+        drmModeFreeCrtc(crtc);
+        if (!lit) {
+            continue;
+        }
+        
+        // 与正常选择相同的限制：不使用隔行模式，满足最小分辨率和变换预算
+        bool compatible = !(mode.flags & DRM_MODE_FLAG_INTERLACE) &&
+                          mode.hdisplay >= mode_selection_.min_width &&
+                          mode.vdisplay >= mode_selection_.min_height &&
+                          (!mode_selection_.pixel_budget ||
+                           modeThroughput(mode, source_refresh) <= mode_selection_.pixel_budget);
+        if (!compatible) {
+            LOG_INFO("{}: boot mode {}x{}@{} doesn't fit the mode selection, a full modeset is needed",
+                     display.name, mode.hdisplay, mode.vdisplay, mode.vrefresh);
+            continue;
+        }
+        
+        // 模式相同时内核只更新plane，不经过关闭CRTC、重新训练链路的完整modeset
+        if (mode.hdisplay != display.width || mode.vdisplay != display.height ||
+            mode.vrefresh != display.mode.vrefresh) {
+            LOG_INFO("{}: adopting boot mode {}x{}@{} instead of {}x{}@{} to avoid a blanking modeset",
+                     display.name, mode.hdisplay, mode.vdisplay, mode.vrefresh,
+                     display.width, display.height, display.mode.vrefresh);
+        }
+        display.mode = mode;
+        display.width = mode.hdisplay;
+        display.height = mode.vdisplay;
+        display.boot_mode = true;
+    }
+}
+
+const drmModeModeInfo* DRMManager::findEfficientMode(drmModeConnector* connector, uint64_t source_pixels,
+                                                     uint32_t source_refresh) {
+    const drmModeModeInfo* best = nullptr;
+    const drmModeModeInfo* cheapest = nullptr;  // 预算内没有模式时的后备
+    
+    for (int i = 0; i < connector->count_modes; i++) {
+        const drmModeModeInfo& mode = connector->modes[i];
+        if ((mode.flags & DRM_MODE_FLAG_INTERLACE) ||
+            mode.hdisplay < mode_selection_.min_width || mode.vdisplay < mode_selection_.min_height) {
+            continue;
+        }
+        
+        uint64_t throughput = modeThroughput(mode, source_refresh);
+        if (!cheapest || throughput < modeThroughput(*cheapest, source_refresh)) {
+            cheapest = &mode;
+        }
+        if (mode_selection_.pixel_budget && throughput > mode_selection_.pixel_budget) {
+            continue;
+        }
+        
+        if (!best) {
+            best = &mode;
+            continue;
+        }
+        
+        // 面积最接近源帧 (缩放最少)，其次刷新率最接近主显示器，最后优先首选模式
+        uint64_t area = (uint64_t)mode.hdisplay * mode.vdisplay;
+        uint64_t best_area = (uint64_t)best->hdisplay * best->vdisplay;
+        uint64_t d_area = distance(area, source_pixels);
+        uint64_t d_best_area = distance(best_area, source_pixels);
+        uint64_t d_refresh = distance(mode.vrefresh, source_refresh);
+        uint64_t d_best_refresh = distance(best->vrefresh, source_refresh);
+        
+        if (d_area != d_best_area) {
+            if (d_area < d_best_area) {
+                best = &mode;
+            }
+        } else if (d_refresh != d_best_refresh) {
+            if (d_refresh < d_best_refresh) {
+                best = &mode;
+            }
+        } else if ((mode.type & DRM_MODE_TYPE_PREFERRED) && !(best->type & DRM_MODE_TYPE_PREFERRED)) {
+            best = &mode;
+        }
+    }
+    
+    if (!best && cheapest) {
+        LOG_WARN("No mode within the {:.1f} MP/s budget, using cheapest {}x{}@{}",
+                 mode_selection_.pixel_budget / 1e6, cheapest->hdisplay, cheapest->vdisplay, cheapest->vrefresh);
+        return cheapest;
+    }
+    if (!best) {
+        LOG_WARN("No mode of at least {}x{} available, keeping preferred mode",
+                 mode_selection_.min_width, mode_selection_.min_height);
+    }
+    return best;
+}
+
+bool DRMManager::setupAtomic() {
+    atomic_enabled_ = false;
+    
+    if (requested_backend_ == KmsBackend::LEGACY) {
+        LOG_INFO("Using legacy KMS backend (forced)");
+        return false;
+    }
+    
+    if (drmSetClientCap(drm_fd_, DRM_CLIENT_CAP_ATOMIC, 1) < 0) {
+        if (requested_backend_ == KmsBackend::ATOMIC) {
+            LOG_WARN("Atomic modesetting requested but not supported, falling back to legacy");
+        } else {
+            LOG_INFO("Atomic modesetting not supported, using legacy KMS backend");
+        }
+        return false;
+    }
+    
+    atomic_enabled_ = true;
+    LOG_INFO("Using atomic KMS backend");
+    return true;
+}
+
+std::map<std::string, uint32_t> DRMManager::getPropertyIds(uint32_t object_id, uint32_t object_type) {
+    std::map<std::string, uint32_t> ids;
+    
+    drmModeObjectProperties* props = drmModeObjectGetProperties(drm_fd_, object_id, object_type);
+    if (!props) {
+        return ids;
+    }
+    
+    for (uint32_t i = 0; i < props->count_props; i++) {
+        drmModePropertyRes* prop = drmModeGetProperty(drm_fd_, props->props[i]);
+        if (prop) {
+            ids[prop->name] = prop->prop_id;
+            drmModeFreeProperty(prop);
+        }
+    }
+    
+    drmModeFreeObjectProperties(props);
+    return ids;
+}
+
+void DRMManager::loadAtomicProperties() {
+    // 属性ID不会变化，为所有连接器、CRTC和plane查询一次，翻转时直接使用缓存
+    for (int i = 0; i < resources_->count_connectors; i++) {
+        uint32_t connector_id = resources_->connectors[i];
+        auto ids = getPropertyIds(connector_id, DRM_MODE_OBJECT_CONNECTOR);
+        connector_props_[connector_id].crtc_id = ids["CRTC_ID"];
+    }
+    
+    for (int i = 0; i < resources_->count_crtcs; i++) {
+        uint32_t crtc_id = resources_->crtcs[i];
+        auto ids = getPropertyIds(crtc_id, DRM_MODE_OBJECT_CRTC);
+        CrtcProps& props = crtc_props_[crtc_id];
+        props.mode_id = ids["MODE_ID"];
+        props.active = ids["ACTIVE"];
+    }
+    
+    drmModePlaneRes* plane_res = drmModeGetPlaneResources(drm_fd_);
+    if (!plane_res) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < plane_res->count_planes; i++) {
+        uint32_t plane_id = plane_res->planes[i];
+        auto ids = getPropertyIds(plane_id, DRM_MODE_OBJECT_PLANE);
+        PlaneProps& props = plane_props_[plane_id];
+        props.fb_id = ids["FB_ID"];
+        props.crtc_id = ids["CRTC_ID"];
+        props.src_x = ids["SRC_X"];
+        props.src_y = ids["SRC_Y"];
+        props.src_w = ids["SRC_W"];
+        props.src_h = ids["SRC_H"];
+        props.crtc_x = ids["CRTC_X"];
+        props.crtc_y = ids["CRTC_Y"];
+        props.crtc_w = ids["CRTC_W"];
+        props.crtc_h = ids["CRTC_H"];
+        props.rotation = ids.count("rotation") ? ids["rotation"] : 0;
+    }
+    
+    drmModeFreePlaneResources(plane_res);
+}
+
+bool DRMManager::addModesetProperties(drmModeAtomicReq* req, DisplayInfo* display,
+                                      uint32_t fb_id, uint32_t mode_blob) {
+    auto conn_it = connector_props_.find(display->connector_id);
+    auto crtc_it = crtc_props_.find(display->crtc_id);
+    auto plane_it = plane_props_.find(display->plane_id);
+    if (conn_it == connector_props_.end() || crtc_it == crtc_props_.end() ||
+        plane_it == plane_props_.end()) {
+        LOG_ERROR("Missing atomic properties for display {}", display->name);
+        return false;
+    }
+    
+    const PlaneProps& plane = plane_it->second;
+    uint32_t w = display->mode.hdisplay;
+    uint32_t h = display->mode.vdisplay;
+    
+    drmModeAtomicAddProperty(req, display->connector_id, conn_it->second.crtc_id, display->crtc_id);
+    drmModeAtomicAddProperty(req, display->crtc_id, crtc_it->second.mode_id, mode_blob);
+    drmModeAtomicAddProperty(req, display->crtc_id, crtc_it->second.active, 1);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.fb_id, fb_id);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_id, display->crtc_id);
+    // SRC坐标为16.16定点数
+    drmModeAtomicAddProperty(req, display->plane_id, plane.src_x, 0);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.src_y, 0);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.src_w, (uint64_t)w << 16);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.src_h, (uint64_t)h << 16);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_x, 0);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_y, 0);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_w, w);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_h, h);
+    if (plane.rotation) {
+        // 清除零拷贝镜像可能留下的旋转
+        drmModeAtomicAddProperty(req, display->plane_id, plane.rotation, DRM_MODE_ROTATE_0);
+    }
+    return true;
+}
+
+int DRMManager::atomicCommit(drmModeAtomicReq* req, uint32_t flags, void* user_data) {
+    auto start = std::chrono::steady_clock::now();
+    int ret = drmModeAtomicCommit(drm_fd_, req, flags, user_data);
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    
+    std::lock_guard<std::mutex> lock(kms_stats_mutex_);
+    if (flags & DRM_MODE_ATOMIC_TEST_ONLY) {
+        kms_stats_.test_count++;
+        kms_stats_.test_total_us += us;
+        kms_stats_.test_max_us = std::max(kms_stats_.test_max_us, us);
+    } else {
+        kms_stats_.commit_count++;
+        kms_stats_.commit_total_us += us;
+        kms_stats_.commit_max_us = std::max(kms_stats_.commit_max_us, us);
+        if (ret) {
+            kms_stats_.commit_failures++;
+        }
+    }
+    
+    return ret;
+}
+
+KmsStats DRMManager::getKmsStats() const {
+    std::lock_guard<std::mutex> lock(kms_stats_mutex_);
+    return kms_stats_;
+}
+
+bool DRMManager::testDisplayConfig(DisplayInfo* display, uint32_t fb_id) {
+    if (!display || !display->connected || !display->crtc_id || !fb_id) {
+        return false;
+    }
+    
+    // legacy接口没有校验能力，直接交给setCRTC
+    if (!atomic_enabled_) {
+        return true;
+    }
+    
+    uint32_t blob = 0;
+    if (drmModeCreatePropertyBlob(drm_fd_, &display->mode, sizeof(display->mode), &blob)) {
+        LOG_ERROR("Failed to create mode blob for {}", display->name);
+        return false;
+    }
+    
+    drmModeAtomicReq* req = drmModeAtomicAlloc();
+    int ret = -EINVAL;
+    if (req && addModesetProperties(req, display, fb_id, blob)) {
+        ret = atomicCommit(req, DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+    }
+    drmModeAtomicFree(req);
+    drmModeDestroyPropertyBlob(drm_fd_, blob);
+    
+    if (ret) {
+        LOG_WARN("Atomic test of {} ({}x{}@{}) rejected: {}", display->name,
+                 display->mode.hdisplay, display->mode.vdisplay, display->mode.vrefresh, strerror(-ret));
+        return false;
+    }
+    return true;
+}
+
+static bool modesMatch(const drmModeModeInfo& a, const drmModeModeInfo& b) {
+    return a.clock == b.clock &&
+           a.hdisplay == b.hdisplay && a.hsync_start == b.hsync_start &&
+           a.hsync_end == b.hsync_end && a.htotal == b.htotal &&
+           a.vdisplay == b.vdisplay && a.vsync_start == b.vsync_start &&
+           a.vsync_end == b.vsync_end && a.vtotal == b.vtotal && a.flags == b.flags;
+}
+
+bool DRMManager::canClone(const DisplayInfo* primary, const DisplayInfo* secondary) {
+    if (!primary || !secondary || !primary->crtc_id || !primary->encoder_id || !secondary->connected) {
+        return false;
+    }
+    
+    // 克隆时副显示器使用主CRTC正在运行的模式
+    drmModeCrtc* crtc = drmModeGetCrtc(drm_fd_, primary->crtc_id);
+    if (!crtc) {
+        return false;
+    }
+    bool mode_valid = crtc->mode_valid;
+    drmModeModeInfo mode = crtc->mode;
+    drmModeFreeCrtc(crtc);
+    
+    drmModeEncoder* primary_encoder = drmModeGetEncoder(drm_fd_, primary->encoder_id);
+    if (!mode_valid || !primary_encoder) {
+        drmModeFreeEncoder(primary_encoder);
+        return false;
+    }
+    uint32_t primary_clones = primary_encoder->possible_clones;
+    drmModeFreeEncoder(primary_encoder);
+    
+    int primary_index = getEncoderIndex(primary->encoder_id);
+    drmModeConnector* connector = drmModeGetConnector(drm_fd_, secondary->connector_id);
+    if (primary_index < 0 || !connector) {
+        drmModeFreeConnector(connector);
+        return false;
+    }
+    
+    bool has_mode = false;
+    for (int i = 0; i < connector->count_modes && !has_mode; i++) {
+        has_mode = modesMatch(connector->modes[i], mode);
+    }
+    
+    // 两个编码器必须互相出现在对方的possible_clones中，且副显示器的编码器能驱动主CRTC
+    bool clone_capable = false;
+    for (int i = 0; i < connector->count_encoders && has_mode && !clone_capable; i++) {
+        drmModeEncoder* encoder = drmModeGetEncoder(drm_fd_, connector->encoders[i]);
+        if (!encoder) {
+            continue;
+        }
+        int index = getEncoderIndex(encoder->encoder_id);
+        clone_capable = index >= 0 && encoder->encoder_id != primary->encoder_id &&
+                        (encoder->possible_crtcs & (1u << primary->crtc_index)) &&
+                        (encoder->possible_clones & (1u << primary_index)) &&
+                        (primary_clones & (1u << index));
+        drmModeFreeEncoder(encoder);
+    }
+    drmModeFreeConnector(connector);
+    
+    if (has_mode && !clone_capable) {
+        LOG_DEBUG("{} supports the {}x{}@{} mode of {} but encoders cannot clone",
+                  secondary->name, mode.hdisplay, mode.vdisplay, mode.vrefresh, primary->name);
+    }
+    return clone_capable;
+}
+
+bool DRMManager::attachClone(const DisplayInfo* primary, DisplayInfo* secondary) {
+    if (!setCloneConnectors(primary, secondary, true)) {
+        return false;
+    }
+    
+    secondary->crtc_id = primary->crtc_id;
+    secondary->crtc_index = primary->crtc_index;
+    secondary->plane_id = primary->plane_id;
+    LOG_INFO("{} attached to CRTC {} of {} (hardware clone)", secondary->name, primary->crtc_id, primary->name);
+    return true;
+}
+
+bool DRMManager::detachClone(const DisplayInfo* primary, DisplayInfo* secondary) {
+    if (!setCloneConnectors(primary, secondary, false)) {
+        return false;
+    }
+    
+    secondary->crtc_id = 0;
+    secondary->plane_id = 0;
+    LOG_INFO("{} detached from CRTC {} of {}", secondary->name, primary->crtc_id, primary->name);
+    return true;
+}
+
+bool DRMManager::setCloneConnectors(const DisplayInfo* primary, DisplayInfo* secondary, bool attach) {
+    if (!primary || !secondary || !primary->crtc_id) {
+        return false;
+    }
+    
+    int ret = -EINVAL;
+    if (atomic_enabled_) {
+        // 只修改副显示器连接器的CRTC_ID，主CRTC的模式和plane保持不变
+        auto conn_it = connector_props_.find(secondary->connector_id);
+        drmModeAtomicReq* req = drmModeAtomicAlloc();
+        if (req && conn_it != connector_props_.end()) {
+            drmModeAtomicAddProperty(req, secondary->connector_id, conn_it->second.crtc_id,
+                                     attach ? primary->crtc_id : 0);
+            ret = atomicCommit(req, DRM_MODE_ATOMIC_TEST_ONLY | DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+            if (ret == 0) {
+                ret = atomicCommit(req, DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+            }
+        }
+        drmModeAtomicFree(req);
+    } else {
+        // legacy接口：用当前fb和模式重新设置主CRTC，连接器列表包含或去掉副显示器
+        drmModeCrtc* crtc = drmModeGetCrtc(drm_fd_, primary->crtc_id);
+        if (crtc && crtc->mode_valid) {
+            uint32_t connectors[2] = {primary->connector_id, secondary->connector_id};
+            ret = drmModeSetCrtc(drm_fd_, crtc->crtc_id, crtc->buffer_id, crtc->x, crtc->y,
+                                 connectors, attach ? 2 : 1, &crtc->mode);
+        }
+        drmModeFreeCrtc(crtc);
+    }
+    
+    if (ret) {
+        LOG_WARN("Failed to {} {} {} CRTC {}: {}", attach ? "attach" : "detach", secondary->name,
+                 attach ? "to" : "from", primary->crtc_id, strerror(-ret));
+        return false;
+    }
+    return true;
+}
+
+uint32_t DRMManager::getCrtcFramebuffer(uint32_t crtc_id) {
+    drmModeCrtc* crtc = drmModeGetCrtc(drm_fd_, crtc_id);
+    if (!crtc) {
+        return 0;
+    }
+    
+    uint32_t fb_id = crtc->buffer_id;
+    drmModeFreeCrtc(crtc);
+    return fb_id;
+}
+
+bool DRMManager::getFramebufferSize(uint32_t fb_id, uint32_t& width, uint32_t& height) {
+    drmModeFB* fb = drmModeGetFB(drm_fd_, fb_id);
+    if (!fb) {
+        return false;
+    }
+    
+    width = fb->width;
+    height = fb->height;
+    drmModeFreeFB(fb);
+    return true;
+}
+
+bool DRMManager::setPlaneMirror(DisplayInfo* display, const PlaneMirror& mirror, bool test_only) {
+    if (!atomic_enabled_ || !display || !display->crtc_id || !mirror.fb_id) {
+        return false;
+    }
+    
+    auto plane_it = plane_props_.find(display->plane_id);
+    if (plane_it == plane_props_.end()) {
+        LOG_ERROR("Missing atomic properties for plane of {}", display->name);
+        return false;
+    }
+    const PlaneProps& plane = plane_it->second;
+    
+    // DRM的旋转方向为逆时针，配置中的角度为顺时针 (与RGA一致)
+    uint64_t rotation = DRM_MODE_ROTATE_0;
+    switch (mirror.rotation_degrees) {
+        case 90:  rotation = DRM_MODE_ROTATE_270; break;
+        case 180: rotation = DRM_MODE_ROTATE_180; break;
+        case 270: rotation = DRM_MODE_ROTATE_90; break;
+    }
+    if (rotation != DRM_MODE_ROTATE_0 && !plane.rotation) {
+        LOG_WARN("Plane {} of {} cannot rotate during scanout", display->plane_id, display->name);
+        return false;
+    }
+    
+    drmModeAtomicReq* req = drmModeAtomicAlloc();
+    if (!req) {
+        return false;
+    }
+    
+    drmModeAtomicAddProperty(req, display->plane_id, plane.fb_id, mirror.fb_id);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_id, display->crtc_id);
+    // SRC坐标为16.16定点数
+    drmModeAtomicAddProperty(req, display->plane_id, plane.src_x, 0);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.src_y, 0);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.src_w, (uint64_t)mirror.src_w << 16);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.src_h, (uint64_t)mirror.src_h << 16);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_x, mirror.crtc_x);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_y, mirror.crtc_y);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_w, mirror.crtc_w);
+    drmModeAtomicAddProperty(req, display->plane_id, plane.crtc_h, mirror.crtc_h);
+    if (plane.rotation) {
+        drmModeAtomicAddProperty(req, display->plane_id, plane.rotation, rotation);
+    }
+    
+    // 阻塞提交：返回时旧的缓冲区已不再被扫描输出
+    int ret = atomicCommit(req, test_only ? DRM_MODE_ATOMIC_TEST_ONLY : 0, nullptr);
+    drmModeAtomicFree(req);
+    
+    if (ret) {
+        LOG_WARN("Plane mirror of fb {} ({}x{}) on {} {}: {}", mirror.fb_id, mirror.src_w, mirror.src_h,
+                 display->name, test_only ? "rejected by atomic test" : "failed", strerror(-ret));
+        return false;
+    }
+    
+    if (!test_only) {
+        resetFlipState(display, mirror.fb_id);
+    }
+    return true;
+}
+
+bool DRMManager::commitPageFlips(std::vector<PageFlipRequest>& flips) {
+    if (flips.empty()) {
+        return true;
+    }
+    
+    if (!atomic_enabled_) {
+        bool all_ok = true;
+        for (auto& flip : flips) {
+            flip.submitted = pageFlip(flip.display, flip.fb_id, &flip.replaced_fb);
+            all_ok &= flip.submitted;
+        }
+        return all_ok;
+    }
+    
+    // 所有请求的翻转合并为一次非阻塞atomic提交，上一次翻转未完成的CRTC改为排队
+    int ret = 0;
+    std::lock_guard<std::mutex> lock(flip_mutex_);
+    
+    drmModeAtomicReq* req = drmModeAtomicAlloc();
+    if (!req) {
+        return false;
+    }
+    
+    flip_batch_.clear();
+    for (auto& flip : flips) {
+        flip.submitted = false;
+        flip.replaced_fb = 0;
+        CrtcFlipState& state = flip_states_[flip.display->crtc_id];
+        state.connector_id = flip.display->connector_id;
+        state.plane_id = flip.display->plane_id;
+        
+        if (state.pending_fb) {
+            flip.replaced_fb = state.queued_fb;
+            state.queued_fb = flip.fb_id;
+            flip.submitted = true;
+            continue;
+        }
+        
+        auto it = plane_props_.find(flip.display->plane_id);
+        if (it == plane_props_.end() || !it->second.fb_id) {
+            LOG_ERROR("No FB_ID property for plane of {}", flip.display->name);
+            continue;
+        }
+        drmModeAtomicAddProperty(req, flip.display->plane_id, it->second.fb_id, flip.fb_id);
+        flip_batch_.push_back(&flip);
+    }
+    
+    if (!flip_batch_.empty()) {
+        ret = atomicCommit(req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, this);
+    }
+    drmModeAtomicFree(req);
+    
+    // EBUSY时这些CRTC上没有我们提交的翻转，不会有完成事件来提交排队帧：
+    // 不提交，由调用者回收缓冲区，下一帧重试
+    for (PageFlipRequest* flip : flip_batch_) {
+        CrtcFlipState& state = flip_states_[flip->display->crtc_id];
+        if (ret == 0) {
+            state.pending_fb = flip->fb_id;
+            flip->submitted = true;
+            flip->replaced_fb = state.queued_fb;
+            state.queued_fb = 0;
+        }
+    }
+    
+    if (ret && ret != -EBUSY) {
+        LOG_EVERY_MS(WARN, 1000, "Atomic flip commit for {} displays failed: {}", flip_batch_.size(), strerror(-ret));
+    }
+    
+    return ret == 0 || ret == -EBUSY;
+}
+
+int DRMManager::getCrtcIndex(uint32_t crtc_id) {
+    for (int i = 0; i < resources_->count_crtcs; i++) {
+        if (resources_->crtcs[i] == crtc_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int DRMManager::getEncoderIndex(uint32_t encoder_id) {
+    for (int i = 0; i < resources_->count_encoders; i++) {
+        if (resources_->encoders[i] == encoder_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint64_t DRMManager::getPropertyValue(uint32_t object_id, uint32_t object_type, 
+                                      const char* name, bool* found) {
+    if (found) {
+        *found = false;
+    }
+    
+    drmModeObjectProperties* props = drmModeObjectGetProperties(drm_fd_, object_id, object_type);
+    if (!props) {
+        return 0;
+    }
+    
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < props->count_props; i++) {
+        drmModePropertyRes* prop = drmModeGetProperty(drm_fd_, props->props[i]);
+        if (!prop) {
+            continue;
+        }
+        bool match = (strcmp(prop->name, name) == 0);
+        drmModeFreeProperty(prop);
+        if (match) {
+            value = props->prop_values[i];
+            if (found) {
+                *found = true;
+            }
+            break;
+        }
+    }
+    
+    drmModeFreeObjectProperties(props);
+    return value;
+}
+
+uint32_t DRMManager::findPrimaryPlane(uint32_t crtc_index) {
+    drmModePlaneRes* plane_res = drmModeGetPlaneResources(drm_fd_);
+    if (!plane_res) {
+        return 0;
+    }
+    
+    uint32_t fallback = 0;
+    uint32_t primary = 0;
+    for (uint32_t i = 0; i < plane_res->count_planes && !primary; i++) {
+        drmModePlane* plane = drmModeGetPlane(drm_fd_, plane_res->planes[i]);
+        if (!plane) {
+            continue;
+        }
+        
+        if (plane->possible_crtcs & (1u << crtc_index)) {
+            bool has_type = false;
+            uint64_t type = getPropertyValue(plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", &has_type);
+            if (has_type && type == DRM_PLANE_TYPE_PRIMARY) {
+                primary = plane->plane_id;
+            } else if (!fallback && (!has_type || type != DRM_PLANE_TYPE_CURSOR)) {
+                fallback = plane->plane_id;
+            }
+        }
+        drmModeFreePlane(plane);
+    }
+    
+    drmModeFreePlaneResources(plane_res);
+    return primary ? primary : fallback;
+}
+
+std::vector<uint32_t> DRMManager::getPlaneFormats(uint32_t plane_id) {
+    std::vector<uint32_t> formats;
+    if (!plane_id) {
+        return formats;
+    }
+    
+    // 优先使用IN_FORMATS blob，它反映了驱动实际支持的格式/modifier组合
+    bool has_in_formats = false;
+    uint64_t blob_id = getPropertyValue(plane_id, DRM_MODE_OBJECT_PLANE, "IN_FORMATS", &has_in_formats);
+    if (has_in_formats && blob_id) {
+        drmModePropertyBlobRes* blob = drmModeGetPropertyBlob(drm_fd_, blob_id);
+        if (blob) {
+            auto* header = static_cast<const struct drm_format_modifier_blob*>(blob->data);
+            if (blob->length >= sizeof(*header)) {
+                auto* list = reinterpret_cast<const uint32_t*>(
+                    static_cast<const uint8_t*>(blob->data) + header->formats_offset);
+                formats.assign(list, list + header->count_formats);
+            }
+            drmModeFreePropertyBlob(blob);
+        }
+    }
+    
+    if (formats.empty()) {
+        drmModePlane* plane = drmModeGetPlane(drm_fd_, plane_id);
+        if (plane) {
+            formats.assign(plane->formats, plane->formats + plane->count_formats);
+            drmModeFreePlane(plane);
+        }
+    }
+    
+    return formats;
+}
+
+bool DRMManager::isFormatSupported(const DisplayInfo* display, uint32_t format) {
+    if (!display || !display->plane_id) {
+        // 无法查询plane时只信任XRGB8888
+        return format == DRM_FORMAT_XRGB8888;
+    }
+    
+    std::vector<uint32_t> formats = getPlaneFormats(display->plane_id);
+    return std::find(formats.begin(), formats.end(), format) != formats.end();
+}
+
 DisplayInfo* DRMManager::getPrimaryDisplay() {
     for (auto& display : displays_) {
         if (display.is_primary) {
@@ -257,8 +1160,36 @@ bool DRMManager::disableDisplay(DisplayInfo* display) {
         return false;
     }
     
-    // 禁用CRTC
-    int ret = drmModeSetCrtc(drm_fd_, display->crtc_id, 0, 0, 0, nullptr, 0, nullptr);
+    int ret;
+    if (atomic_enabled_) {
+        ret = -EINVAL;
+        auto conn_it = connector_props_.find(display->connector_id);
+        auto crtc_it = crtc_props_.find(display->crtc_id);
+        auto plane_it = plane_props_.find(display->plane_id);
+        drmModeAtomicReq* req = drmModeAtomicAlloc();
+        if (req && conn_it != connector_props_.end() && crtc_it != crtc_props_.end() &&
+            plane_it != plane_props_.end()) {
+            drmModeAtomicAddProperty(req, display->connector_id, conn_it->second.crtc_id, 0);
+            drmModeAtomicAddProperty(req, display->crtc_id, crtc_it->second.active, 0);
+            drmModeAtomicAddProperty(req, display->crtc_id, crtc_it->second.mode_id, 0);
+            drmModeAtomicAddProperty(req, display->plane_id, plane_it->second.fb_id, 0);
+            drmModeAtomicAddProperty(req, display->plane_id, plane_it->second.crtc_id, 0);
+            ret = atomicCommit(req, DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+        }
+        drmModeAtomicFree(req);
+        
+        std::lock_guard<std::mutex> lock(flip_mutex_);
+        auto blob_it = mode_blobs_.find(display->crtc_id);
+        if (ret == 0 && blob_it != mode_blobs_.end()) {
+            drmModeDestroyPropertyBlob(drm_fd_, blob_it->second);
+            mode_blobs_.erase(blob_it);
+        }
+    } else {
+        // 禁用CRTC
+        ret = drmModeSetCrtc(drm_fd_, display->crtc_id, 0, 0, 0, nullptr, 0, nullptr);
+    }
+    
+    resetFlipState(display, 0);
     
     if (ret) {
         std::cerr << "Failed to disable CRTC for display " << display->name 
@@ -275,6 +1206,39 @@ bool DRMManager::setCRTCWithFramebuffer(DisplayInfo* display, uint32_t fb_id) {
         return false;
     }
     
+    if (atomic_enabled_) {
+        uint32_t blob = 0;
+        if (drmModeCreatePropertyBlob(drm_fd_, &display->mode, sizeof(display->mode), &blob)) {
+            LOG_ERROR("Failed to create mode blob for {}", display->name);
+            return false;
+        }
+        
+        drmModeAtomicReq* req = drmModeAtomicAlloc();
+        int ret = -EINVAL;
+        if (req && addModesetProperties(req, display, fb_id, blob)) {
+            ret = atomicCommit(req, DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr);
+        }
+        drmModeAtomicFree(req);
+        
+        if (ret) {
+            drmModeDestroyPropertyBlob(drm_fd_, blob);
+            LOG_ERROR("Atomic modeset failed for display {}: {}", display->name, strerror(-ret));
+            return false;
+        }
+        
+        // 替换该CRTC之前的mode blob (工作线程的零拷贝回退也会modeset)
+        {
+            std::lock_guard<std::mutex> lock(flip_mutex_);
+            auto blob_it = mode_blobs_.find(display->crtc_id);
+            if (blob_it != mode_blobs_.end()) {
+                drmModeDestroyPropertyBlob(drm_fd_, blob_it->second);
+            }
+            mode_blobs_[display->crtc_id] = blob;
+        }
+        resetFlipState(display, fb_id);
+        return true;
+    }
+    
     // 设置CRTC模式
     int ret = drmModeSetCrtc(drm_fd_, display->crtc_id, fb_id, 0, 0,
                             &display->connector_id, 1, &display->mode);
@@ -285,6 +1249,7 @@ bool DRMManager::setCRTCWithFramebuffer(DisplayInfo* display, uint32_t fb_id) {
         return false;
     }
     
+    resetFlipState(display, fb_id);
     return true;
 }
 
@@ -307,76 +1272,185 @@ void DRMManager::destroyFramebuffer(uint32_t fb_id) {
     }
 }
 
-bool DRMManager::pageFlip(DisplayInfo* display, uint32_t fb_id) {
+bool DRMManager::pageFlip(DisplayInfo* display, uint32_t fb_id, uint32_t* replaced_fb) {
     if (!display || !display->crtc_id || !fb_id) {
         return false;
     }
     
-    int ret = drmModePageFlip(drm_fd_, display->crtc_id, fb_id, 
-                             DRM_MODE_PAGE_FLIP_EVENT, display);
-    
-    if (ret) {
-        std::cerr << "Failed to page flip for display " << display->name 
-                  << ": " << strerror(-ret) << std::endl;
-        return false;
+    if (replaced_fb) {
+        *replaced_fb = 0;
     }
     
-    // 强制等待页面翻转完成
-    fd_set fds;
-    struct timeval timeout;
+    PageFlipEvent released = {};
+    {
+        std::lock_guard<std::mutex> lock(flip_mutex_);
+        CrtcFlipState& state = flip_states_[display->crtc_id];
+        state.connector_id = display->connector_id;
+        state.plane_id = display->plane_id;
+        
+        // 上一次翻转尚未完成：排队，最新的帧替换之前排队的帧
+        if (state.pending_fb) {
+            released = {display->crtc_id, state.connector_id, 0, state.queued_fb, 0, 0};
+            state.queued_fb = fb_id;
+        } else {
+            // 没有我们提交的翻转时CRTC仍然忙 (例如刚modeset)，不会有完成事件来提交排队帧：
+            // 本帧不提交，由调用者回收缓冲区，下一帧重试
+            int ret = submitFlipLocked(display->crtc_id, display->plane_id, fb_id);
+            if (ret) {
+                if (ret != -EBUSY) {
+                    LOG_EVERY_MS(WARN, 1000, "Failed to page flip for display {}: {}", display->name, strerror(-ret));
+                }
+                return false;
+            }
+            state.pending_fb = fb_id;
+            
+            // 不应存在的遗留排队帧已被本帧取代，回收而不是在下一次完成时翻转到旧帧
+            released = {display->crtc_id, state.connector_id, 0, state.queued_fb, 0, 0};
+            state.queued_fb = 0;
+        }
+    }
     
-    FD_ZERO(&fds);
-    FD_SET(drm_fd_, &fds);
+    // 被替换的排队帧从未显示过，可以直接重用
+    if (replaced_fb) {
+        *replaced_fb = released.released_fb_id;
+    } else if (released.released_fb_id && flip_callback_) {
+        flip_callback_(released);
+    }
+    return true;
+}
+
+int DRMManager::submitFlipLocked(uint32_t crtc_id, uint32_t plane_id, uint32_t fb_id) {
+    if (!atomic_enabled_) {
+        return drmModePageFlip(drm_fd_, crtc_id, fb_id, DRM_MODE_PAGE_FLIP_EVENT, this);
+    }
     
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 50000;  // 50ms timeout
+    auto it = plane_props_.find(plane_id);
+    if (it == plane_props_.end() || !it->second.fb_id) {
+        return -EINVAL;
+    }
     
-    int select_ret = select(drm_fd_ + 1, &fds, nullptr, nullptr, &timeout);
-    if (select_ret > 0 && FD_ISSET(drm_fd_, &fds)) {
-        drmEventContext evctx = {};
-        evctx.version = 2;
-        evctx.page_flip_handler = [](int fd, unsigned int frame, unsigned int sec, 
-                                   unsigned int usec, void* data) {
-            // Page flip completed
-        };
-        
-        drmHandleEvent(drm_fd_, &evctx);
+    drmModeAtomicReq* req = drmModeAtomicAlloc();
+    if (!req) {
+        return -ENOMEM;
+    }
+    drmModeAtomicAddProperty(req, plane_id, it->second.fb_id, fb_id);
+    int ret = atomicCommit(req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, this);
+    drmModeAtomicFree(req);
+    return ret;
+}
+
+void DRMManager::resetFlipState(const DisplayInfo* display, uint32_t scanout_fb) {
+    // modeset之后该CRTC上没有未完成的翻转，之前的事件将被忽略
+    std::lock_guard<std::mutex> lock(flip_mutex_);
+    if (!scanout_fb) {
+        flip_states_.erase(display->crtc_id);
+        return;
     }
     
-    return true;
+    CrtcFlipState& state = flip_states_[display->crtc_id];
+    state.connector_id = display->connector_id;
+    state.plane_id = display->plane_id;
+    state.scanout_fb = scanout_fb;
+    state.pending_fb = 0;
+    state.queued_fb = 0;
+}
+
+bool DRMManager::isFlipPending(uint32_t crtc_id) {
+    std::lock_guard<std::mutex> lock(flip_mutex_);
+    auto it = flip_states_.find(crtc_id);
+    return it != flip_states_.end() && it->second.pending_fb != 0;
 }
 
-bool DRMManager::waitForPageFlipEvents(int timeout_ms) {
-    fd_set fds;
-    struct timeval timeout;
+bool DRMManager::handleEvents() {
+    // DRM fd已由事件循环确认可读，这里只读取并分发事件
+    drmEventContext evctx = {};
+    evctx.version = 3;
+    evctx.page_flip_handler2 = &DRMManager::pageFlipHandler;
+    evctx.vblank_handler = &DRMManager::vblankHandler;
     
-    FD_ZERO(&fds);
-    FD_SET(drm_fd_, &fds);
+    return drmHandleEvent(drm_fd_, &evctx) == 0;
+}
+
+bool DRMManager::requestVBlankEvent(const DisplayInfo* display) {
+    if (!display || !display->crtc_id) {
+        return false;
+    }
     
-    timeout.tv_sec = timeout_ms / 1000;
-    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    // CRTC索引编码在请求类型中 (0为默认，1为SECONDARY，其余用高位字段)
+    drmVBlank vbl = {};
+    vbl.request.type = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT);
+    if (display->crtc_index == 1) {
+        vbl.request.type = (drmVBlankSeqType)(vbl.request.type | DRM_VBLANK_SECONDARY);
+    } else if (display->crtc_index > 1) {
+        vbl.request.type = (drmVBlankSeqType)(vbl.request.type |
+            ((display->crtc_index << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK));
+    }
+    vbl.request.sequence = 1;
+    vbl.request.signal = (unsigned long)this;
     
-    int ret = select(drm_fd_ + 1, &fds, nullptr, nullptr, &timeout);
-    if (ret <= 0) {
-        return false;  // Timeout or error
+    if (drmWaitVBlank(drm_fd_, &vbl) != 0) {
+        LOG_EVERY_MS(WARN, 5000, "Failed to request vblank event on CRTC {}: {}",
+                     display->crtc_id, strerror(errno));
+        return false;
     }
+    return true;
+}
+
+void DRMManager::vblankHandler(int fd, unsigned int sequence, unsigned int sec, unsigned int usec, void* data) {
+    auto* self = static_cast<DRMManager*>(data);
+    if (self && self->vblank_callback_) {
+        self->vblank_callback_((uint64_t)sec * 1000000ULL + usec);
+    }
+}
+
+void DRMManager::pageFlipHandler(int fd, unsigned int sequence, unsigned int sec,
+                                 unsigned int usec, unsigned int crtc_id, void* data) {
+    auto* self = static_cast<DRMManager*>(data);
+    if (self) {
+        self->handlePageFlipEvent(crtc_id, sequence, sec, usec);
+    }
+}
+
+void DRMManager::handlePageFlipEvent(uint32_t crtc_id, unsigned int sequence, unsigned int sec, unsigned int usec) {
+    PageFlipEvent event = {};
+    event.crtc_id = crtc_id;
+    event.sequence = sequence;
+    event.timestamp_us = (uint64_t)sec * 1000000ULL + usec;
+    PageFlipEvent dropped = {};
     
-    if (FD_ISSET(drm_fd_, &fds)) {
-        drmEventContext evctx = {};
-        evctx.version = 2;
-        evctx.page_flip_handler = [](int fd, unsigned int frame, unsigned int sec, 
-                                   unsigned int usec, void* data) {
-            // Page flip completed - buffer is now free for reuse
-        };
+    {
+        std::lock_guard<std::mutex> lock(flip_mutex_);
+        auto it = flip_states_.find(crtc_id);
+        if (it == flip_states_.end() || !it->second.pending_fb) {
+            return;  // 显示器已被禁用
+        }
         
-        drmHandleEvent(drm_fd_, &evctx);
-        return true;
+        // 翻转完成：之前扫描输出的buffer现在可以重用
+        CrtcFlipState& state = it->second;
+        event.connector_id = state.connector_id;
+        event.fb_id = state.pending_fb;
+        event.released_fb_id = state.scanout_fb;
+        state.scanout_fb = state.pending_fb;
+        state.pending_fb = 0;
+        
+        // 提交排队的翻转；失败时之后不会再有完成事件，排队帧直接回收
+        if (state.queued_fb) {
+            uint32_t queued = state.queued_fb;
+            state.queued_fb = 0;
+            int ret = submitFlipLocked(crtc_id, state.plane_id, queued);
+            if (ret == 0) {
+                state.pending_fb = queued;
+            } else {
+                LOG_EVERY_MS(WARN, 1000, "Failed to submit queued flip on CRTC {}: {}", crtc_id, strerror(-ret));
+                dropped = {crtc_id, state.connector_id, 0, queued, 0, 0};
+            }
+        }
     }
     
-    return false;
+    if (flip_callback_) {
+        flip_callback_(event);
+        if (dropped.released_fb_id) {
+            flip_callback_(dropped);
+        }
+    }
 }
-
-void DRMManager::handlePageFlipEvent(unsigned int frame, unsigned int sec, unsigned int usec, void* data) {
-    // This callback is called when page flip completes
-    // The buffer used in the page flip is now free for reuse
-} 
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "display_profile.h"
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
@@ -9,6 +10,11 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <map>
+#include <set>
+#include <mutex>
+#include <functional>
+#include <cstdint>
 
 struct DisplayInfo {
     uint32_t connector_id;
@@ -20,6 +26,75 @@ struct DisplayInfo {
     bool is_primary;
     uint32_t width;
     uint32_t height;
+    uint32_t crtc_index;  // CRTC在resources->crtcs中的索引
+    uint32_t plane_id;    // 该CRTC的主plane
+    uint64_t edid_hash = 0;     // 0表示没有EDID
+    bool from_profile = false;  // 模式来自EDID配置缓存，没有强制探测
+    bool boot_mode = false;     // 沿用固件/引导程序留在CRTC上的模式，modeset不会黑屏
+};
+
+// KMS后端选择
+enum class KmsBackend {
+    AUTO,     // 优先atomic，不支持时回退legacy
+    ATOMIC,
+    LEGACY
+};
+
+// 副显示器模式选择策略
+enum class ModePolicy {
+    PREFERRED,  // 连接器的首选模式 (没有时取面积最大的)
+    EFFICIENT   // 在像素吞吐预算内选择逐帧变换工作量最小的模式
+};
+
+struct ModeSelection {
+    ModePolicy policy = ModePolicy::EFFICIENT;
+    uint32_t min_width = 0;       // 用户要求的最小分辨率
+    uint32_t min_height = 0;
+    uint64_t pixel_budget = 0;    // 每秒变换像素数上限，0表示不限制
+    bool adopt_boot_mode = true;  // 启动时沿用固件已点亮的模式 (满足以上限制时)
+};
+
+// 一次翻转请求：将fb_id显示到display上
+struct PageFlipRequest {
+    DisplayInfo* display;
+    uint32_t fb_id;
+    bool submitted = false;    // 由commitPageFlips填写
+    uint32_t replaced_fb = 0;  // 被本次请求替换、从未显示的排队帧，调用者负责回收
+};
+
+// 翻转完成事件 (page_flip_handler2)
+struct PageFlipEvent {
+    uint32_t crtc_id;
+    uint32_t connector_id;
+    uint32_t fb_id;           // 开始扫描输出的fb，0表示仅释放 (排队的翻转被替换)
+    uint32_t released_fb_id;  // 不再被硬件使用、可以重新渲染的fb
+    unsigned int sequence;    // vblank计数
+    uint64_t timestamp_us;    // vblank时间戳 (CLOCK_MONOTONIC)
+};
+
+// 零拷贝镜像的plane配置：源framebuffer由显示硬件缩放/旋转到目标矩形
+struct PlaneMirror {
+    uint32_t fb_id;
+    uint32_t src_w, src_h;                    // 源framebuffer尺寸
+    uint32_t crtc_x, crtc_y, crtc_w, crtc_h;  // 目标矩形 (保持宽高比时留黑边)
+    int rotation_degrees;                     // 顺时针：0, 90, 180, 270
+};
+
+using PageFlipCallback = std::function<void(const PageFlipEvent& event)>;
+using VBlankCallback = std::function<void(uint64_t timestamp_us)>;
+
+// 连接器名称，例如 card0-HDMIA-1 (card_name为设备节点名)
+std::string formatConnectorName(const std::string& card_name, const drmModeConnector* connector);
+
+// atomic校验/提交延迟统计 (微秒)
+struct KmsStats {
+    uint64_t test_count = 0;
+    uint64_t test_total_us = 0;
+    uint64_t test_max_us = 0;
+    uint64_t commit_count = 0;
+    uint64_t commit_total_us = 0;
+    uint64_t commit_max_us = 0;
+    uint64_t commit_failures = 0;
 };
 
 class DRMManager {
@@ -30,7 +105,22 @@ public:
     bool initialize(const char* device_path = "/dev/dri/card0");
     void cleanup();
     
+    // 必须在initialize之前设置
+    void setKmsBackend(KmsBackend backend) { requested_backend_ = backend; }
+    void setModeSelection(const ModeSelection& selection) { mode_selection_ = selection; }
+    void setProfileStore(std::shared_ptr<DisplayProfileStore> profiles) { profiles_ = profiles; }
+    bool isAtomic() const { return atomic_enabled_; }
+    // 捕获、呈现和重配置线程都会提交，返回加锁拷贝的快照
+    KmsStats getKmsStats() const;
+    
+    // 启动时只强制探测EDID没有缓存配置的连接器；热插拔后总是强制探测状态变化的连接器，其余读取内核缓存的状态
+    // initialize中的第一次扫描会沿用固件留在副显示器CRTC上的兼容模式
     bool scanDisplays();
+    bool rescanDisplays(const std::set<uint32_t>& changed_connectors);
+    
+    // 连接状态与上一次扫描结果不同的连接器 (只读取内核缓存的状态，不探测)
+    // 用于补上扫描之后、热插拔监视器启用之前错过的事件
+    std::set<uint32_t> findChangedConnectors();
     std::vector<DisplayInfo> getDisplays() const { return displays_; }
     DisplayInfo* getPrimaryDisplay();
     DisplayInfo* getDisplayByName(const std::string& name);
@@ -40,25 +130,128 @@ public:
     bool disableDisplay(DisplayInfo* display);
     bool setCRTCWithFramebuffer(DisplayInfo* display, uint32_t fb_id);
     
+    // atomic TEST_ONLY校验：在真正modeset之前验证配置
+    bool testDisplayConfig(DisplayInfo* display, uint32_t fb_id);
+    
+    // 硬件克隆：编码器的possible_clones允许且副显示器支持主CRTC当前模式时，
+    // 将副显示器的连接器直接挂到主显示器的CRTC上，无需逐帧处理
+    bool canClone(const DisplayInfo* primary, const DisplayInfo* secondary);
+    bool attachClone(const DisplayInfo* primary, DisplayInfo* secondary);
+    bool detachClone(const DisplayInfo* primary, DisplayInfo* secondary);
+    
+    // 零拷贝镜像 (仅atomic)：读取CRTC当前扫描输出的fb，并直接放到另一个CRTC的plane上
+    uint32_t getCrtcFramebuffer(uint32_t crtc_id);
+    bool getFramebufferSize(uint32_t fb_id, uint32_t& width, uint32_t& height);
+    bool setPlaneMirror(DisplayInfo* display, const PlaneMirror& mirror, bool test_only);
+    
+    // Plane格式协商 (IN_FORMATS 或 plane格式列表)
+    std::vector<uint32_t> getPlaneFormats(uint32_t plane_id);
+    bool isFormatSupported(const DisplayInfo* display, uint32_t format);
+    
     // Framebuffer operations
     uint32_t createFramebuffer(uint32_t width, uint32_t height, uint32_t format, uint32_t handles[4], uint32_t pitches[4], uint32_t offsets[4]);
     void destroyFramebuffer(uint32_t fb_id);
     
-    // Page flip operations
-    bool pageFlip(DisplayInfo* display, uint32_t fb_id);
+    // Page flip operations - 非阻塞，立即返回；我们提交的上一次翻转未完成时排队，完成后自动提交
+    // 没有未完成的翻转但CRTC仍忙 (EBUSY) 时返回false，由调用者回收缓冲区并在下一帧重试
+    // 替换掉的排队帧写入replaced_fb，未提供时通过翻转回调通知
+    bool pageFlip(DisplayInfo* display, uint32_t fb_id, uint32_t* replaced_fb = nullptr);
+    
+    // 提交多个显示器的翻转：atomic下为一次非阻塞提交，legacy下逐个pageFlip
+    // 可以从多个线程调用，被替换的排队帧通过PageFlipRequest::replaced_fb返回
+    bool commitPageFlips(std::vector<PageFlipRequest>& flips);
     
-    // Page flip event handling
-    bool waitForPageFlipEvents(int timeout_ms = 16);
-    void handlePageFlipEvent(unsigned int frame, unsigned int sec, unsigned int usec, void* data);
+    // Page flip event handling - DRM fd可读时调用，回调在调用handleEvents的线程中执行
+    bool handleEvents();
+    void setPageFlipCallback(PageFlipCallback callback) { flip_callback_ = callback; }
+    
+    // 请求display所在CRTC的下一个vblank事件 (非阻塞)，事件随handleEvents分发给vblank回调
+    bool requestVBlankEvent(const DisplayInfo* display);
+    void setVBlankCallback(VBlankCallback callback) { vblank_callback_ = callback; }
+    bool isFlipPending(uint32_t crtc_id);
     
     int getFd() const { return drm_fd_; }
+    const std::string& getCardName() const { return card_name_; }
     
 private:
     int drm_fd_;
+    std::string card_name_;             // 设备节点名，例如card0
     drmModeRes* resources_;
+    std::vector<uint32_t> connector_ids_;  // 连接器列表可能变化 (DP MST)，每次扫描时刷新
     std::vector<DisplayInfo> displays_;
     
+    // atomic modesetting
+    struct ConnectorProps { uint32_t crtc_id = 0; };
+    struct CrtcProps { uint32_t mode_id = 0; uint32_t active = 0; };
+    struct PlaneProps {
+        uint32_t fb_id = 0, crtc_id = 0;
+        uint32_t src_x = 0, src_y = 0, src_w = 0, src_h = 0;
+        uint32_t crtc_x = 0, crtc_y = 0, crtc_w = 0, crtc_h = 0;
+        uint32_t rotation = 0;  // 部分plane没有rotation属性
+    };
+    
+    KmsBackend requested_backend_;
+    ModeSelection mode_selection_;
+    bool boot_scan_;  // initialize中的第一次扫描，CRTC上还是固件留下的状态
+    std::shared_ptr<DisplayProfileStore> profiles_;
+    bool atomic_enabled_;
+    mutable std::mutex kms_stats_mutex_;
+    KmsStats kms_stats_;  // 受kms_stats_mutex_保护
+    std::map<uint32_t, ConnectorProps> connector_props_;
+    std::map<uint32_t, CrtcProps> crtc_props_;
+    std::map<uint32_t, PlaneProps> plane_props_;
+    std::map<uint32_t, uint32_t> mode_blobs_;  // crtc_id -> MODE_ID blob
+    
+    // 每个CRTC的翻转状态
+    struct CrtcFlipState {
+        uint32_t connector_id = 0;
+        uint32_t plane_id = 0;
+        uint32_t scanout_fb = 0;   // 当前正在扫描输出
+        uint32_t pending_fb = 0;   // 已提交，等待vblank
+        uint32_t queued_fb = 0;    // CRTC忙时排队，等待下一次提交
+    };
+    
+    std::mutex flip_mutex_;
+    std::map<uint32_t, CrtcFlipState> flip_states_;  // crtc_id -> state
+    std::vector<PageFlipRequest*> flip_batch_;       // commitPageFlips复用，受flip_mutex_保护
+    PageFlipCallback flip_callback_;
+    VBlankCallback vblank_callback_;
+    
+    void resetFlipState(const DisplayInfo* display, uint32_t scanout_fb);
+    int submitFlipLocked(uint32_t crtc_id, uint32_t plane_id, uint32_t fb_id);
+    void handlePageFlipEvent(uint32_t crtc_id, unsigned int sequence, unsigned int sec, unsigned int usec);
+    static void pageFlipHandler(int fd, unsigned int sequence, unsigned int sec, unsigned int usec,
+                                unsigned int crtc_id, void* data);
+    static void vblankHandler(int fd, unsigned int sequence, unsigned int sec, unsigned int usec, void* data);
+    
+    bool setupAtomic();
+    void loadAtomicProperties();
+    std::map<std::string, uint32_t> getPropertyIds(uint32_t object_id, uint32_t object_type);
+    bool addModesetProperties(drmModeAtomicReq* req, DisplayInfo* display, uint32_t fb_id, uint32_t mode_blob);
+    int atomicCommit(drmModeAtomicReq* req, uint32_t flags, void* user_data);
+    
     bool probeDrmDevice();
-    bool getConnectorInfo(uint32_t connector_id, DisplayInfo& info);
+    // 连接器状态的读取方式
+    enum class ConnectorProbe {
+        CACHED,      // 只读取内核缓存的状态
+        IF_UNKNOWN,  // 缓存的EDID没有对应的配置时强制探测 (启动扫描)
+        FORCE        // 总是强制探测 (热插拔中状态变化的连接器，缓存的EDID可能属于之前的显示器)
+    };
+    
+    bool scanConnectors(const std::set<uint32_t>* changed_connectors);
+    void refreshConnectorList();
+    bool getConnectorInfo(uint32_t connector_id, ConnectorProbe probe, DisplayInfo& info);
+    uint64_t getEdidHash(uint32_t connector_id);
+    bool findProfile(drmModeConnector* connector, DisplayInfo& info, DisplayProfile& profile);
     drmModeModeInfo* findBestMode(drmModeConnector* connector);
+    static bool hasMode(const drmModeConnector* connector, const drmModeModeInfo& mode);
+    void selectSecondaryModes();
+    const drmModeModeInfo* findEfficientMode(drmModeConnector* connector, uint64_t source_pixels, 
+                                             uint32_t source_refresh);
+    void adoptBootModes();
+    int getCrtcIndex(uint32_t crtc_id);
+    int getEncoderIndex(uint32_t encoder_id);
+    bool setCloneConnectors(const DisplayInfo* primary, DisplayInfo* secondary, bool attach);
+    uint32_t findPrimaryPlane(uint32_t crtc_index);
+    uint64_t getPropertyValue(uint32_t object_id, uint32_t object_type, const char* name, bool* found = nullptr);
 }; 
\ No newline at end of file
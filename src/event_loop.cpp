@@ -0,0 +1,187 @@
+#include "event_loop.h"
+#include "logger.h"
+#include <cstring>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static const int kMaxEvents = 16;
+
+EventLoop::EventLoop()
+    : epoll_fd_(-1), wakeup_fd_(-1), running_(false), wakeups_(0), idle_wakeups_(0) {
+}
+
+EventLoop::~EventLoop() {
+    cleanup();
+}
+
+bool EventLoop::initialize() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        LOG_ERROR("Failed to create epoll instance: {}", strerror(errno));
+        return false;
+    }
+
+    wakeup_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeup_fd_ < 0) {
+        LOG_ERROR("Failed to create eventfd: {}", strerror(errno));
+        cleanup();
+        return false;
+    }
+    running_ = true;
+
+    // 唤醒只是为了重新执行prepare回调，不计为空闲
+    return addFd(wakeup_fd_, [this]() {
+        uint64_t value;
+        while (read(wakeup_fd_, &value, sizeof(value)) > 0) {
+        }
+        return true;
+    });
+}
+
+void EventLoop::cleanup() {
+    handlers_.clear();
+    for (int fd : owned_fds_) {
+        close(fd);
+    }
+    owned_fds_.clear();
+
+    if (wakeup_fd_ >= 0) {
+        close(wakeup_fd_);
+        wakeup_fd_ = -1;
+    }
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+}
+
+bool EventLoop::addFd(int fd, Handler handler) {
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+        LOG_ERROR("Failed to add fd {} to epoll: {}", fd, strerror(errno));
+        return false;
+    }
+    handlers_[fd] = std::make_shared<Handler>(std::move(handler));
+    return true;
+}
+
+void EventLoop::removeFd(int fd) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    handlers_.erase(fd);
+}
+
+int EventLoop::createTimer(TimerHandler handler) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create timerfd: {}", strerror(errno));
+        return -1;
+    }
+
+    bool added = addFd(fd, [fd, handler]() {
+        uint64_t expirations = 0;
+        if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            return false;
+        }
+        return handler(expirations);
+    });
+    if (!added) {
+        close(fd);
+        return -1;
+    }
+    owned_fds_.push_back(fd);
+    return fd;
+}
+
+bool EventLoop::setTimer(int timer_fd, std::chrono::microseconds interval, bool periodic) {
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = interval.count() / 1000000;
+    spec.it_value.tv_nsec = (interval.count() % 1000000) * 1000;
+    if (periodic) {
+        spec.it_interval = spec.it_value;
+    }
+    if (timerfd_settime(timer_fd, 0, &spec, nullptr) != 0) {
+        LOG_ERROR("Failed to arm timerfd: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool EventLoop::addSignals(const std::vector<int>& signals, SignalHandler handler) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    for (int signo : signals) {
+        sigaddset(&mask, signo);
+    }
+
+    int fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create signalfd: {}", strerror(errno));
+        return false;
+    }
+
+    bool added = addFd(fd, [fd, handler]() {
+        struct signalfd_siginfo info;
+        while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+            handler((int)info.ssi_signo);
+        }
+        return true;
+    });
+    if (!added) {
+        close(fd);
+        return false;
+    }
+    owned_fds_.push_back(fd);
+    return true;
+}
+
+void EventLoop::run() {
+    struct epoll_event events[kMaxEvents];
+
+    while (running_) {
+        if (prepare_) {
+            prepare_();
+        }
+
+        int count = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+        if (count < 0) {
+            if (errno != EINTR) {
+                LOG_ERROR("epoll_wait failed: {}", strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        wakeups_++;
+        bool worked = false;
+        for (int i = 0; i < count; i++) {
+            auto it = handlers_.find(events[i].data.fd);
+            if (it != handlers_.end()) {
+                std::shared_ptr<Handler> handler = it->second;
+                worked |= (*handler)();
+            }
+        }
+        if (!worked) {
+            idle_wakeups_++;
+        }
+    }
+}
+
+void EventLoop::stop() {
+    running_ = false;
+    wakeup();
+}
+
+void EventLoop::wakeup() {
+    if (wakeup_fd_ >= 0) {
+        uint64_t value = 1;
+        ssize_t ret = write(wakeup_fd_, &value, sizeof(value));
+        (void)ret;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+// 基于epoll的事件循环：DRM fd、udev监视器、timerfd节拍和signalfd在同一个线程中多路复用
+// 只有fd就绪时才唤醒，没有轮询超时
+class EventLoop {
+public:
+    // 处理函数返回false表示这次唤醒没有实际工作 (计为空闲唤醒)
+    using Handler = std::function<bool()>;
+    using TimerHandler = std::function<bool(uint64_t expirations)>;
+    using SignalHandler = std::function<void(int signo)>;
+
+    EventLoop();
+    ~EventLoop();
+
+    bool initialize();
+    void cleanup();
+
+    // fd可读时调用handler (电平触发)，handler中可以移除自己的fd
+    bool addFd(int fd, Handler handler);
+    void removeFd(int fd);
+
+    // 创建定时器，setTimer的interval为0时停止，periodic为false时只触发一次
+    int createTimer(TimerHandler handler);
+    bool setTimer(int timer_fd, std::chrono::microseconds interval, bool periodic = true);
+
+    // 通过signalfd同步接收信号，这些信号必须事先在所有线程中屏蔽
+    bool addSignals(const std::vector<int>& signals, SignalHandler handler);
+
+    // 每次等待之前调用 (例如确认拓扑版本、根据状态启停定时器)
+    void setPrepareCallback(std::function<void()> callback) { prepare_ = callback; }
+
+    // 在调用线程中运行直到stop() (在run之前调用stop时立即返回)
+    void run();
+
+    // 以下可以从任意线程调用
+    void stop();
+    void wakeup();
+
+    uint64_t wakeups() const { return wakeups_; }
+    uint64_t idleWakeups() const { return idle_wakeups_; }
+
+private:
+    int epoll_fd_;
+    int wakeup_fd_;                  // eventfd，用于跨线程唤醒
+    std::vector<int> owned_fds_;     // 由事件循环创建的timerfd/signalfd
+    std::map<int, std::shared_ptr<Handler>> handlers_;  // 分发时持有引用，处理函数可以安全地移除fd
+    std::function<void()> prepare_;
+    std::atomic<bool> running_;
+
+    uint64_t wakeups_;
+    uint64_t idle_wakeups_;
+};
@@ -10,9 +10,51 @@
 #include <chrono>
 #include <cmath>
 
+bool parseOutputFormat(const std::string& name, uint32_t& format) {
+    if (name == "xrgb8888") {
+        format = DRM_FORMAT_XRGB8888;
+    } else if (name == "rgb565") {
+        format = DRM_FORMAT_RGB565;
+    } else if (name == "nv12") {
+        format = DRM_FORMAT_NV12;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* outputFormatName(uint32_t format) {
+    switch (format) {
+        case DRM_FORMAT_XRGB8888: return "xrgb8888";
+        case DRM_FORMAT_RGB565:   return "rgb565";
+        case DRM_FORMAT_NV12:     return "nv12";
+        default:                  return "unknown";
+    }
+}
+
+uint32_t frameBytesForFormat(uint32_t width, uint32_t height, uint32_t format) {
+    switch (format) {
+        case DRM_FORMAT_RGB565: return width * height * 2;
+        case DRM_FORMAT_NV12:   return width * height * 3 / 2;
+        default:                return width * height * 4;
+    }
+}
+
+// 每个工作线程最多同时持有两帧 (正在渲染的帧和邮箱中的帧)，另留一帧给捕获线程
+static size_t capturePoolSize(size_t output_count) {
+    return 2 * output_count + 1;
+}
+
 FrameCopier::FrameCopier(std::shared_ptr<DRMManager> drm_manager, 
                          std::shared_ptr<RGAHelper> rga_helper)
-    : drm_manager_(drm_manager), rga_helper_(rga_helper), gbm_device_(nullptr) {
+    : drm_manager_(drm_manager), rga_helper_(rga_helper), gbm_device_(nullptr),
+      bytes_saved_total_(0), capture_pool_(capturePoolSize(1)), capture_sequence_(0),
+      last_content_hash_(0), unchanged_captures_(0), fallback_captures_(0), capture_started_(false),
+      last_capture_us_(0), transform_peak_us_(0), fast_quality_(false),
+      rotation_degrees_(0), scale_mode_(DisplayConfig::SCALE_STRETCH), quality_(DisplayConfig::QUALITY_GOOD),
+      settings_generation_(0),
+      swapchain_cache_hits_(0), swapchain_cache_lookups_(0) {
+    capture_stages_.setTraceTrack(FrameTrace::track("Capture"));
 }
 
 FrameCopier::~FrameCopier() {
@@ -35,22 +77,14 @@ bool FrameCopier::initialize() {
 }
 
 void FrameCopier::cleanup() {
-    // 清理所有显示器的缓冲区
-    for (auto& [connector_id, buffers] : display_buffers_) {
-        for (auto& buffer : buffers) {
-            if (buffer.fb_id) {
-                drm_manager_->destroyFramebuffer(buffer.fb_id);
-            }
-            if (buffer.bo) {
-                gbm_bo_destroy(buffer.bo);
-            }
-            if (buffer.frame_buffer.virtual_addr) {
-                rga_helper_->freeBuffer(buffer.frame_buffer);
-            }
+    // 显示器的缓冲区由OutputSlot持有，工作线程持有的帧也必须在此之前全部释放
+    flushSwapchainCache();
+    
+    for (auto& captured : capture_pool_.frames()) {
+        if (captured->buffer.virtual_addr) {
+            rga_helper_->freeBuffer(captured->buffer);
         }
     }
-    display_buffers_.clear();
-    current_buffer_index_.clear();
     
     if (gbm_device_) {
         gbm_device_destroy(gbm_device_);
@@ -58,6 +92,30 @@ void FrameCopier::cleanup() {
     }
 }
 
+void FrameCopier::setConfig(const DisplayConfig& config) {
+    config_ = config;
+    TransformSettings settings;
+    settings.rotation_degrees = config.rotation_degrees;
+    settings.scale_mode = config.scale_mode;
+    settings.quality = config.quality;
+    setSettings(settings);
+}
+
+void FrameCopier::setSettings(const TransformSettings& settings) {
+    rotation_degrees_.store(settings.rotation_degrees, std::memory_order_relaxed);
+    scale_mode_.store(settings.scale_mode, std::memory_order_relaxed);
+    quality_.store(settings.quality, std::memory_order_relaxed);
+    settings_generation_.fetch_add(1, std::memory_order_release);
+}
+
+TransformSettings FrameCopier::currentSettings() const {
+    TransformSettings settings;
+    settings.rotation_degrees = getRotation();
+    settings.scale_mode = getScaleMode();
+    settings.quality = getQuality();
+    return settings;
+}
+
 bool FrameCopier::setupGBM() {
     int drm_fd = drm_manager_->getFd();
     if (drm_fd < 0) {
@@ -73,33 +131,51 @@ bool FrameCopier::setupGBM() {
     return true;
 }
 
-bool FrameCopier::captureFrame(DisplayInfo* primary_display, FrameBuffer& frame) {
+void FrameCopier::reserveCaptureFrames(size_t output_count) {
+    size_t size = capturePoolSize(output_count);
+    if (size > capture_pool_.frames().size()) {
+        LOG_DEBUG("Capture pool grows to {} frames for {} outputs", size, output_count);
+        capture_pool_.reserve(size);
+    }
+}
+
+bool FrameCopier::captureFrame(const DisplayInfo* primary_display, FrameRef& frame_ref) {
+    frame_ref.reset();
     if (!primary_display || !primary_display->connected) {
         return false;
     }
     
+    // 最慢的显示器还在使用所有捕获缓冲区时丢弃本帧，不等待
+    FrameRef captured = capture_pool_.acquire();
+    if (!captured) {
+        return false;
+    }
+    
     uint32_t width = primary_display->width;
     uint32_t height = primary_display->height;
     uint32_t format = DRM_FORMAT_XRGB8888;
     
-    if (!rga_helper_->allocateBuffer(frame, width, height, format)) {
-        return false;
+    // 捕获缓冲区为持久化的dma-buf，仅在分辨率变化时重新分配 (此时没有其他引用)
+    FrameBuffer& frame = captured.get()->buffer;
+    if (!frame.virtual_addr || frame.width != width ||
+        frame.height != height || frame.format != format) {
+        if (frame.virtual_addr) {
+            rga_helper_->freeBuffer(frame);
+        }
+        if (!rga_helper_->allocateBuffer(frame, width, height, format)) {
+            return false;
+        }
     }
+    rga_helper_->beginCpuAccess(frame, true);
     
     bool captured_real_content = false;
-    static uint32_t last_pixel_checksum = 0;
     
-    // 等待vblank以确保framebuffer是最新的
-    if (primary_display->crtc_id) {
-        drmVBlank vbl;
-        vbl.request.type = DRM_VBLANK_RELATIVE;
-        vbl.request.sequence = 1;
-        vbl.request.signal = 0;
-        drmWaitVBlank(drm_manager_->getFd(), &vbl);
-    }
+    // 调用者已在vblank事件之后调用 (捕获线程不在这里阻塞等待)
+    auto copy_start = std::chrono::steady_clock::now();
     
     // 尝试读取当前活跃的framebuffer
     if (primary_display->crtc_id && frame.virtual_addr) {
+        ScopedStageTimer map_timer(&capture_stages_, PipelineStage::MAP);
         drmModeCrtc* crtc = drmModeGetCrtc(drm_manager_->getFd(), primary_display->crtc_id);
         if (crtc && crtc->buffer_id) {
             drmModeFB* fb = drmModeGetFB(drm_manager_->getFd(), crtc->buffer_id);
@@ -115,6 +191,9 @@ bool FrameCopier::captureFrame(DisplayInfo* primary_display, FrameBuffer& frame)
                                            drm_manager_->getFd(), map_req.offset);
                         
                         if (fb_ptr != MAP_FAILED) {
+                            map_timer.stop();
+                            ScopedStageTimer copy_timer(&capture_stages_, PipelineStage::CAPTURE_COPY);
+                            
                             // 强制同步内存，确保读取最新数据
                             msync(fb_ptr, fb->height * fb->pitch, MS_SYNC);
                             
@@ -137,56 +216,10 @@ bool FrameCopier::captureFrame(DisplayInfo* primary_display, FrameBuffer& frame)
                                       copy_width * 4);
                             }
                             
-
-                            
-                            // 计算像素内容的简单校验和来检测变化
-                            uint32_t checksum = 0;
-                            for (uint32_t i = 0; i < std::min(1000u, copy_width * copy_height); i++) {
-                                checksum ^= dst_pixels[i];
-                            }
-                            
+                            copy_timer.stop();
                             captured_real_content = true;
                             mapping_success = true;
                             
-                            // 检测内容变化 - 仅在严格调试模式下记录
-                            static int success_count = 0;
-                            static uint32_t frame_checksums[10] = {0}; // 记录最近10帧的校验和
-                            static auto last_report_time = std::chrono::steady_clock::now();
-                            static bool first_capture_logged = false;
-                            ++success_count;
-                            
-                            bool content_changed = (checksum != last_pixel_checksum);
-                            frame_checksums[success_count % 10] = checksum;
-                            
-                            // 只在第一次成功capture时记录一次，之后不再循环记录
-                            if (!first_capture_logged) {
-                                LOG_INFO("DSI capture started successfully, frame mirroring active");
-                                first_capture_logged = true;
-                            }
-                            
-                            // 仅在每300帧（10秒）或严重错误时记录
-                            auto now = std::chrono::steady_clock::now();
-                            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - last_report_time);
-                            
-                            if (success_count % 300 == 0 && elapsed.count() >= 10) {
-                                // 检查最近10帧是否有任何变化
-                                bool any_variation = false;
-                                for (int i = 1; i < 10; i++) {
-                                    if (frame_checksums[i] != frame_checksums[0]) {
-                                        any_variation = true;
-                                        break;
-                                    }
-                                }
-                                
-                                // 只在没有变化（可能有问题）时记录
-                                if (!any_variation) {
-                                    LOG_WARN("DSI capture: No content variation detected in last 10 frames");
-                                }
-                                last_report_time = now;
-                            }
-                            
-                            last_pixel_checksum = checksum;
-                            
                             munmap(fb_ptr, fb->height * fb->pitch);
                         } else {
                             // 映射失败，短暂等待后重试
@@ -214,58 +247,78 @@ bool FrameCopier::captureFrame(DisplayInfo* primary_display, FrameBuffer& frame)
             }
         }
         
-        static int fallback_count = 0;
-        if (++fallback_count % 30 == 0) {  // 更频繁地报告
-            std::cout << "DSI framebuffer capture FAILED - using fallback pattern (attempt " 
-                     << fallback_count << ")" << std::endl;
-        }
+        fallback_captures_++;
+        LOG_EVERY_N(WARN, 30, "DSI framebuffer capture FAILED - using fallback pattern (attempt {})",
+                    fallback_captures_);
     }
     
+    uint64_t hash = contentHash(frame);
+    captured.get()->changed = (hash != last_content_hash_);
+    last_content_hash_ = hash;
+    
+    if (captured_real_content) {
+        // 只在第一次成功capture时记录一次
+        if (!capture_started_) {
+            LOG_INFO("DSI capture started successfully, frame mirroring active");
+            capture_started_ = true;
+        }
+        unchanged_captures_ = captured.get()->changed ? 0 : unchanged_captures_ + 1;
+        if (unchanged_captures_ >= 10) {
+            LOG_EVERY_MS(WARN, 10000, "DSI capture: No content variation detected in last {} frames",
+                         unchanged_captures_);
+        }
+    }
+    rga_helper_->endCpuAccess(frame, true);
+    last_capture_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - copy_start).count();
+    captured.get()->sequence = ++capture_sequence_;
+    frame_ref = std::move(captured);
     return true;
 }
 
-bool FrameCopier::copyToDisplay(const FrameBuffer& source_frame, DisplayInfo* target_display) {
-    if (!target_display || !target_display->connected) {
-        return false;
+uint32_t FrameCopier::renderToDisplay(const FrameBuffer& source_frame, OutputSlot& slot) {
+    DisplayInfo* target_display = &slot.display;
+    if (!target_display->connected) {
+        return 0;
     }
     
-    GBMBuffer* target_buffer = getNextBuffer(target_display);
-    if (!target_buffer || !target_buffer->valid) {
-        std::cerr << "Failed to get target buffer for " << target_display->name << std::endl;
-        return false;
+    // 所有缓冲区都在排队或扫描输出时跳过本帧而不是阻塞 (计入饥饿次数)
+    Swapchain* swapchain = &slot.swapchain;
+    GBMBuffer* target_buffer;
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        target_buffer = swapchain->acquire();
+    }
+    if (!target_buffer) {
+        return 0;
     }
     
-    // 使用static map为每个显示器单独计数
-    static std::map<std::string, int> copy_counts;
-    copy_counts[target_display->name]++;
-    
-    // if (copy_counts[target_display->name] % 60 == 0) {
-    //     // // std::cout << "Copying frame " << copy_counts[target_display->name] << " to " << target_display->name 
-    //     //           << " (source: " << source_frame.width << "x" << source_frame.height 
-    //     //           << ", target: " << target_display->width << "x" << target_display->height << ")" << std::endl;
-    // }
-    
-    uint32_t scale_x, scale_y, scale_width, scale_height;
-    calculateScaling(source_frame.width, source_frame.height,
-                    target_display->width, target_display->height,
-                    scale_x, scale_y, scale_width, scale_height);
+    slot.frames++;
+    auto render_start = std::chrono::steady_clock::now();
     
-    // 使用配置中的旋转角度
-    int rotation_degrees = config_.rotation_degrees;
+    // 缩放参数只在源尺寸变化时重新计算
+    TransformPlan& plan = slot.plan;
+    if (plan.src_width != source_frame.width || plan.src_height != source_frame.height) {
+        plan.src_width = source_frame.width;
+        plan.src_height = source_frame.height;
+        calculateScaling(source_frame.width, source_frame.height,
+                        target_display->width, target_display->height,
+                        plan.x, plan.y, plan.width, plan.height);
+    }
     
-    // if (copy_counts[target_display->name] % 60 == 0) {
-    //     std::cout << "  Scaling to: " << scale_width << "x" << scale_height 
-    //               << " at offset (" << scale_x << "," << scale_y 
-    //               << "), rotation: " << rotation_degrees << "°" << std::endl;
-    // }
+    // 使用该显示器在帧边界锁存的变换参数，质量可能被调节器临时降低
+    int rotation_degrees = slot.settings.rotation_degrees;
+    DisplayConfig::ScaleMode scale_mode = slot.settings.scale_mode;
+    DisplayConfig::Quality quality = fast_quality_.load(std::memory_order_relaxed)
+        ? DisplayConfig::QUALITY_FAST : slot.settings.quality;
     
     // 优先使用RGA硬件加速，仅在失败时使用CPU复制
     bool use_cpu_copy = false;  // 优先使用RGA提高性能
     bool success = false;
     
     if (!use_cpu_copy) {
-        // 确保源缓冲区数据是最新的
-        if (source_frame.virtual_addr) {
+        // 确保源缓冲区数据是最新的 (dma-buf已在captureFrame中完成同步)
+        if (source_frame.dma_fd < 0 && source_frame.virtual_addr) {
             // 强制刷新源缓冲区缓存
             msync(source_frame.virtual_addr, source_frame.size, MS_SYNC);
             __sync_synchronize();
@@ -275,68 +328,68 @@ bool FrameCopier::copyToDisplay(const FrameBuffer& source_frame, DisplayInfo* ta
         success = rga_helper_->scaleAndCopy(
             source_frame, target_buffer->frame_buffer,
             0, 0, source_frame.width, source_frame.height,
-            scale_x, scale_y, scale_width, scale_height,
-            rotation_degrees
+            plan.x, plan.y, plan.width, plan.height,
+            rotation_degrees, &slot.stages
         );
         
         if (!success) {
-            LOG_WARN("RGA copy failed for {}, falling back to CPU copy", target_display->name);
+            LOG_EVERY_MS(WARN, 1000, "RGA copy failed for {}, falling back to CPU copy", target_display->name);
             use_cpu_copy = true;
         }
     }
     
     if (use_cpu_copy) {
         // CPU直接复制和旋转
-        // if (copy_counts[target_display->name] % 60 == 0) {
-        //     std::cout << "  Using CPU copy instead of RGA..." << std::endl;
-        // }
-        
-        // 获取目标缓冲区的虚拟地址
-        void* target_addr = nullptr;
-        uint32_t stride;
-        void* map_data;
-        if (target_buffer->bo) {
-            target_addr = gbm_bo_map(target_buffer->bo, 0, 0, 
-                                   target_display->width, target_display->height,
-                                   GBM_BO_TRANSFER_WRITE, &stride, &map_data);
-        }
-        
-        if (target_addr && source_frame.virtual_addr) {
-            uint32_t* src_pixels = (uint32_t*)source_frame.virtual_addr;
-            uint32_t* dst_pixels = (uint32_t*)target_addr;
-            
-            // 简单的缩放和旋转（90度顺时针）
-            uint32_t src_w = source_frame.width;
-            uint32_t src_h = source_frame.height;
+        ScopedStageTimer cpu_timer(&slot.stages, PipelineStage::CPU_FALLBACK);
+        uint32_t target_format = target_buffer->frame_buffer.format;
+        if (target_format != DRM_FORMAT_XRGB8888 && source_frame.virtual_addr) {
+            // 非XRGB格式：先变换到XRGB中间缓冲区，再打包写入目标格式
             uint32_t dst_w = target_display->width;
             uint32_t dst_h = target_display->height;
+            slot.cpu_scratch.assign((size_t)dst_w * dst_h, 0);
+            copyWithTransform((uint32_t*)source_frame.virtual_addr, slot.cpu_scratch.data(),
+                            source_frame.width, source_frame.height, dst_w, dst_h,
+                            rotation_degrees, scale_mode, quality);
+            success = packToTarget(slot.cpu_scratch.data(), dst_w, dst_h, *target_buffer);
+        } else {
+            // 获取目标缓冲区的虚拟地址
+            void* target_addr = nullptr;
+            uint32_t stride;
+            void* map_data;
+            if (target_buffer->bo) {
+                target_addr = gbm_bo_map(target_buffer->bo, 0, 0, 
+                                       target_display->width, target_display->height,
+                                       GBM_BO_TRANSFER_WRITE, &stride, &map_data);
+            }
+            
+            if (target_addr && source_frame.virtual_addr) {
+                uint32_t* src_pixels = (uint32_t*)source_frame.virtual_addr;
+                uint32_t* dst_pixels = (uint32_t*)target_addr;
             
-            // 清空目标缓冲区
-            memset(dst_pixels, 0, dst_w * dst_h * 4);
+                // 简单的缩放和旋转（90度顺时针）
+                uint32_t src_w = source_frame.width;
+                uint32_t src_h = source_frame.height;
+                uint32_t dst_w = target_display->width;
+                uint32_t dst_h = target_display->height;
             
-            // 根据配置进行缩放和旋转
-            copyWithTransform(src_pixels, dst_pixels, src_w, src_h, dst_w, dst_h, 
-                            rotation_degrees, config_.scale_mode, config_.quality);
+                // 清空目标缓冲区
+                memset(dst_pixels, 0, dst_w * dst_h * 4);
             
-            gbm_bo_unmap(target_buffer->bo, map_data);
-            success = true;
+                // 根据配置进行缩放和旋转
+                copyWithTransform(src_pixels, dst_pixels, src_w, src_h, dst_w, dst_h, 
+                                rotation_degrees, scale_mode, quality);
+            
+                gbm_bo_unmap(target_buffer->bo, map_data);
+                success = true;
+            }
         }
-    } else {
-        // 原来的RGA方法
-        success = rga_helper_->scaleAndCopy(
-            source_frame, target_buffer->frame_buffer,
-            0, 0, source_frame.width, source_frame.height,
-            scale_x, scale_y, scale_width, scale_height,
-            rotation_degrees
-        );
     }
     
-        // 使用RGA硬件加速复制DSI内容到目标显示器
-    // 移除循环打印
-    
     if (!success) {
-        LOG_ERROR("Failed to scale and copy frame to {}", target_display->name);
-        return false;
+        LOG_EVERY_MS(ERROR, 1000, "Failed to scale and copy frame to {}", target_display->name);
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        swapchain->release(target_buffer);
+        return 0;
     }
     
     // 强制同步DMA缓冲区，确保数据写入到显示硬件
@@ -347,88 +400,427 @@ bool FrameCopier::copyToDisplay(const FrameBuffer& source_frame, DisplayInfo* ta
     // 添加内存屏障确保所有写操作完成
     __sync_synchronize();
     
-    // 移除循环打印
+    uint64_t render_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - render_start).count();
+    uint64_t peak = transform_peak_us_.load(std::memory_order_relaxed);
+    while (render_us > peak &&
+           !transform_peak_us_.compare_exchange_weak(peak, render_us, std::memory_order_relaxed)) {
+    }
     
-    // 使用pageFlip确保垂直同步
-    success = drm_manager_->pageFlip(target_display, target_buffer->fb_id);
-    if (!success) {
-        LOG_ERROR("Failed to page flip for {}", target_display->name);
+    // 刚退出零拷贝镜像：这一帧通过modeset恢复全屏plane，不再提交翻转
+    if (slot.mirror.leaving) {
+        restoreFromMirror(slot, target_buffer);
+        return 0;
+    }
+    
+    // 翻转由调用者提交
+    return target_buffer->fb_id;
+}
+
+uint64_t FrameCopier::contentHash(const FrameBuffer& frame) {
+    // 每16行每16个像素采样一次 (1080p约8000个像素)，足以发现滚动、视频和界面更新
+    if (!frame.virtual_addr) {
+        return 0;
+    }
+    const uint8_t* base = static_cast<const uint8_t*>(frame.virtual_addr);
+    uint64_t hash = 1469598103934665603ULL;  // FNV-1a
+    for (uint32_t y = 0; y < frame.height; y += 16) {
+        const uint32_t* row = reinterpret_cast<const uint32_t*>(base + (size_t)y * frame.stride);
+        for (uint32_t x = 0; x < frame.width; x += 16) {
+            hash = (hash ^ row[x]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+void FrameCopier::onFlipSubmitted(OutputSlot& slot, const PageFlipRequest& flip) {
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    GBMBuffer* buffer = slot.swapchain.findByFb(flip.fb_id);
+    if (!buffer) {
+        // 零拷贝镜像翻转的是主显示器的fb，可能已被其所有者删除 (plane随之被关闭)，下一帧重新配置plane
+        if (!flip.submitted) {
+            slot.mirror.stale = true;
+        }
+        return;
+    }
+    
+    // 被新帧替换的排队帧从未显示过，直接回收
+    if (flip.replaced_fb) {
+        slot.swapchain.onFlipComplete(0, flip.replaced_fb);
+    }
+    
+    if (!flip.submitted) {
+        slot.swapchain.release(buffer);
+        return;
+    }
+    
+    slot.swapchain.markQueued(buffer);
+    
+    // 提交时间 (steady_clock即CLOCK_MONOTONIC，与vblank时间戳可比)，用于统计翻转完成延迟
+    slot.stats.submitted_fb = flip.fb_id;
+    slot.stats.submitted_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    bytes_saved_total_.fetch_add(slot.format_savings, std::memory_order_relaxed);
+}
+
+void FrameCopier::discardFrame(OutputSlot& slot, uint32_t fb_id) {
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    slot.swapchain.release(slot.swapchain.findByFb(fb_id));
+}
+
+void FrameCopier::onPageFlipComplete(OutputSlot& slot, const PageFlipEvent& event) {
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    slot.swapchain.onFlipComplete(event.fb_id, event.released_fb_id);
+    
+    // 仅释放 (排队帧被替换) 的事件没有vblank时间戳
+    if (!event.fb_id) {
+        return;
+    }
+    
+    OutputStats& stats = slot.stats;
+    if (stats.last_timestamp_us && event.timestamp_us > stats.last_timestamp_us) {
+        stats.max_interval_us = std::max(stats.max_interval_us, event.timestamp_us - stats.last_timestamp_us);
+        stats.vblank_jitter.add(event.timestamp_us - stats.last_timestamp_us);
+    }
+    stats.last_timestamp_us = event.timestamp_us;
+    stats.flips++;
+    
+    // vblank时间戳就是该帧开始扫描输出的时刻
+    FrameTrace::Clock::time_point vblank{std::chrono::microseconds(event.timestamp_us)};
+    FrameTrace::instant(slot.scanout_track, "vblank", vblank, event.sequence);
+    
+    // 只统计最近一次提交的帧，被替换的排队帧没有完成事件
+    if (event.fb_id == stats.submitted_fb && event.timestamp_us >= stats.submitted_us) {
+        slot.stages.record(PipelineStage::FLIP_COMPLETE, event.timestamp_us - stats.submitted_us);
+        FrameTrace::span(slot.scanout_track, pipelineStageName(PipelineStage::FLIP_COMPLETE),
+                         FrameTrace::Clock::time_point(std::chrono::microseconds(stats.submitted_us)), vblank);
+        stats.submitted_fb = 0;
+    }
+}
+
+bool FrameCopier::mirrorToDisplay(const DisplayInfo& primary_display, OutputSlot& slot, uint32_t& fb_id) {
+    fb_id = 0;
+    DisplayInfo* target_display = &slot.display;
+    if (!config_.zero_copy || !drm_manager_->isAtomic() || !target_display->connected) {
         return false;
     }
     
-    // 移除循环打印
+    MirrorState& state = slot.mirror;
+    uint32_t source_fb = drm_manager_->getCrtcFramebuffer(primary_display.crtc_id);
     
-    current_buffer_index_[target_display->connector_id] = 
-        (current_buffer_index_[target_display->connector_id] + 1) % 2;
+    // 主显示器没有翻转：plane上已经是最新的帧
+    if (state.active && !state.stale && source_fb == state.fb_id) {
+        return true;
+    }
     
+    uint32_t src_w = 0, src_h = 0;
+    if (!source_fb || !drm_manager_->getFramebufferSize(source_fb, src_w, src_h)) {
+        if (state.active) {
+            leaveMirror(slot);
+        }
+        return false;
+    }
+    
+    // 源尺寸不变时plane配置保持不变，只需跟随主显示器翻转FB_ID
+    if (state.active && !state.stale && src_w == state.src_w && src_h == state.src_h) {
+        fb_id = source_fb;
+        state.fb_id = source_fb;
+        return true;
+    }
+    
+    // 该源尺寸已被驱动拒绝，主显示器的fb尺寸变化之前一直走复制路径
+    if (state.rejected && src_w == state.src_w && src_h == state.src_h) {
+        return false;
+    }
+    
+    // 等待该CRTC上未完成的翻转，本帧保持原样
+    if (drm_manager_->isFlipPending(target_display->crtc_id)) {
+        return true;
+    }
+    
+    int rotation_degrees = slot.settings.rotation_degrees;
+    uint32_t rotated_w = src_w, rotated_h = src_h;
+    if (rotation_degrees == 90 || rotation_degrees == 270) {
+        std::swap(rotated_w, rotated_h);
+    }
+    
+    PlaneMirror mirror = {};
+    mirror.fb_id = source_fb;
+    mirror.src_w = src_w;
+    mirror.src_h = src_h;
+    mirror.rotation_degrees = rotation_degrees;
+    if (slot.settings.scale_mode == DisplayConfig::SCALE_KEEP_ASPECT) {
+        calculateScaling(rotated_w, rotated_h, target_display->width, target_display->height,
+                         mirror.crtc_x, mirror.crtc_y, mirror.crtc_w, mirror.crtc_h);
+    } else {
+        mirror.crtc_x = 0;
+        mirror.crtc_y = 0;
+        mirror.crtc_w = target_display->width;
+        mirror.crtc_h = target_display->height;
+    }
+    
+    state.src_w = src_w;
+    state.src_h = src_h;
+    
+    if (!drm_manager_->setPlaneMirror(target_display, mirror, true) ||
+        !drm_manager_->setPlaneMirror(target_display, mirror, false)) {
+        LOG_WARN("Zero-copy mirroring of {}x{} source not possible on {}, using copy pipeline",
+                 src_w, src_h, target_display->name);
+        state.rejected = true;
+        if (state.active) {
+            leaveMirror(slot);
+        }
+        return false;
+    }
+    
+    if (!state.active) {
+        LOG_INFO("Zero-copy mirroring {} onto {} ({}x{} -> {}x{}+{}+{}, rotation {}°)",
+                 primary_display.name, target_display->name, src_w, src_h,
+                 mirror.crtc_w, mirror.crtc_h, mirror.crtc_x, mirror.crtc_y, rotation_degrees);
+    }
+    
+    // 阻塞提交返回后交换链中的缓冲区都不再被扫描输出
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.swapchain.releaseAll();
+    }
+    state.active = true;
+    state.stale = false;
+    state.rejected = false;
+    state.leaving = false;
+    state.fb_id = source_fb;
     return true;
 }
 
-bool FrameCopier::createBuffersForDisplay(DisplayInfo* display) {
-    if (!display || !gbm_device_) {
-        return false;
+void FrameCopier::leaveMirror(OutputSlot& slot) {
+    // 之后的帧走复制路径；plane保持镜像配置，直到复制路径的第一帧渲染完成再恢复，不显示未渲染的缓冲区
+    slot.mirror.active = false;
+    slot.mirror.stale = false;
+    slot.mirror.fb_id = 0;
+    slot.mirror.leaving = true;
+}
+
+void FrameCopier::restoreFromMirror(OutputSlot& slot, GBMBuffer* buffer) {
+    // 用已渲染的帧恢复全屏plane配置 (清除源矩形和旋转)
+    bool restored = drm_manager_->setCRTCWithFramebuffer(&slot.display, buffer->fb_id);
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    if (!restored) {
+        LOG_EVERY_MS(ERROR, 1000, "Failed to restore {} after zero-copy mirroring", slot.display.name);
+        slot.swapchain.release(buffer);
+        return;
+    }
+    slot.swapchain.markScanout(buffer->fb_id);
+    slot.mirror.leaving = false;
+    LOG_INFO("Zero-copy mirroring stopped on {}", slot.display.name);
+}
+
+void FrameCopier::resetCalibration(OutputSlot& slot) {
+    // 源尺寸清零后下一帧重新计算缩放参数；被拒绝的镜像配置重新尝试，生效中的镜像按当前角度重新配置plane
+    slot.plan = TransformPlan();
+    slot.mirror.rejected = false;
+    if (slot.mirror.active) {
+        slot.mirror.stale = true;
+    }
+    LOG_INFO("Recalibrating {} (rotation {}°)", slot.display.name, slot.settings.rotation_degrees);
+}
+
+void FrameCopier::applySettings(OutputSlot& slot) {
+    slot.settings_generation = settingsGeneration();
+    TransformSettings settings = currentSettings();
+    bool geometry_changed = settings.rotation_degrees != slot.settings.rotation_degrees ||
+                            settings.scale_mode != slot.settings.scale_mode;
+    slot.settings = settings;
+    
+    // 缩放参数和镜像的plane配置依赖旋转和缩放模式，模式和缓冲区不受影响
+    if (geometry_changed) {
+        resetCalibration(slot);
+    }
+}
+
+std::shared_ptr<OutputSlot> FrameCopier::createOutputSlot(const DisplayInfo& display, const DisplayProfile* profile) {
+    if (!gbm_device_) {
+        return nullptr;
     }
     
-    uint32_t connector_id = display->connector_id;
-    uint32_t width = display->width;
-    uint32_t height = display->height;
-    uint32_t format = GBM_FORMAT_XRGB8888;
+    // 已知显示器沿用上次的格式协商结果
+    uint32_t requested = config_.outputFormatFor(display.name);
+    bool known_format = profile && profile->output_format && profile->requested_format == requested;
+    uint32_t format = known_format ? profile->output_format : negotiateOutputFormat(display);
     
-    std::vector<GBMBuffer> buffers(2);
+    // 显示缓冲区都按线性布局分配
+    SwapchainKey key;
+    key.width = display.width;
+    key.height = display.height;
+    key.format = format;
+    key.modifier = DRM_FORMAT_MOD_LINEAR;
+    key.depth = (size_t)std::clamp(config_.swapchain_depth, 2, 8);
+    
+    std::vector<GBMBuffer> buffers;
+    bool cached = takeCachedSwapchain(key, buffers);
+    if (!cached) {
+        buffers.resize(key.depth);
+        if (!allocateDisplayBuffers(display, format, buffers)) {
+            if (format == DRM_FORMAT_XRGB8888) {
+                return nullptr;
+            }
+            LOG_WARN("Failed to allocate {} buffers for {}, falling back to xrgb8888",
+                     outputFormatName(format), display.name);
+            format = DRM_FORMAT_XRGB8888;
+            key.format = format;
+            if (!allocateDisplayBuffers(display, format, buffers)) {
+                return nullptr;
+            }
+        }
+    }
+    
+    // 最后一个引用 (可能在工作线程中) 释放时销毁缓冲区
+    std::shared_ptr<OutputSlot> slot(new OutputSlot(), [this](OutputSlot* s) { releaseOutputSlot(s); });
+    slot->display = display;
+    slot->cache_key = key;
+    slot->requested_format = requested;
+    slot->stages.setTraceTrack(FrameTrace::track(display.name + " transform"));
+    slot->scanout_track = FrameTrace::track(display.name + " CRTC " + std::to_string(display.crtc_id));
+    slot->settings_generation = settingsGeneration();
+    slot->settings = currentSettings();
+    
+    // 旋转和缩放模式未变时沿用上次的变换参数和零拷贝镜像校准结果
+    if (profile && profile->rotation_degrees == slot->settings.rotation_degrees &&
+        profile->scale_mode == (int)slot->settings.scale_mode &&
+        profile->mode.hdisplay == display.width && profile->mode.vdisplay == display.height) {
+        slot->plan.src_width = profile->plan_src_width;
+        slot->plan.src_height = profile->plan_src_height;
+        slot->plan.x = profile->plan_x;
+        slot->plan.y = profile->plan_y;
+        slot->plan.width = profile->plan_width;
+        slot->plan.height = profile->plan_height;
+        if (profile->mirror_rejected) {
+            slot->mirror.rejected = true;
+            slot->mirror.src_w = profile->mirror_src_width;
+            slot->mirror.src_h = profile->mirror_src_height;
+        }
+    }
     
-    for (int i = 0; i < 2; i++) {
+    // 第一个缓冲区将由modeset直接扫描输出
+    uint32_t initial_fb = buffers[0].fb_id;
+    slot->swapchain = Swapchain(std::move(buffers));
+    slot->swapchain.markScanout(initial_fb);
+    
+    // 报告低带宽格式每帧节省的扫描输出字节数
+    uint32_t frame_bytes = frameBytesForFormat(display.width, display.height, format);
+    uint32_t xrgb_bytes = frameBytesForFormat(display.width, display.height, DRM_FORMAT_XRGB8888);
+    slot->format_savings = xrgb_bytes - frame_bytes;
+    
+    LOG_INFO("{} {} buffers for display {} ({}x{} {}, {} KB/frame, saves {} KB/frame vs xrgb8888)",
+             cached ? "Reused cached" : "Created", key.depth, display.name, display.width, display.height,
+             outputFormatName(format), frame_bytes / 1024, (xrgb_bytes - frame_bytes) / 1024);
+    return slot;
+}
+
+uint32_t FrameCopier::negotiateOutputFormat(const DisplayInfo& display) {
+    uint32_t format = config_.outputFormatFor(display.name);
+    if (format == DRM_FORMAT_XRGB8888) {
+        return format;
+    }
+    
+    if (format == DRM_FORMAT_NV12 && ((display.width | display.height) & 1)) {
+        LOG_WARN("{}: nv12 requires even dimensions ({}x{}), using xrgb8888",
+                 display.name, display.width, display.height);
+        return DRM_FORMAT_XRGB8888;
+    }
+    
+    if (!drm_manager_->isFormatSupported(&display, format)) {
+        LOG_WARN("{}: plane {} doesn't support {}, using xrgb8888",
+                 display.name, display.plane_id, outputFormatName(format));
+        return DRM_FORMAT_XRGB8888;
+    }
+    
+    if (!gbm_device_is_format_supported(gbm_device_, format, GBM_BO_USE_SCANOUT)) {
+        LOG_WARN("{}: GBM can't allocate {} scanout buffers, using xrgb8888",
+                 display.name, outputFormatName(format));
+        return DRM_FORMAT_XRGB8888;
+    }
+    
+    return format;
+}
+
+bool FrameCopier::allocateDisplayBuffers(const DisplayInfo& display, uint32_t format,
+                                         std::vector<GBMBuffer>& buffers) {
+    uint32_t width = display.width;
+    uint32_t height = display.height;
+    
+    for (size_t i = 0; i < buffers.size(); i++) {
         GBMBuffer& buffer = buffers[i];
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.frame_buffer.dma_fd = -1;
         
         buffer.bo = gbm_bo_create(gbm_device_, width, height, format, 
                                  GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING | GBM_BO_USE_LINEAR);
         
         if (!buffer.bo) {
-            LOG_ERROR("Failed to create GBM BO for {}", display->name);
-            
-            for (int j = 0; j < i; j++) {
-                if (buffers[j].fb_id) {
-                    drm_manager_->destroyFramebuffer(buffers[j].fb_id);
-                }
-                if (buffers[j].bo) {
-                    gbm_bo_destroy(buffers[j].bo);
-                }
+            LOG_ERROR("Failed to create GBM BO for {}", display.name);
+            for (size_t j = 0; j < i; j++) {
+                releaseDisplayBuffer(buffers[j]);
             }
             return false;
         }
         
         uint32_t bo_width = gbm_bo_get_width(buffer.bo);
         uint32_t bo_height = gbm_bo_get_height(buffer.bo);
-        uint32_t bo_stride = gbm_bo_get_stride(buffer.bo);
-        uint32_t bo_handle = gbm_bo_get_handle(buffer.bo).u32;
         uint32_t bo_format = gbm_bo_get_format(buffer.bo);
         
-        uint32_t handles[4] = {bo_handle, 0, 0, 0};
-        uint32_t pitches[4] = {bo_stride, 0, 0, 0};
-        uint32_t offsets[4] = {0, 0, 0, 0};
+        uint32_t handles[4] = {0, 0, 0, 0};
+        int plane_count = gbm_bo_get_plane_count(buffer.bo);
+        for (int p = 0; p < plane_count && p < 4; p++) {
+            handles[p] = gbm_bo_get_handle_for_plane(buffer.bo, p).u32;
+            buffer.pitches[p] = gbm_bo_get_stride_for_plane(buffer.bo, p);
+            buffer.offsets[p] = gbm_bo_get_offset(buffer.bo, p);
+        }
+        
+        // 部分GBM实现将NV12分配为单个连续plane，UV紧随Y之后
+        if (bo_format == DRM_FORMAT_NV12 && plane_count == 1) {
+            handles[1] = handles[0];
+            buffer.pitches[1] = buffer.pitches[0];
+            buffer.offsets[1] = buffer.pitches[0] * bo_height;
+        }
+        
+        // RGA和CPU打包都只通过plane 0的dma-buf访问各plane，各plane在不同BO中时无法使用
+        // RGA只能表达行距 (wstride) 和UV plane起始行 (hstride)：UV必须与Y同行距且从整行开始
+        bool separate_bos = plane_count > 1 && handles[1] != handles[0];
+        bool rga_layout = bo_format != DRM_FORMAT_NV12 ||
+            (buffer.offsets[0] == 0 && buffer.pitches[1] == buffer.pitches[0] &&
+             buffer.offsets[1] % buffer.pitches[0] == 0 && buffer.offsets[1] / buffer.pitches[0] >= bo_height);
+        if (separate_bos || !rga_layout) {
+            LOG_WARN("{}: {} layout not supported ({} planes, pitches {}/{}, UV offset {}{})",
+                     display.name, outputFormatName(bo_format), plane_count, buffer.pitches[0],
+                     buffer.pitches[1], buffer.offsets[1], separate_bos ? ", separate buffer objects" : "");
+            releaseDisplayBuffer(buffer);
+            for (size_t j = 0; j < i; j++) {
+                releaseDisplayBuffer(buffers[j]);
+            }
+            return false;
+        }
         
         buffer.fb_id = drm_manager_->createFramebuffer(bo_width, bo_height, bo_format,
-                                                      handles, pitches, offsets);
+                                                      handles, buffer.pitches, buffer.offsets);
         
         if (!buffer.fb_id) {
-            LOG_ERROR("Failed to create framebuffer for {}", display->name);
-            
-            gbm_bo_destroy(buffer.bo);
-            for (int j = 0; j < i; j++) {
-                if (buffers[j].fb_id) {
-                    drm_manager_->destroyFramebuffer(buffers[j].fb_id);
-                }
-                if (buffers[j].bo) {
-                    gbm_bo_destroy(buffers[j].bo);
-                }
+            LOG_ERROR("Failed to create framebuffer for {}", display.name);
+            releaseDisplayBuffer(buffer);
+            for (size_t j = 0; j < i; j++) {
+                releaseDisplayBuffer(buffers[j]);
             }
             return false;
         }
         
         buffer.frame_buffer.width = bo_width;
         buffer.frame_buffer.height = bo_height;
-        buffer.frame_buffer.stride = bo_stride;
+        buffer.frame_buffer.stride = buffer.pitches[0];
+        buffer.frame_buffer.height_stride = (bo_format == DRM_FORMAT_NV12)
+            ? buffer.offsets[1] / buffer.pitches[0] : bo_height;
         buffer.frame_buffer.format = bo_format;
-        buffer.frame_buffer.size = bo_stride * bo_height;
+        buffer.frame_buffer.size = (bo_format == DRM_FORMAT_NV12)
+            ? buffer.offsets[1] + buffer.pitches[1] * (bo_height / 2)
+            : buffer.pitches[0] * bo_height;
         buffer.frame_buffer.dma_fd = gbm_bo_get_fd(buffer.bo);
         buffer.frame_buffer.virtual_addr = nullptr;
         buffer.frame_buffer.physical_addr = 0;
@@ -436,90 +828,158 @@ bool FrameCopier::createBuffersForDisplay(DisplayInfo* display) {
         buffer.valid = true;
     }
     
-    display_buffers_[connector_id] = std::move(buffers);
-    current_buffer_index_[connector_id] = 0;
-    
-    LOG_INFO("Created buffers for display {}", display->name);
     return true;
 }
 
-void FrameCopier::destroyBuffersForDisplay(DisplayInfo* display) {
-    if (!display) {
-        return;
+void FrameCopier::releaseDisplayBuffer(GBMBuffer& buffer) {
+    if (buffer.fb_id) {
+        drm_manager_->destroyFramebuffer(buffer.fb_id);
+        buffer.fb_id = 0;
     }
+    if (buffer.bo) {
+        gbm_bo_destroy(buffer.bo);
+        buffer.bo = nullptr;
+    }
+    if (buffer.frame_buffer.dma_fd >= 0) {
+        close(buffer.frame_buffer.dma_fd);
+        buffer.frame_buffer.dma_fd = -1;
+    }
+    buffer.valid = false;
+}
+
+void FrameCopier::fillProfile(const OutputSlot& slot, DisplayProfile& profile) const {
+    profile.mode = slot.display.mode;
+    profile.requested_format = slot.requested_format;
+    profile.output_format = slot.cache_key.format;
+    profile.rotation_degrees = slot.settings.rotation_degrees;
+    profile.scale_mode = (int)slot.settings.scale_mode;
+    profile.plan_src_width = slot.plan.src_width;
+    profile.plan_src_height = slot.plan.src_height;
+    profile.plan_x = slot.plan.x;
+    profile.plan_y = slot.plan.y;
+    profile.plan_width = slot.plan.width;
+    profile.plan_height = slot.plan.height;
+    profile.mirror_rejected = slot.mirror.rejected;
+    profile.mirror_src_width = slot.mirror.rejected ? slot.mirror.src_w : 0;
+    profile.mirror_src_height = slot.mirror.rejected ? slot.mirror.src_h : 0;
+}
+
+void FrameCopier::releaseOutputSlot(OutputSlot* slot) {
+    // 显示器已被禁用，缓冲区不再被扫描输出；保留整个交换链供同一模式重新连接时使用
+    if (config_.swapchain_cache_size > 0 && !slot->swapchain.buffers().empty()) {
+        cacheSwapchain(slot->cache_key, std::move(slot->swapchain.buffers()));
+        LOG_INFO("Cached buffers for display {} ({}x{} {})", slot->display.name,
+                 slot->cache_key.width, slot->cache_key.height, outputFormatName(slot->cache_key.format));
+    } else {
+        for (auto& buffer : slot->swapchain.buffers()) {
+            releaseDisplayBuffer(buffer);
+        }
+        LOG_INFO("Destroyed buffers for display {}", slot->display.name);
+    }
+    delete slot;
+}
+
+bool FrameCopier::takeCachedSwapchain(const SwapchainKey& key, std::vector<GBMBuffer>& buffers) {
+    swapchain_cache_lookups_.fetch_add(1, std::memory_order_relaxed);
     
-    uint32_t connector_id = display->connector_id;
-    auto it = display_buffers_.find(connector_id);
-    
-    if (it != display_buffers_.end()) {
-        for (auto& buffer : it->second) {
-            if (buffer.fb_id) {
-                drm_manager_->destroyFramebuffer(buffer.fb_id);
-            }
-            if (buffer.bo) {
-                gbm_bo_destroy(buffer.bo);
-            }
-            if (buffer.frame_buffer.dma_fd >= 0) {
-                close(buffer.frame_buffer.dma_fd);
+    std::lock_guard<std::mutex> lock(swapchain_cache_mutex_);
+    for (auto it = swapchain_cache_.rbegin(); it != swapchain_cache_.rend(); ++it) {
+        if (it->key == key) {
+            buffers = std::move(it->buffers);
+            swapchain_cache_.erase(std::next(it).base());
+            for (auto& buffer : buffers) {
+                buffer.state = BufferState::FREE;
             }
+            swapchain_cache_hits_.fetch_add(1, std::memory_order_relaxed);
+            return true;
         }
-        
-        display_buffers_.erase(it);
-        current_buffer_index_.erase(connector_id);
-        
-        LOG_INFO("Destroyed buffers for display {}", display->name);
     }
+    return false;
 }
 
-GBMBuffer* FrameCopier::getCurrentBuffer(DisplayInfo* display) {
-    if (!display) {
-        return nullptr;
-    }
-    
-    uint32_t connector_id = display->connector_id;
-    auto it = display_buffers_.find(connector_id);
+void FrameCopier::cacheSwapchain(const SwapchainKey& key, std::vector<GBMBuffer> buffers) {
+    std::lock_guard<std::mutex> lock(swapchain_cache_mutex_);
+    swapchain_cache_.push_back({key, std::move(buffers)});
     
-    if (it == display_buffers_.end()) {
-        return nullptr;
+    // 超出上限时释放最早缓存的交换链
+    while (swapchain_cache_.size() > (size_t)config_.swapchain_cache_size) {
+        for (auto& buffer : swapchain_cache_.front().buffers) {
+            releaseDisplayBuffer(buffer);
+        }
+        swapchain_cache_.pop_front();
     }
-    
-    int index = current_buffer_index_[connector_id];
-    return &it->second[index];
 }
 
-GBMBuffer* FrameCopier::getNextBuffer(DisplayInfo* display) {
-    if (!display) {
-        return nullptr;
+void FrameCopier::flushSwapchainCache() {
+    std::lock_guard<std::mutex> lock(swapchain_cache_mutex_);
+    for (auto& entry : swapchain_cache_) {
+        for (auto& buffer : entry.buffers) {
+            releaseDisplayBuffer(buffer);
+        }
+    }
+    swapchain_cache_.clear();
+}
+
+bool FrameCopier::packToTarget(const uint32_t* src, uint32_t width, uint32_t height,
+                               GBMBuffer& target) {
+    FrameBuffer& fb = target.frame_buffer;
+    if (fb.dma_fd < 0) {
+        return false;
     }
     
-    uint32_t connector_id = display->connector_id;
-    auto it = display_buffers_.find(connector_id);
-    
-    if (it == display_buffers_.end()) {
-        LOG_WARN("No buffers found for {}, attempting to recreate...", display->name);
-        if (createBuffersForDisplay(display)) {
-            it = display_buffers_.find(connector_id);
-        } else {
-            return nullptr;
-        }
+    // 多plane格式通过dma-buf整体映射，gbm_bo_map只能映射第一个plane
+    void* addr = mmap(nullptr, fb.size, PROT_READ | PROT_WRITE, MAP_SHARED, fb.dma_fd, 0);
+    if (addr == MAP_FAILED) {
+        LOG_ERROR("Failed to map target buffer for CPU packing: {}", strerror(errno));
+        return false;
     }
     
-    int next_index = (current_buffer_index_[connector_id] + 1) % 2;
-    GBMBuffer* buffer = &it->second[next_index];
+    rga_helper_->beginCpuAccess(fb, true);
+    uint8_t* base = static_cast<uint8_t*>(addr);
     
-    // 检查缓冲区有效性
-    if (!buffer->valid || !buffer->bo || !buffer->fb_id) {
-        LOG_WARN("Invalid buffer for {}, attempting to recreate...", display->name);
-        destroyBuffersForDisplay(display);
-        if (createBuffersForDisplay(display)) {
-            it = display_buffers_.find(connector_id);
-            buffer = &it->second[next_index];
-        } else {
-            return nullptr;
+    if (fb.format == DRM_FORMAT_RGB565) {
+        for (uint32_t y = 0; y < height; y++) {
+            const uint32_t* s = &src[y * width];
+            uint16_t* d = reinterpret_cast<uint16_t*>(base + target.offsets[0] + y * target.pitches[0]);
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t p = s[x];
+                d[x] = (uint16_t)(((p >> 8) & 0xF800) | ((p >> 5) & 0x07E0) | ((p >> 3) & 0x001F));
+            }
+        }
+    } else if (fb.format == DRM_FORMAT_NV12) {
+        // BT.601 limited range，UV取2x2像素平均
+        uint8_t* y_plane = base + target.offsets[0];
+        uint8_t* uv_plane = base + target.offsets[1];
+        for (uint32_t y = 0; y < height; y += 2) {
+            const uint32_t* row0 = &src[y * width];
+            const uint32_t* row1 = &src[(y + 1) * width];
+            uint8_t* y0 = y_plane + y * target.pitches[0];
+            uint8_t* y1 = y0 + target.pitches[0];
+            uint8_t* uv = uv_plane + (y / 2) * target.pitches[1];
+            
+            for (uint32_t x = 0; x < width; x += 2) {
+                int r_sum = 0, g_sum = 0, b_sum = 0;
+                uint32_t quad[4] = {row0[x], row0[x + 1], row1[x], row1[x + 1]};
+                uint8_t* y_out[4] = {&y0[x], &y0[x + 1], &y1[x], &y1[x + 1]};
+                for (int i = 0; i < 4; i++) {
+                    int r = (quad[i] >> 16) & 0xFF;
+                    int g = (quad[i] >> 8) & 0xFF;
+                    int b = quad[i] & 0xFF;
+                    *y_out[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                    r_sum += r;
+                    g_sum += g;
+                    b_sum += b;
+                }
+                int r = r_sum / 4, g = g_sum / 4, b = b_sum / 4;
+                uv[x] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                uv[x + 1] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            }
         }
     }
     
-    return buffer;
+    rga_helper_->endCpuAccess(fb, true);
+    munmap(addr, fb.size);
+    return true;
 }
 
 void FrameCopier::calculateScaling(uint32_t src_width, uint32_t src_height,
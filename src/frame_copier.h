@@ -1,18 +1,22 @@
 #pragma once
 
 #include "drm_manager.h"
+#include "frame_governor.h"
+#include "frame_pool.h"
+#include "frame_trace.h"
+#include "realtime.h"
 #include "rga_helper.h"
+#include "stage_timing.h"
+#include "swapchain.h"
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <gbm.h>
 
-struct GBMBuffer {
-    struct gbm_bo* bo;
-    uint32_t fb_id;
-    FrameBuffer frame_buffer;
-    bool valid;
-};
-
 // 配置选项
 struct DisplayConfig {
     enum ScaleMode {
@@ -29,6 +33,131 @@ struct DisplayConfig {
     int rotation_degrees = 90;         // 旋转角度：0, 90, 180, 270
     Quality quality = QUALITY_GOOD;    // 默认使用好质量
     bool enable_debug = false;
+    
+    // 副显示器扫描输出格式：XRGB8888 / RGB565 / NV12，可按连接器名单独覆盖
+    uint32_t output_format = DRM_FORMAT_XRGB8888;
+    std::map<std::string, uint32_t> display_formats;
+    
+    // 按EDID缓存的显示器配置文件 (为空时不写磁盘)
+    std::string profile_cache = "/var/cache/rk3588-multi-display/display-profiles";
+    
+    // 每个显示器交换链的缓冲区数量 (2-8)
+    int swapchain_depth = 3;
+    
+    // 保留断开的显示器的交换链数量，以相同模式重新连接时不重新分配 (0为不保留)
+    int swapchain_cache_size = 2;
+    
+    // 零拷贝镜像：副显示器的plane直接扫描输出DSI的framebuffer (仅atomic，失败时回退复制)
+    bool zero_copy = false;
+    
+    // 硬件克隆：编码器允许且模式兼容时副显示器共享DSI的CRTC (仅rotation为0时)
+    bool hw_clone = true;
+    
+    // 快速启动：点亮副显示器之前捕获一帧DSI画面，第一次modeset直接显示镜像内容
+    // 并沿用固件留在CRTC上的兼容模式 (mode_selection.adopt_boot_mode)
+    bool fast_boot = true;
+    
+    // DRM设备与KMS后端 (vkms等虚拟设备可用于测量)
+    std::string drm_device = "/dev/dri/card0";
+    KmsBackend kms_backend = KmsBackend::AUTO;
+    
+    // 副显示器模式选择 (默认在预算内选择缩放工作量最小的模式)
+    ModeSelection mode_selection;
+    
+    // 捕获/呈现线程的实时调度、CPU绑定和内存锁定
+    RealtimeConfig realtime;
+    
+    // 根据内容变化、负载和温度自适应调节帧率和质量
+    GovernorConfig governor;
+    
+    // 逐帧跟踪 (Chrome trace JSON)
+    TraceConfig trace;
+    
+    // 本地控制套接字：Prometheus指标和运行时命令 (为空时不创建)
+    std::string control_socket = "/run/rk3588-multi-display/control.sock";
+    
+    // 配置文件 (config_file.h)，SIGHUP或控制命令reload时重新读取 (为空时不使用)
+    std::string config_file = "/etc/rk3588-multi-display.conf";
+    
+    uint32_t outputFormatFor(const std::string& connector_name) const {
+        auto it = display_formats.find(connector_name);
+        return it != display_formats.end() ? it->second : output_format;
+    }
+};
+
+// 输出格式工具函数
+bool parseOutputFormat(const std::string& name, uint32_t& format);
+const char* outputFormatName(uint32_t format);
+uint32_t frameBytesForFormat(uint32_t width, uint32_t height, uint32_t format);
+
+// 每个副显示器的翻转与交换链统计 (翻转间隔来自vblank时间戳)
+struct OutputStats {
+    uint64_t flips = 0;
+    uint64_t last_timestamp_us = 0;
+    uint64_t max_interval_us = 0;
+    IntervalJitter vblank_jitter;  // 每个报告周期重置
+    uint32_t submitted_fb = 0;     // 最近一次提交的fb和提交时间，用于翻转完成延迟
+    uint64_t submitted_us = 0;
+};
+
+// 零拷贝镜像状态
+struct MirrorState {
+    bool active = false;     // plane已配置为扫描输出主显示器的fb
+    std::atomic<bool> stale{false};  // 上一次翻转失败，需要重新配置plane (由呈现线程设置)
+    bool rejected = false;   // 驱动拒绝了当前源尺寸的配置
+    bool leaving = false;    // 已改走复制路径，plane保持镜像配置直到第一帧复制完成
+    uint32_t fb_id = 0;      // 最近一次提交的主显示器fb
+    uint32_t src_w = 0, src_h = 0;
+};
+
+// 预先计算的缩放参数，源尺寸变化时才重新计算
+struct TransformPlan {
+    uint32_t src_width = 0, src_height = 0;
+    uint32_t x = 0, y = 0, width = 0, height = 0;
+};
+
+// 每帧使用的变换参数：工作线程只在帧边界锁存，一帧之内不会混用新旧配置
+struct TransformSettings {
+    int rotation_degrees = 0;
+    DisplayConfig::ScaleMode scale_mode = DisplayConfig::SCALE_STRETCH;
+    DisplayConfig::Quality quality = DisplayConfig::QUALITY_GOOD;
+};
+
+// 交换链缓存的键：尺寸、格式、modifier和深度都相同的缓冲区可以直接复用
+struct SwapchainKey {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t format = 0;
+    uint64_t modifier = 0;
+    size_t depth = 0;
+    
+    bool operator==(const SwapchainKey& other) const {
+        return width == other.width && height == other.height && format == other.format &&
+               modifier == other.modifier && depth == other.depth;
+    }
+};
+
+// 每个走复制/镜像路径的副显示器的密集状态槽
+// 由重新配置线程创建，发布之后由该显示器的工作线程使用；最后一个引用释放时销毁缓冲区
+struct OutputSlot {
+    DisplayInfo display;
+    Swapchain swapchain;
+    SwapchainKey cache_key;        // 释放时按该键放入交换链缓存
+    uint32_t requested_format = 0; // 协商前请求的输出格式
+    uint32_t format_savings = 0;   // 低带宽格式每帧节省的字节数
+    TransformPlan plan;
+    TransformSettings settings;    // 当前帧使用的变换参数 (只由工作线程修改)
+    uint64_t settings_generation = 0;
+    MirrorState mirror;
+    OutputStats stats;
+    StageHistograms stages;        // 各阶段耗时 (工作线程、呈现线程和捕获线程写入，无锁)
+    std::atomic<bool> recalibrate{false};  // 运行时命令请求重新计算变换参数和镜像配置 (工作线程处理)
+    uint32_t scanout_track = 0;    // 逐帧跟踪中该显示器CRTC的vblank和翻转完成轨道
+    uint64_t frames = 0;
+    std::vector<uint32_t> cpu_scratch;  // CPU路径非XRGB格式的中间缓冲区
+    
+    // 翻转完成事件在捕获线程中处理，swapchain和stats的访问需要持有该锁
+    std::mutex mutex;
 };
 
 class FrameCopier {
@@ -39,35 +168,129 @@ public:
     bool initialize();
     void cleanup();
     
-    // 从主显示器获取当前帧
-    bool captureFrame(DisplayInfo* primary_display, FrameBuffer& frame);
+    // 从主显示器获取当前帧到捕获池中的空闲缓冲区 (只由捕获线程在主显示器的vblank事件之后调用)
+    // 所有缓冲区都还被工作线程持有时返回false，本帧被丢弃
+    bool captureFrame(const DisplayInfo* primary_display, FrameRef& frame);
+    
+    // 按显示器数量扩充捕获池 (只由捕获线程在切换拓扑时调用)
+    void reserveCaptureFrames(size_t output_count);
     
-    // 复制帧到目标显示器，并自适应分辨率
-    bool copyToDisplay(const FrameBuffer& source_frame, DisplayInfo* target_display);
+    // 将帧渲染到目标显示器交换链中的空闲缓冲区，并自适应分辨率 (可在多个工作线程中并行调用)
+    // 返回待翻转的framebuffer ID (没有空闲缓冲区或失败返回0)，提交翻转后调用onFlipSubmitted
+    uint32_t renderToDisplay(const FrameBuffer& source_frame, OutputSlot& slot);
+    void onFlipSubmitted(OutputSlot& slot, const PageFlipRequest& flip);
+    
+    // 渲染完成但被更新的帧取代、不会提交的帧，归还交换链
+    void discardFrame(OutputSlot& slot, uint32_t fb_id);
+    
+    // 零拷贝镜像：由显示硬件缩放/旋转主显示器的framebuffer，不经过RGA复制
+    // 返回false表示该显示器需要走复制路径；fb_id非0时需要翻转到主显示器的新帧
+    bool mirrorToDisplay(const DisplayInfo& primary_display, OutputSlot& slot, uint32_t& fb_id);
+    
+    // 翻转完成回调：释放不再被扫描输出的缓冲区
+    void onPageFlipComplete(OutputSlot& slot, const PageFlipEvent& event);
     
     // 配置管理
-    void setConfig(const DisplayConfig& config) { config_ = config; }
+    void setConfig(const DisplayConfig& config);
     const DisplayConfig& getConfig() const { return config_; }
     
-    // 为显示器创建缓冲区
-    bool createBuffersForDisplay(DisplayInfo* display);
-    void destroyBuffersForDisplay(DisplayInfo* display);
+    // 运行时修改旋转角度、缩放模式和质量 (控制套接字、配置重新加载)，三者一起发布，
+    // 各显示器的工作线程在下一帧开始时发现版本变化后通过applySettings锁存
+    void setSettings(const TransformSettings& settings);
+    TransformSettings currentSettings() const;
+    uint64_t settingsGeneration() const { return settings_generation_.load(std::memory_order_acquire); }
+    int getRotation() const { return rotation_degrees_.load(std::memory_order_relaxed); }
+    DisplayConfig::ScaleMode getScaleMode() const { return scale_mode_.load(std::memory_order_relaxed); }
+    DisplayConfig::Quality getQuality() const { return quality_.load(std::memory_order_relaxed); }
+    
+    // 锁存当前的变换参数；旋转或缩放模式变化时才丢弃该显示器的变换参数和镜像配置，
+    // 只改质量时下一帧直接使用，不重新计算 (由该显示器的工作线程调用)
+    void applySettings(OutputSlot& slot);
+    
+    // 丢弃缓存的变换参数和镜像校准结果，下一帧重新计算 (由该显示器的工作线程调用)
+    void resetCalibration(OutputSlot& slot);
+    
+    // 为显示器创建状态槽和交换链 (第一个缓冲区标记为扫描输出，供modeset使用)
+    // 优先复用缓存中相同模式的交换链 (BO、fb和dma-buf fd都保持有效)
+    // profile为该显示器EDID对应的缓存配置，用于跳过格式协商并预置变换参数
+    std::shared_ptr<OutputSlot> createOutputSlot(const DisplayInfo& display, const DisplayProfile* profile = nullptr);
     
-    // 获取当前缓冲区
-    GBMBuffer* getCurrentBuffer(DisplayInfo* display);
+    // 将显示器当前的格式、变换参数和镜像校准结果写入配置 (工作线程停止后调用)
+    void fillProfile(const OutputSlot& slot, DisplayProfile& profile) const;
+    
+    // 交换链缓存命中统计
+    uint64_t getSwapchainCacheHits() const { return swapchain_cache_hits_.load(std::memory_order_relaxed); }
+    uint64_t getSwapchainCacheLookups() const { return swapchain_cache_lookups_.load(std::memory_order_relaxed); }
+    
+    // 低带宽输出格式累计节省的扫描输出字节数
+    uint64_t getBytesSaved() const { return bytes_saved_total_.load(std::memory_order_relaxed); }
+    
+    // 调节器使用的各级耗时：最近一次捕获的复制耗时 (不含等待vblank) 和上次读取以来变换的峰值耗时
+    uint64_t getLastCaptureUs() const { return last_capture_us_; }
+    uint64_t takeTransformPeakUs() { return transform_peak_us_.exchange(0, std::memory_order_relaxed); }
+    
+    // 捕获各阶段 (等待vblank、映射、复制) 的耗时，只由捕获线程写入
+    StageHistograms& captureStages() { return capture_stages_; }
+    
+    // 累计捕获的帧数 (只由捕获线程读取)
+    uint64_t getCaptureCount() const { return capture_sequence_; }
+    
+    // 调节器在压力下临时改用QUALITY_FAST (工作线程在下一帧生效)
+    void setFastQuality(bool fast) { fast_quality_.store(fast, std::memory_order_relaxed); }
     
 private:
     std::shared_ptr<DRMManager> drm_manager_;
     std::shared_ptr<RGAHelper> rga_helper_;
     
     struct gbm_device* gbm_device_;
-    std::map<uint32_t, std::vector<GBMBuffer>> display_buffers_;  // connector_id -> buffers
-    std::map<uint32_t, int> current_buffer_index_;  // connector_id -> current buffer index
+    std::atomic<uint64_t> bytes_saved_total_;
     
     DisplayConfig config_;  // 显示配置
+    FramePool capture_pool_;      // 持久化的DSI捕获缓冲区 (dma-buf)，按引用计数回收
+    uint64_t capture_sequence_;
+    uint64_t last_content_hash_;
+    uint64_t unchanged_captures_;   // 连续内容未变化的捕获帧数
+    uint64_t fallback_captures_;    // 读取DSI framebuffer失败、使用测试图案的次数
+    bool capture_started_;
+    uint64_t last_capture_us_;
+    std::atomic<uint64_t> transform_peak_us_;
+    StageHistograms capture_stages_;
+    std::atomic<bool> fast_quality_;
+    std::atomic<int> rotation_degrees_;                  // 当前生效的旋转角度、缩放模式和质量，可在运行时修改
+    std::atomic<DisplayConfig::ScaleMode> scale_mode_;
+    std::atomic<DisplayConfig::Quality> quality_;
+    std::atomic<uint64_t> settings_generation_;         // 每次setSettings加一
+    
+    // 已断开显示器的交换链，最近释放的在后面；槽可能在工作线程中释放，需要加锁
+    struct CachedSwapchain {
+        SwapchainKey key;
+        std::vector<GBMBuffer> buffers;
+    };
+    std::mutex swapchain_cache_mutex_;
+    std::deque<CachedSwapchain> swapchain_cache_;
+    std::atomic<uint64_t> swapchain_cache_hits_;
+    std::atomic<uint64_t> swapchain_cache_lookups_;
+    
+    // 稀疏采样的内容哈希，用于检测画面是否变化
+    uint64_t contentHash(const FrameBuffer& frame);
     
     bool setupGBM();
-    GBMBuffer* getNextBuffer(DisplayInfo* display);
+    void releaseOutputSlot(OutputSlot* slot);
+    void leaveMirror(OutputSlot& slot);
+    void restoreFromMirror(OutputSlot& slot, GBMBuffer* buffer);
+    
+    // 输出格式协商与缓冲区分配
+    uint32_t negotiateOutputFormat(const DisplayInfo& display);
+    bool allocateDisplayBuffers(const DisplayInfo& display, uint32_t format, std::vector<GBMBuffer>& buffers);
+    void releaseDisplayBuffer(GBMBuffer& buffer);
+    
+    // 交换链缓存
+    bool takeCachedSwapchain(const SwapchainKey& key, std::vector<GBMBuffer>& buffers);
+    void cacheSwapchain(const SwapchainKey& key, std::vector<GBMBuffer> buffers);
+    void flushSwapchainCache();
+    
+    // CPU路径：将XRGB8888中间结果打包为RGB565/NV12
+    bool packToTarget(const uint32_t* src, uint32_t width, uint32_t height, GBMBuffer& target);
     
     // 计算最佳缩放参数
     void calculateScaling(uint32_t src_width, uint32_t src_height,
@@ -0,0 +1,193 @@
+#include "frame_governor.h"
+#include "logger.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <string>
+
+static const auto kWindow = std::chrono::milliseconds(500);
+static const auto kStaticHold = std::chrono::seconds(1);     // 内容静止多久之后开始降帧
+static const auto kThermalPeriod = std::chrono::seconds(2);
+static const int kRelaxedWindowsToRecover = 4;               // 约2秒无压力后恢复质量
+
+FrameGovernor::FrameGovernor()
+    : window_frames_(0), window_changed_(0), window_capture_us_(0),
+      relaxed_windows_(0), hot_(false) {
+    auto now = std::chrono::steady_clock::now();
+    window_start_ = now;
+    last_change_ = now;
+    last_thermal_read_ = now - kThermalPeriod;
+    metrics_.fps = config_.max_fps;
+    readCpufreqMax(cpufreq_baseline_);
+}
+
+void FrameGovernor::setConfig(const GovernorConfig& config) {
+    config_ = config;
+    config_.max_fps = std::max(config_.max_fps, 1);
+    config_.min_fps = std::clamp(config_.min_fps, 1, config_.max_fps);
+    metrics_.fps = config_.max_fps;
+    metrics_.fast_quality = false;
+}
+
+bool FrameGovernor::onCapture(bool changed, uint64_t capture_us) {
+    window_frames_++;
+    window_capture_us_ = std::max(window_capture_us_, capture_us);
+    if (!changed) {
+        return false;
+    }
+    
+    window_changed_++;
+    last_change_ = std::chrono::steady_clock::now();
+    
+    // 降帧期间内容变化时不等评估窗口结束，立即恢复帧率
+    int fps_cap = fpsCap();
+    if (config_.enabled && metrics_.fps < fps_cap) {
+        setFps(fps_cap, hot_ ? "motion, thermal cap" : "motion");
+        return true;
+    }
+    return false;
+}
+
+int FrameGovernor::fpsCap() const {
+    return hot_ ? std::max(config_.max_fps / 2, config_.min_fps) : config_.max_fps;
+}
+
+bool FrameGovernor::windowElapsed() const {
+    return std::chrono::steady_clock::now() - window_start_ >= kWindow;
+}
+
+bool FrameGovernor::update(uint64_t transform_us) {
+    auto now = std::chrono::steady_clock::now();
+    uint64_t decisions = metrics_.decisions;
+
+    metrics_.change_ratio = window_frames_ ? (double)window_changed_ / window_frames_ : 0.0;
+    metrics_.capture_us = window_capture_us_;
+    metrics_.transform_us = transform_us;
+
+    if (now - last_thermal_read_ >= kThermalPeriod) {
+        readThermal();
+        last_thermal_read_ = now;
+    }
+
+    if (config_.enabled) {
+        // 温度滞后：超过上限后直到低于恢复温度才解除
+        if (!hot_ && metrics_.temperature_c >= config_.thermal_limit_c) {
+            hot_ = true;
+        } else if (hot_ && metrics_.temperature_c < config_.thermal_resume_c) {
+            hot_ = false;
+        }
+        int fps_cap = fpsCap();
+
+        // 帧率：有变化立即恢复，静止超过kStaticHold后每个窗口减半
+        // 没有捕获 (全部为零拷贝镜像) 时无法判断内容变化，保持节拍以跟随主显示器的翻转
+        if (window_changed_ > 0) {
+            setFps(fps_cap, hot_ ? "motion, thermal cap" : "motion");
+        } else if (window_frames_ == 0) {
+            setFps(fps_cap, "no captures");
+        } else if (now - last_change_ >= kStaticHold && metrics_.fps > config_.min_fps) {
+            setFps(std::max(config_.min_fps, metrics_.fps / 2), "static content");
+        }
+        if (metrics_.fps > fps_cap) {
+            setFps(fps_cap, "thermal");
+        }
+
+        // 质量：温度、限频或任一级耗时接近帧预算时改用快速质量
+        uint64_t budget_us = 1000000 / std::max(metrics_.fps, 1);
+        uint64_t stage_us = std::max(metrics_.capture_us, metrics_.transform_us);
+        if (hot_ || metrics_.cpufreq_throttled || stage_us > budget_us * 8 / 10) {
+            relaxed_windows_ = 0;
+            setFastQuality(true, hot_ ? "thermal" : metrics_.cpufreq_throttled ? "cpufreq throttled"
+                                                  : "stage time " + std::to_string(stage_us) + " us");
+        } else if (stage_us < budget_us / 2 && ++relaxed_windows_ >= kRelaxedWindowsToRecover) {
+            setFastQuality(false, "load relieved");
+        }
+    } else if (metrics_.fps != config_.max_fps) {
+        setFps(config_.max_fps, "governor disabled");
+    }
+
+    window_start_ = now;
+    window_frames_ = 0;
+    window_changed_ = 0;
+    window_capture_us_ = 0;
+    return metrics_.decisions != decisions;
+}
+
+std::chrono::microseconds FrameGovernor::frameInterval() const {
+    return std::chrono::microseconds(1000000 / std::max(metrics_.fps, 1));
+}
+
+void FrameGovernor::readThermal() {
+    // 所有thermal zone中的最高温度 (毫摄氏度)
+    int max_temp = 0;
+    if (DIR* dir = opendir("/sys/class/thermal")) {
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 12, "thermal_zone") != 0) {
+                continue;
+            }
+            std::ifstream file("/sys/class/thermal/" + name + "/temp");
+            int millidegrees = 0;
+            if (file >> millidegrees) {
+                max_temp = std::max(max_temp, millidegrees / 1000);
+            }
+        }
+        closedir(dir);
+    }
+    metrics_.temperature_c = max_temp;
+
+    // cpufreq冷却设备通过降低scaling_max_freq限频，与启动时的值比较 (部分板子的默认策略本来就低于cpuinfo_max_freq)
+    std::map<std::string, uint64_t> max_freqs;
+    bool throttled = false;
+    if (readCpufreqMax(max_freqs)) {
+        for (const auto& [policy, max_freq] : max_freqs) {
+            uint64_t& baseline = cpufreq_baseline_[policy];
+            if (max_freq < baseline) {
+                throttled = true;
+            }
+            // 启动时已经被限频的policy在解除后提高基准
+            baseline = std::max(baseline, max_freq);
+        }
+    }
+    metrics_.cpufreq_throttled = throttled;
+}
+
+bool FrameGovernor::readCpufreqMax(std::map<std::string, uint64_t>& max_freqs) const {
+    DIR* dir = opendir("/sys/devices/system/cpu/cpufreq");
+    if (!dir) {
+        return false;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.compare(0, 6, "policy") != 0) {
+            continue;
+        }
+        std::ifstream max_file("/sys/devices/system/cpu/cpufreq/" + name + "/scaling_max_freq");
+        uint64_t max_freq = 0;
+        if (max_file >> max_freq) {
+            max_freqs[name] = max_freq;
+        }
+    }
+    closedir(dir);
+    return true;
+}
+
+void FrameGovernor::setFps(int fps, const char* reason) {
+    if (fps == metrics_.fps) {
+        return;
+    }
+    LOG_INFO("Governor: {} -> {} FPS ({}, change ratio {:.2f}, {}°C)",
+             metrics_.fps, fps, reason, metrics_.change_ratio, metrics_.temperature_c);
+    metrics_.fps = fps;
+    metrics_.decisions++;
+}
+
+void FrameGovernor::setFastQuality(bool fast, const std::string& reason) {
+    if (fast == metrics_.fast_quality) {
+        return;
+    }
+    LOG_INFO("Governor: quality -> {} ({}, capture {} us, transform {} us, {}°C)",
+             fast ? "fast" : "configured", reason, metrics_.capture_us, metrics_.transform_us,
+             metrics_.temperature_c);
+    metrics_.fast_quality = fast;
+    metrics_.decisions++;
+}
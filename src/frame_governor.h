@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+// 自适应帧率/质量调节器配置
+struct GovernorConfig {
+    bool enabled = true;
+    int max_fps = 60;
+    int min_fps = 10;               // 内容静止时降到的最低帧率
+    int thermal_limit_c = 85;       // 超过该温度时降低质量并限制帧率
+    int thermal_resume_c = 75;      // 低于该温度时恢复
+};
+
+// 调节器的当前状态，随帧率统计一起报告
+struct GovernorMetrics {
+    int fps = 0;
+    bool fast_quality = false;      // 压力下切换到QUALITY_FAST
+    int temperature_c = 0;
+    bool cpufreq_throttled = false;
+    double change_ratio = 0.0;      // 最近一个窗口中内容变化的帧比例
+    uint64_t capture_us = 0;        // 最近一个窗口中各级的峰值耗时
+    uint64_t transform_us = 0;
+    uint64_t decisions = 0;
+};
+
+// 根据内容变化率、各级耗时、温度和cpufreq调节捕获帧率和缩放质量 (只由捕获线程调用)
+// 内容静止时逐级降低帧率，检测到变化立即恢复；温度过高、CPU被限频或耗时接近帧预算时改用快速质量
+class FrameGovernor {
+public:
+    FrameGovernor();
+
+    void setConfig(const GovernorConfig& config);
+
+    // 每次捕获后调用，内容变化使帧率立即恢复时返回true (调用方需要按新的帧间隔重新设置节拍)
+    bool onCapture(bool changed, uint64_t capture_us);
+
+    // 评估窗口 (500ms) 结束时调用update，transform_us为该窗口内变换级的峰值耗时
+    // 决策变化时返回true
+    bool windowElapsed() const;
+    bool update(uint64_t transform_us);
+
+    std::chrono::microseconds frameInterval() const;
+    bool useFastQuality() const { return metrics_.fast_quality; }
+    const GovernorMetrics& metrics() const { return metrics_; }
+
+private:
+    GovernorConfig config_;
+    GovernorMetrics metrics_;
+
+    std::chrono::steady_clock::time_point window_start_;
+    std::chrono::steady_clock::time_point last_change_;
+    std::chrono::steady_clock::time_point last_thermal_read_;
+    uint64_t window_frames_;
+    uint64_t window_changed_;
+    uint64_t window_capture_us_;
+    int relaxed_windows_;           // 连续无压力的窗口数，用于恢复质量的滞后
+    bool hot_;                      // 温度滞后状态：超过上限后直到低于恢复温度
+    std::map<std::string, uint64_t> cpufreq_baseline_;  // 各policy启动时的scaling_max_freq (默认策略可能本来就低于硬件上限)
+
+    int fpsCap() const;
+
+    void readThermal();
+    bool readCpufreqMax(std::map<std::string, uint64_t>& max_freqs) const;
+    void setFps(int fps, const char* reason);
+    void setFastQuality(bool fast, const std::string& reason);
+};
@@ -0,0 +1,73 @@
+#include "frame_pool.h"
+#include <cstring>
+
+FrameRef::FrameRef(const FrameRef& other) : frame_(other.frame_) {
+    if (frame_) {
+        frame_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameRef::FrameRef(FrameRef&& other) noexcept : frame_(other.frame_) {
+    other.frame_ = nullptr;
+}
+
+FrameRef& FrameRef::operator=(const FrameRef& other) {
+    if (this != &other) {
+        reset();
+        frame_ = other.frame_;
+        if (frame_) {
+            frame_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return *this;
+}
+
+FrameRef& FrameRef::operator=(FrameRef&& other) noexcept {
+    if (this != &other) {
+        reset();
+        frame_ = other.frame_;
+        other.frame_ = nullptr;
+    }
+    return *this;
+}
+
+FrameRef::~FrameRef() {
+    reset();
+}
+
+FrameRef FrameRef::adopt(CapturedFrame* frame) {
+    FrameRef ref;
+    ref.frame_ = frame;
+    return ref;
+}
+
+void FrameRef::reset() {
+    if (frame_) {
+        // release：消费者对缓冲区的读取必须在捕获线程重新写入之前完成
+        frame_->refs.fetch_sub(1, std::memory_order_release);
+        frame_ = nullptr;
+    }
+}
+
+FramePool::FramePool(size_t size) {
+    reserve(size);
+}
+
+void FramePool::reserve(size_t size) {
+    while (frames_.size() < size) {
+        auto frame = std::make_unique<CapturedFrame>();
+        memset(&frame->buffer, 0, sizeof(frame->buffer));
+        frame->buffer.dma_fd = -1;
+        frames_.push_back(std::move(frame));
+    }
+}
+
+FrameRef FramePool::acquire() {
+    for (auto& frame : frames_) {
+        int expected = 0;
+        if (frame->refs.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+            return FrameRef::adopt(frame.get());
+        }
+    }
+    return FrameRef();
+}
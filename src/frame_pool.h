@@ -0,0 +1,52 @@
+#pragma once
+
+#include "rga_helper.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// 引用计数的捕获帧：所有消费者释放之后缓冲区才会被下一次捕获重用
+struct CapturedFrame {
+    FrameBuffer buffer;
+    uint64_t sequence = 0;
+    bool changed = true;            // 内容与上一次捕获不同 (稀疏采样比较)
+    std::atomic<int> refs{0};
+};
+
+// 持有一个捕获帧的引用，析构时释放 (可以在任意线程中释放)
+class FrameRef {
+public:
+    FrameRef() = default;
+    FrameRef(const FrameRef& other);
+    FrameRef(FrameRef&& other) noexcept;
+    FrameRef& operator=(const FrameRef& other);
+    FrameRef& operator=(FrameRef&& other) noexcept;
+    ~FrameRef();
+
+    // 接管一个已经加过引用的帧
+    static FrameRef adopt(CapturedFrame* frame);
+
+    void reset();
+    explicit operator bool() const { return frame_ != nullptr; }
+    CapturedFrame* get() const { return frame_; }
+    const FrameBuffer& buffer() const { return frame_->buffer; }
+
+private:
+    CapturedFrame* frame_ = nullptr;
+};
+
+// 捕获缓冲区，只由捕获线程获取和扩充，消费者通过FrameRef归还
+class FramePool {
+public:
+    explicit FramePool(size_t size);
+
+    // 取一个没有被任何消费者持有的帧，全部被占用时返回空引用
+    FrameRef acquire();
+    // 扩充到至少size个帧 (只由捕获线程调用，已有的帧地址不变，不会缩小)
+    void reserve(size_t size);
+    std::vector<std::unique_ptr<CapturedFrame>>& frames() { return frames_; }
+
+private:
+    std::vector<std::unique_ptr<CapturedFrame>> frames_;
+};
@@ -0,0 +1,220 @@
+#include "frame_trace.h"
+#include "logger.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+bool FrameTrace::enabled_ = false;
+std::atomic<bool> FrameTrace::active_{false};
+std::atomic<uint64_t> FrameTrace::head_{0};
+std::atomic<uint64_t> FrameTrace::window_start_{0};
+FrameTrace::Clock::time_point FrameTrace::window_begin_;
+FrameTrace::Clock::time_point FrameTrace::window_end_;
+std::unique_ptr<FrameTrace::Slot[]> FrameTrace::ring_;
+size_t FrameTrace::mask_ = 0;
+std::mutex FrameTrace::tracks_mutex_;
+std::vector<std::string> FrameTrace::tracks_{"Pipeline"};
+
+static void writeJsonString(FILE* file, const std::string& text) {
+    fputc('"', file);
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+            fputc(c, file);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// 纳秒转为Chrome trace使用的微秒 (保留三位小数)
+static void writeMicros(FILE* file, int64_t ns) {
+    if (ns < 0) {
+        fputc('-', file);
+        ns = -ns;
+    }
+    fprintf(file, "%" PRId64 ".%03d", ns / 1000, (int)(ns % 1000));
+}
+
+bool FrameTrace::initialize(const TraceConfig& config) {
+    if (config.file.empty() || config.events == 0) {
+        return false;
+    }
+
+    size_t capacity = 1;
+    while (capacity < config.events) {
+        capacity <<= 1;
+    }
+    ring_.reset(new Slot[capacity]);
+    mask_ = capacity - 1;
+    enabled_ = true;
+
+    LOG_INFO("Frame tracing: {} event ring buffer ({} KB), output {}", capacity,
+             capacity * sizeof(Slot) / 1024, config.file);
+    return true;
+}
+
+void FrameTrace::cleanup() {
+    active_.store(false, std::memory_order_relaxed);
+    enabled_ = false;
+}
+
+void FrameTrace::start() {
+    if (!enabled_) {
+        return;
+    }
+    window_start_.store(head_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    window_begin_ = Clock::now();
+    window_end_ = Clock::time_point();
+    active_.store(true, std::memory_order_release);
+    LOG_INFO("Frame tracing started");
+}
+
+void FrameTrace::stop() {
+    if (active_.exchange(false, std::memory_order_acq_rel)) {
+        window_end_ = Clock::now();
+        LOG_INFO("Frame tracing stopped");
+    }
+}
+
+uint32_t FrameTrace::track(const std::string& name) {
+    std::lock_guard<std::mutex> lock(tracks_mutex_);
+    for (size_t i = 0; i < tracks_.size(); i++) {
+        if (tracks_[i] == name) {
+            return i;
+        }
+    }
+    tracks_.push_back(name);
+    return tracks_.size() - 1;
+}
+
+void FrameTrace::record(uint32_t track, const char* name, char phase, Clock::time_point time,
+                        Clock::duration duration, uint64_t arg) {
+    uint64_t position = head_.fetch_add(1, std::memory_order_relaxed);
+    writeSlot(ring_[position & mask_], position, track, name, phase, time, duration, arg);
+}
+
+void FrameTrace::writeSlot(Slot& slot, uint64_t position, uint32_t track, const char* name, char phase,
+                           Clock::time_point time, Clock::duration duration, uint64_t arg) {
+    // 奇数序号表示正在写入
+    slot.sequence.store(position * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event.ts_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    slot.event.dur_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    slot.event.name = name;
+    slot.event.arg = arg;
+    slot.event.track = track;
+    slot.event.phase = phase;
+    slot.sequence.store(position * 2 + 2, std::memory_order_release);
+}
+
+double FrameTrace::measureRecordNs() {
+    // 在私有的小缓冲区上重复record的操作 (取时间戳、fetch_add、写槽)，不影响正在记录的窗口
+    static const int kIterations = 100000;
+    std::unique_ptr<Slot[]> slots(new Slot[64]);
+    std::atomic<uint64_t> head{0};
+    auto begin = Clock::now();
+    for (int i = 0; i < kIterations; i++) {
+        Clock::time_point now = Clock::now();
+        uint64_t position = head.fetch_add(1, std::memory_order_relaxed);
+        writeSlot(slots[position & 63], position, 0, "calibration", 'i', now, Clock::duration::zero(), i);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+    return (double)elapsed / kIterations;
+}
+
+long FrameTrace::dump(const std::string& path) {
+    if (!enabled_) {
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t first = window_start_.load(std::memory_order_relaxed);
+    uint64_t capacity = mask_ + 1;
+    uint64_t overwritten = 0;
+    if (head - first > capacity) {
+        overwritten = head - first - capacity;
+        first = head - capacity;
+    }
+
+    // 先复制出完整的事件，正在写入或已被覆盖的事件跳过
+    std::vector<Event> events;
+    events.reserve(head - first);
+    for (uint64_t position = first; position < head; position++) {
+        Slot& slot = ring_[position & mask_];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        Event event = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+        if (before == position * 2 + 2 && after == before) {
+            events.push_back(event);
+        }
+    }
+
+    std::vector<std::string> tracks;
+    {
+        std::lock_guard<std::mutex> lock(tracks_mutex_);
+        tracks = tracks_;
+    }
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        LOG_ERROR("Failed to write frame trace {}: {}", path, strerror(errno));
+        return -1;
+    }
+
+    int pid = getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rk3588_multi_display\"}}", pid);
+    for (size_t i = 0; i < tracks.size(); i++) {
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%zu,\"args\":{\"name\":", pid, i);
+        writeJsonString(file, tracks[i]);
+        fprintf(file, "}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%zu,\"args\":{\"sort_index\":%zu}}",
+                pid, i, i);
+    }
+    for (const Event& event : events) {
+        fprintf(file, ",\n{\"name\":");
+        writeJsonString(file, event.name);
+        fprintf(file, ",\"ph\":\"%c\",\"pid\":%d,\"tid\":%u,\"ts\":", event.phase, pid, event.track);
+        writeMicros(file, event.ts_ns);
+        if (event.phase == 'X') {
+            fprintf(file, ",\"dur\":");
+            writeMicros(file, event.dur_ns);
+        } else {
+            fprintf(file, ",\"s\":\"t\"");
+        }
+        if (event.arg) {
+            fprintf(file, ",\"args\":{\"frame\":%" PRIu64 "}", event.arg);
+        }
+        fputc('}', file);
+    }
+    fprintf(file, "\n]}\n");
+
+    bool ok = (fflush(file) == 0);
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) {
+        LOG_ERROR("Failed to write frame trace {}", path);
+        return -1;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    LOG_INFO("Frame trace written to {}: {} events, {} overwritten by the ring buffer ({} ms)",
+             path, events.size(), overwritten, elapsed.count());
+    
+    // 记录开销 = 事件速率 × 每个事件的写入耗时，占一个CPU的比例
+    Clock::time_point window_end = active() || window_end_ == Clock::time_point() ? start : window_end_;
+    double seconds = std::chrono::duration<double>(window_end - window_begin_).count();
+    if (seconds > 0) {
+        double events_per_second = (head - window_start_.load(std::memory_order_relaxed)) / seconds;
+        double record_ns = measureRecordNs();
+        LOG_INFO("Frame trace cost: {:.0f} events/s over {:.1f} s, {:.1f} ns per event, {:.4f}% of one CPU",
+                 events_per_second, seconds, record_ns, events_per_second * record_ns / 1e7);
+    }
+    return events.size();
+}
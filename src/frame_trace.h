@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 逐帧跟踪的配置
+struct TraceConfig {
+    std::string file;            // Chrome trace JSON输出文件 (为空时不跟踪)
+    bool on_signal = false;      // 启动时不记录，由SIGUSR2 (或控制命令trace) 开始/结束一个窗口
+    size_t events = 1 << 16;     // 环形缓冲区容量 (事件数)，向上取2的幂，满后覆盖最旧的事件
+};
+
+// 流水线各阶段的逐帧跟踪，输出为Chrome trace JSON (可在Perfetto/chrome://tracing中打开)
+// 事件写入固定大小的无锁环形缓冲区：未启用时只有一次relaxed原子读，启用时每个事件一次fetch_add和几次存储
+// 时间戳使用steady_clock (CLOCK_MONOTONIC)，与DRM的vblank时间戳可比
+class FrameTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static bool initialize(const TraceConfig& config);
+    static void cleanup();
+
+    // 开始记录一个新窗口 (不清空缓冲区，只把窗口起点移到当前位置，dump只写出起点之后的事件) / 停止记录
+    // stop之后可以调用dump
+    static void start();
+    static void stop();
+    static bool active() { return active_.load(std::memory_order_relaxed); }
+    static bool enabled() { return enabled_; }
+
+    // 注册一条轨道 (Perfetto中显示为一个线程)，同名返回同一个ID；不在逐帧路径上调用
+    static uint32_t track(const std::string& name);
+
+    // name必须是字符串字面量；arg非0时作为帧序号输出
+    static void span(uint32_t track, const char* name, Clock::time_point start, Clock::time_point end,
+                     uint64_t arg = 0) {
+        if (active()) {
+            record(track, name, 'X', start, end - start, arg);
+        }
+    }
+    static void instant(uint32_t track, const char* name, Clock::time_point time, uint64_t arg = 0) {
+        if (active()) {
+            record(track, name, 'i', time, Clock::duration::zero(), arg);
+        }
+    }
+
+    // 写出缓冲区中的事件，返回写出的事件数 (失败返回-1)
+    // 同时输出本窗口的记录开销：事件速率和实测的每个事件写入耗时
+    static long dump(const std::string& path);
+
+private:
+    struct Event {
+        int64_t ts_ns;
+        int64_t dur_ns;
+        const char* name;
+        uint64_t arg;
+        uint32_t track;
+        char phase;
+    };
+
+    // 每个槽带序号 (seqlock)：读取时跳过正在写入或已被覆盖的事件
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        Event event;
+    };
+
+    static bool enabled_;
+    static std::atomic<bool> active_;
+    static std::atomic<uint64_t> head_;
+    static std::atomic<uint64_t> window_start_;  // 当前窗口的起始位置 (位置只增不减，不复用旧槽的序号)
+    static Clock::time_point window_begin_;      // 当前窗口开始/结束的时间 (只由开始/停止跟踪的线程访问)
+    static Clock::time_point window_end_;
+    static std::unique_ptr<Slot[]> ring_;
+    static size_t mask_;
+    static std::mutex tracks_mutex_;
+    static std::vector<std::string> tracks_;
+
+    static void record(uint32_t track, const char* name, char phase, Clock::time_point time,
+                       Clock::duration duration, uint64_t arg);
+    static void writeSlot(Slot& slot, uint64_t position, uint32_t track, const char* name, char phase,
+                          Clock::time_point time, Clock::duration duration, uint64_t arg);
+    static double measureRecordNs();
+};
+
+// 作用域跟踪区间：析构时写入，未启用跟踪时不读时钟
+class ScopedTraceSpan {
+public:
+    ScopedTraceSpan(uint32_t track, const char* name)
+        : track_(track), name_(name), arg_(0), traced_(FrameTrace::active()) {
+        if (traced_) {
+            start_ = FrameTrace::Clock::now();
+        }
+    }
+    ~ScopedTraceSpan() {
+        if (traced_) {
+            FrameTrace::span(track_, name_, start_, FrameTrace::Clock::now(), arg_);
+        }
+    }
+
+    ScopedTraceSpan(const ScopedTraceSpan&) = delete;
+    ScopedTraceSpan& operator=(const ScopedTraceSpan&) = delete;
+
+    void setFrame(uint64_t frame) { arg_ = frame; }
+
+private:
+    uint32_t track_;
+    const char* name_;
+    uint64_t arg_;
+    bool traced_;
+    FrameTrace::Clock::time_point start_;
+};
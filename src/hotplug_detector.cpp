@@ -1,20 +1,34 @@
 #include "hotplug_detector.h"
 #include "logger.h"
-#include <poll.h>
+#include "drm_manager.h"
 #include <iostream>
 #include <cstring>
-#include <fstream>
-#include <map>
+#include <cstdlib>
+#include <errno.h>
+#include <set>
+#include <sys/stat.h>
+#include <vector>
 
 HotplugDetector::HotplugDetector()
-    : running_(false), udev_(nullptr), monitor_(nullptr), monitor_fd_(-1) {
+    : running_(false), udev_(nullptr), monitor_(nullptr), monitor_fd_(-1),
+      drm_fd_(-1), drm_devnum_(0) {
 }
 
 HotplugDetector::~HotplugDetector() {
     cleanup();
 }
 
-bool HotplugDetector::initialize() {
+bool HotplugDetector::initialize(int drm_fd, const std::string& card_name) {
+    // 通过设备号识别本设备节点的事件
+    struct stat drm_stat;
+    if (fstat(drm_fd, &drm_stat) != 0) {
+        LOG_ERROR("Failed to stat DRM device: {}", strerror(errno));
+        return false;
+    }
+    drm_fd_ = drm_fd;
+    drm_devnum_ = drm_stat.st_rdev;
+    card_name_ = card_name;
+    
     // 初始化udev
     udev_ = udev_new();
     if (!udev_) {
@@ -55,7 +69,10 @@ bool HotplugDetector::initialize() {
         return false;
     }
     
-    LOG_INFO("Hotplug detector initialized successfully");
+    // 记录所有连接器的初始状态 (DRM管理器启动时已完成探测)
+    probeAllConnectors(false);
+    
+    LOG_INFO("Hotplug detector initialized successfully ({} connectors on {})", connectors_.size(), card_name_);
     return true;
 }
 
@@ -73,6 +90,7 @@ void HotplugDetector::cleanup() {
     }
     
     monitor_fd_ = -1;
+    connectors_.clear();
 }
 
 void HotplugDetector::setCallback(HotplugCallback callback) {
@@ -85,8 +103,6 @@ void HotplugDetector::start() {
     }
     
     running_ = true;
-    monitor_thread_ = std::thread(&HotplugDetector::monitorLoop, this);
-    
     LOG_INFO("Hotplug monitoring started");
 }
 
@@ -96,169 +112,120 @@ void HotplugDetector::stop() {
     }
     
     running_ = false;
-    
-    if (monitor_thread_.joinable()) {
-        monitor_thread_.join();
-    }
-    
     LOG_INFO("Hotplug monitoring stopped");
 }
 
-void HotplugDetector::monitorLoop() {
-    struct pollfd pfd;
-    pfd.fd = monitor_fd_;
-    pfd.events = POLLIN;
-    
-    while (running_) {
-        // 等待事件，超时时间1秒
-        int ret = poll(&pfd, 1, 1000);
-        
-        if (ret < 0) {
-            if (errno != EINTR) {
-                LOG_ERROR("Poll error: {}", strerror(errno));
-                break;
-            }
-            continue;
-        }
-        
-        if (ret == 0) {
-            // 超时，继续循环
-            continue;
-        }
-        
-        if (pfd.revents & POLLIN) {
-            // 有事件到达
-            struct udev_device* device = udev_monitor_receive_device(monitor_);
-            if (device) {
-                processUdevDevice(device);
-                udev_device_unref(device);
-            }
+bool HotplugDetector::processEvents() {
+    // 监视器fd为非阻塞，读完所有排队的事件
+    bool received = false;
+    while (struct udev_device* device = udev_monitor_receive_device(monitor_)) {
+        received = true;
+        if (running_) {
+            processUdevDevice(device);
         }
+        udev_device_unref(device);
     }
+    return received;
 }
 
 void HotplugDetector::processUdevDevice(struct udev_device* device) {
     const char* action = udev_device_get_action(device);
     const char* subsystem = udev_device_get_subsystem(device);
-    const char* syspath = udev_device_get_syspath(device);
     
-    if (!action || !subsystem || !syspath) {
+    if (!action || !subsystem) {
         return;
     }
     
-    // 检查是否是DRM子系统的change事件
-    if (strcmp(subsystem, "drm") != 0 || strcmp(action, "change") != 0) {
+    // 只处理本设备节点的DRM热插拔change事件 (按设备号匹配，不依赖card编号)
+    if (strcmp(subsystem, "drm") != 0 || strcmp(action, "change") != 0 ||
+        udev_device_get_devnum(device) != drm_devnum_) {
         return;
     }
     
-    // 检查是否是card0的事件
-    std::string path = syspath;
-    if (path.find("/drm/card0") == std::string::npos) {
+    const char* hotplug = udev_device_get_property_value(device, "HOTPLUG");
+    if (!hotplug || strcmp(hotplug, "1") != 0) {
         return;
     }
     
-    LOG_DEBUG("DRM change event detected for card0, checking all connectors...");
-    
-    // 当检测到card0变化时，检查所有连接器状态
-    checkAllConnectors();
+    // 较新的内核在事件中带有CONNECTOR属性，只需重新读取该连接器；否则读取所有连接器
+    // 两种情况都只读取内核已经探测到的状态 (GetConnectorCurrent)，不触发强制探测
+    const char* connector = udev_device_get_property_value(device, "CONNECTOR");
+    if (connector) {
+        LOG_DEBUG("DRM hotplug event for connector {}", connector);
+        probeConnector((uint32_t)strtoul(connector, nullptr, 10), true);
+    } else {
+        LOG_DEBUG("DRM hotplug event for {}, checking all connectors...", card_name_);
+        probeAllConnectors(true);
+    }
 }
 
-void HotplugDetector::checkAllConnectors() {
-    // 存储当前状态用于比较
-    static std::map<std::string, bool> previous_states;
-    
-    // 检查HDMI连接器
-    std::string hdmi_path = "/sys/class/drm/card0-HDMI-A-1";
-    std::string hdmi_status_file = hdmi_path + "/status";
-    
-    std::ifstream hdmi_file(hdmi_status_file);
-    if (hdmi_file.is_open()) {
-        std::string status;
-        std::getline(hdmi_file, status);
-        hdmi_file.close();
-        
-        bool connected = (status == "connected");
-        bool prev_connected = previous_states["HDMI"];
-        
-        if (connected != prev_connected) {
-            LOG_INFO("HDMI hotplug detected: card0-HDMI-A-1 -> {}", status);
-            previous_states["HDMI"] = connected;
-            
-            if (callback_) {
-                callback_("card0-HDMI-A-1", connected ? HotplugEvent::CONNECTED : HotplugEvent::DISCONNECTED);
-            }
-        }
-    }
-    
-    // 检查DisplayPort连接器
-    std::string dp_path = "/sys/class/drm/card0-DP-1";
-    std::string dp_status_file = dp_path + "/status";
-    
-    std::ifstream dp_file(dp_status_file);
-    if (dp_file.is_open()) {
-        std::string status;
-        std::getline(dp_file, status);
-        dp_file.close();
-        
-        bool connected = (status == "connected");
-        bool prev_connected = previous_states["DP"];
-        
-        if (connected != prev_connected) {
-            LOG_INFO("DisplayPort hotplug detected: card0-DP-1 -> {}", status);
-            previous_states["DP"] = connected;
-            
-            if (callback_) {
-                callback_("card0-DP-1", connected ? HotplugEvent::CONNECTED : HotplugEvent::DISCONNECTED);
-            }
-        }
+void HotplugDetector::probeConnector(uint32_t connector_id, bool notify) {
+    drmModeConnector* connector = drmModeGetConnectorCurrent(drm_fd_, connector_id);
+    updateConnector(connector_id, connector, notify);
+    if (connector) {
+        drmModeFreeConnector(connector);
     }
 }
 
-std::string HotplugDetector::getConnectorNameFromSysPath(const char* syspath) {
-    if (!syspath) {
-        return "";
+void HotplugDetector::probeAllConnectors(bool notify) {
+    // 连接器可能出现或消失 (DP MST)，每次重新获取列表
+    drmModeRes* resources = drmModeGetResources(drm_fd_);
+    if (!resources) {
+        LOG_WARN("Failed to get DRM resources for hotplug probing");
+        return;
     }
     
-    std::string path = syspath;
+    std::set<uint32_t> seen;
+    for (int i = 0; i < resources->count_connectors; i++) {
+        seen.insert(resources->connectors[i]);
+        probeConnector(resources->connectors[i], notify);
+    }
+    drmModeFreeResources(resources);
     
-    // 查找连接器名称，格式通常为 /sys/devices/.../drm/card0/card0-HDMI-A-1
-    size_t pos = path.find_last_of('/');
-    if (pos != std::string::npos) {
-        std::string connector_name = path.substr(pos + 1);
-        
-        // 检查是否是连接器名称格式 (card0-XXX-X)
-        if (connector_name.find("card0-") == 0) {
-            return connector_name;
+    // 已经消失的连接器
+    std::vector<uint32_t> removed;
+    for (const auto& [connector_id, state] : connectors_) {
+        if (!seen.count(connector_id)) {
+            removed.push_back(connector_id);
         }
     }
-    
-    return "";
+    for (uint32_t connector_id : removed) {
+        updateConnector(connector_id, nullptr, notify);
+    }
 }
 
-HotplugEvent HotplugDetector::getConnectorStatus(const char* syspath) {
-    if (!syspath) {
-        return HotplugEvent::DISCONNECTED;
-    }
+void HotplugDetector::updateConnector(uint32_t connector_id, const drmModeConnector* connector, bool notify) {
+    auto it = connectors_.find(connector_id);
     
-    std::string status_file = std::string(syspath) + "/status";
-    std::ifstream file(status_file);
-    
-    if (!file.is_open()) {
-        LOG_DEBUG("Cannot open status file: {}", status_file);
-        return HotplugEvent::DISCONNECTED;
+    if (!connector) {
+        // 连接器已被移除，按断开处理
+        if (it == connectors_.end()) {
+            return;
+        }
+        ConnectorState state = it->second;
+        connectors_.erase(it);
+        if (state.connected && notify && callback_) {
+            LOG_INFO("Hotplug detected: {} -> removed", state.name);
+            callback_(connector_id, state.name, HotplugEvent::DISCONNECTED);
+        }
+        return;
     }
     
-    std::string status;
-    std::getline(file, status);
-    file.close();
-    
-    LOG_DEBUG("Connector status from {}: {}", status_file, status);
+    bool connected = (connector->connection == DRM_MODE_CONNECTED);
+    if (it == connectors_.end()) {
+        it = connectors_.emplace(connector_id, ConnectorState()).first;
+        it->second.name = formatConnectorName(card_name_, connector);
+    } else if (it->second.connected == connected) {
+        return;
+    }
     
-    if (status == "connected") {
-        return HotplugEvent::CONNECTED;
-    } else if (status == "disconnected") {
-        return HotplugEvent::DISCONNECTED;
+    it->second.connected = connected;
+    if (!notify) {
+        return;
     }
     
-    return HotplugEvent::DISCONNECTED;
-} 
\ No newline at end of file
+    LOG_INFO("Hotplug detected: {} -> {}", it->second.name, connected ? "connected" : "disconnected");
+    if (callback_) {
+        callback_(connector_id, it->second.name, connected ? HotplugEvent::CONNECTED : HotplugEvent::DISCONNECTED);
+    }
+}
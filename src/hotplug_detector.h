@@ -1,42 +1,59 @@
 #pragma once
 
 #include <functional>
-#include <thread>
 #include <atomic>
+#include <cstdint>
+#include <map>
 #include <string>
 #include <libudev.h>
+#include <sys/types.h>
+#include <xf86drmMode.h>
 
 enum class HotplugEvent {
     CONNECTED,
     DISCONNECTED
 };
 
-using HotplugCallback = std::function<void(const std::string& connector_name, HotplugEvent event)>;
+using HotplugCallback = std::function<void(uint32_t connector_id, const std::string& connector_name, HotplugEvent event)>;
 
 class HotplugDetector {
 public:
     HotplugDetector();
     ~HotplugDetector();
     
-    bool initialize();
+    // drm_fd用于读取连接器状态，只处理该设备节点的事件
+    bool initialize(int drm_fd, const std::string& card_name);
     void cleanup();
     
     void setCallback(HotplugCallback callback);
     void start();
     void stop();
     
+    // udev监视器fd，由调用者的事件循环监听，可读时调用processEvents
+    int getFd() const { return monitor_fd_; }
+    bool processEvents();
+    
 private:
+    // 每个连接器最近一次的状态，连接器列表随MST等动态变化
+    struct ConnectorState {
+        std::string name;
+        bool connected = false;
+    };
+    
     std::atomic<bool> running_;
-    std::thread monitor_thread_;
     HotplugCallback callback_;
     
     struct udev* udev_;
     struct udev_monitor* monitor_;
     int monitor_fd_;
     
-    void monitorLoop();
+    int drm_fd_;
+    dev_t drm_devnum_;
+    std::string card_name_;
+    std::map<uint32_t, ConnectorState> connectors_;
+    
     void processUdevDevice(struct udev_device* device);
-    void checkAllConnectors();
-    std::string getConnectorNameFromSysPath(const char* syspath);
-    HotplugEvent getConnectorStatus(const char* syspath);
-}; 
\ No newline at end of file
+    void probeConnector(uint32_t connector_id, bool notify);
+    void probeAllConnectors(bool notify);
+    void updateConnector(uint32_t connector_id, const drmModeConnector* connector, bool notify);
+}; 
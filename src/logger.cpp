@@ -1,15 +1,203 @@
 #include "logger.h"
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #ifdef HAVE_SPDLOG
 std::shared_ptr<spdlog::logger> Logger::logger_;
 #endif
 LogConfig Logger::config_;
+std::atomic<int> Logger::level_{LOG_LEVEL_INFO};
+std::atomic<bool> Logger::async_{false};
+
+namespace {
+
+// 有界多生产者/单消费者队列 (每个槽位带序号，参考Vyukov的有界队列)
+// 生产者CAS领取位置后就地构造参数，写完再发布序号；不加锁
+struct LogSlot {
+    std::atomic<size_t> sequence;
+    log_detail::Record record;
+};
+
+struct LogQueue {
+    std::unique_ptr<LogSlot[]> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};  // 只由后台线程写
+    
+    std::atomic<bool> running{false};
+    std::atomic<bool> sleeping{false};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+    
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+    bool atfork_registered = false;
+};
+
+LogQueue queue;
+
+// 后台线程没有新日志时的轮询间隔；info及以下不唤醒后台线程，热路径上没有系统调用
+const auto kSinkPollInterval = std::chrono::milliseconds(50);
+const auto kFlushInterval = std::chrono::seconds(3);
+
+thread_local uint32_t cached_thread_id = 0;
+
+uint32_t currentThreadId() {
+    if (!cached_thread_id) {
+        cached_thread_id = static_cast<uint32_t>(syscall(SYS_gettid));
+    }
+    return cached_thread_id;
+}
+
+#ifndef HAVE_SPDLOG
+const char* levelName(int level) {
+    static const char* names[] = { "trace", "debug", "info", "warning", "error", "critical", "off" };
+    return (level >= 0 && level <= LOG_LEVEL_OFF) ? names[level] : "?";
+}
+#endif
+
+}  // namespace
+
+namespace log_detail {
+
+void renderText(const Record& record, std::string& out) {
+    out = *std::launder(reinterpret_cast<const std::string*>(record.payload));
+}
+
+#ifndef HAVE_SPDLOG
+// 将{:spec}转换为printf格式并输出一个参数
+static void appendValue(std::string& out, const LogValue& value, const std::string& spec) {
+    std::string flags;
+    std::string width;
+    std::string precision;
+    char type = 0;
+    
+    size_t i = 0;
+    if (i < spec.size() && spec[i] == '0') {
+        flags = "0";
+        i++;
+    }
+    while (i < spec.size() && isdigit((unsigned char)spec[i])) width += spec[i++];
+    if (i < spec.size() && spec[i] == '.') {
+        precision = ".";
+        i++;
+        while (i < spec.size() && isdigit((unsigned char)spec[i])) precision += spec[i++];
+    }
+    if (i < spec.size()) type = spec[i];
+    
+    std::string format = "%" + flags + width + precision;
+    char buffer[128];
+    int len = 0;
+    switch (value.type) {
+    case LogValue::BOOL:
+        len = snprintf(buffer, sizeof(buffer), (format + "s").c_str(), value.u ? "true" : "false");
+        break;
+    case LogValue::CHAR:
+        if (type == 'd' || type == 'x' || type == 'X') {
+            len = snprintf(buffer, sizeof(buffer), (format + "ll" + type).c_str(), (long long)value.i);
+        } else {
+            len = snprintf(buffer, sizeof(buffer), (format + "c").c_str(), (int)value.i);
+        }
+        break;
+    case LogValue::INT:
+        if (type == 'x' || type == 'X') {
+            len = snprintf(buffer, sizeof(buffer), (format + "ll" + type).c_str(), (unsigned long long)value.i);
+        } else if (type == 'f' || type == 'e' || type == 'g') {
+            len = snprintf(buffer, sizeof(buffer), (format + type).c_str(), (double)value.i);
+        } else {
+            len = snprintf(buffer, sizeof(buffer), (format + "lld").c_str(), (long long)value.i);
+        }
+        break;
+    case LogValue::UINT:
+        if (type == 'x' || type == 'X') {
+            len = snprintf(buffer, sizeof(buffer), (format + "ll" + type).c_str(), (unsigned long long)value.u);
+        } else if (type == 'f' || type == 'e' || type == 'g') {
+            len = snprintf(buffer, sizeof(buffer), (format + type).c_str(), (double)value.u);
+        } else {
+            len = snprintf(buffer, sizeof(buffer), (format + "llu").c_str(), (unsigned long long)value.u);
+        }
+        break;
+    case LogValue::DOUBLE:
+        if (type == 'f' || type == 'e' || type == 'g') {
+            len = snprintf(buffer, sizeof(buffer), (format + type).c_str(), value.d);
+        } else if (precision.empty()) {
+            len = snprintf(buffer, sizeof(buffer), (format + "g").c_str(), value.d);
+        } else {
+            len = snprintf(buffer, sizeof(buffer), (format + "f").c_str(), value.d);
+        }
+        break;
+    case LogValue::STRING: {
+        size_t size = value.s.size;
+        if (!precision.empty()) {
+            size = std::min(size, (size_t)atoi(precision.c_str() + 1));
+        }
+        size_t pad = width.empty() ? 0 : (size_t)atoi(width.c_str());
+        out.append(value.s.data, size);
+        if (pad > size) out.append(pad - size, ' ');
+        return;
+    }
+    case LogValue::POINTER:
+        len = snprintf(buffer, sizeof(buffer), "%p", value.p);
+        break;
+    case LogValue::NONE:
+        return;
+    }
+    
+    if (len > 0) {
+        out.append(buffer, std::min((size_t)len, sizeof(buffer) - 1));
+    }
+}
+
+void formatValues(std::string& out, const char* format, const LogValue* values, size_t count) {
+    out.clear();
+    size_t next = 0;
+    for (const char* p = format; *p; p++) {
+        if (*p == '{' && p[1] == '{') {
+            out += '{';
+            p++;
+        } else if (*p == '}' && p[1] == '}') {
+            out += '}';
+            p++;
+        } else if (*p == '{') {
+            const char* end = strchr(p, '}');
+            if (!end) {
+                out += p;
+                break;
+            }
+            std::string spec(p + 1, end);
+            size_t colon = spec.find(':');
+            spec = (colon == std::string::npos) ? std::string() : spec.substr(colon + 1);
+            if (next < count) {
+                appendValue(out, values[next++], spec);
+            } else {
+                out.append(p, end + 1);
+            }
+            p = end;
+        } else {
+            out += *p;
+        }
+    }
+}
+#endif
+
+}  // namespace log_detail
 
 bool Logger::initialize(const LogConfig& config) {
     config_ = config;
-    
+
 #ifdef HAVE_SPDLOG
     try {
         std::vector<spdlog::sink_ptr> sinks;
@@ -27,13 +215,13 @@ bool Logger::initialize(const LogConfig& config) {
             // 确保日志目录存在
             std::filesystem::path log_path(config.log_file_path);
             std::filesystem::path log_dir = log_path.parent_path();
-            if (!std::filesystem::exists(log_dir)) {
+            if (!log_dir.empty() && !std::filesystem::exists(log_dir)) {
                 std::filesystem::create_directories(log_dir);
             }
             
             auto file_sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
-                config.log_file_path, 
-                config.max_file_size, 
+                config.log_file_path,
+                config.max_file_size,
                 config.max_files
             );
             file_sink->set_level(static_cast<spdlog::level::level_enum>(config.log_level));
@@ -48,37 +236,276 @@ bool Logger::initialize(const LogConfig& config) {
         
         // 设置为默认logger
         spdlog::set_default_logger(logger_);
-        
-        // 设置flush间隔(3秒)
-        spdlog::flush_every(std::chrono::seconds(3));
-        
-        logger_->info("Logger initialized successfully");
-        logger_->info("Log file: {}", config.log_file_path);
-        logger_->info("Console output: {}", config.enable_console);
-        logger_->info("File output: {}", config.enable_file);
-        logger_->info("Log level: {}", config.log_level);
-        logger_->info("Max file size: {} MB", config.max_file_size / (1024 * 1024));
-        logger_->info("Max files: {}", config.max_files);
-        
-        return true;
     } catch (const std::exception& ex) {
         std::cerr << "Logger initialization failed: " << ex.what() << std::endl;
         return false;
     }
+#endif
+
+    level_.store(config.log_level, std::memory_order_relaxed);
+    async_.store(config.async, std::memory_order_relaxed);
+    
+    // 后台线程每3秒刷新一次 (代替spdlog::flush_every，其线程在守护进程fork后不存在)
+    if (config.async) {
+        size_t capacity = 2;
+        while (capacity < config.queue_size) capacity <<= 1;
+        queue.slots.reset(new LogSlot[capacity]);
+        queue.mask = capacity - 1;
+        for (size_t i = 0; i < capacity; i++) {
+            queue.slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        queue.enqueue_pos.store(0, std::memory_order_relaxed);
+        queue.dequeue_pos.store(0, std::memory_order_relaxed);
+        startSink();
+        
+        // fork前排空队列并停止后台线程，父子进程中各自重新启动
+        if (!queue.atfork_registered) {
+            pthread_atfork(&Logger::stopSink, &Logger::startSink, &Logger::restartInChild);
+            queue.atfork_registered = true;
+        }
+    }
+
+#ifdef HAVE_SPDLOG
+    LOG_INFO("Logger initialized successfully");
 #else
-    std::cout << "[INFO] Logger initialized (fallback mode - no spdlog)" << std::endl;
-    std::cout << "[INFO] Console output: " << (config.enable_console ? "enabled" : "disabled") << std::endl;
-    return true;
+    LOG_INFO("Logger initialized (fallback mode - no spdlog)");
 #endif
+    LOG_INFO("Log file: {}", config.log_file_path);
+    LOG_INFO("Console output: {}", config.enable_console);
+    LOG_INFO("File output: {}", config.enable_file);
+    LOG_INFO("Log level: {}", config.log_level);
+    LOG_INFO("Max file size: {} MB", config.max_file_size / (1024 * 1024));
+    LOG_INFO("Max files: {}", config.max_files);
+    if (config.async) {
+        LOG_INFO("Async logging: {} entry queue", queue.mask + 1);
+    }
+    
+    return true;
 }
 
 void Logger::cleanup() {
+    LOG_INFO("Logger shutting down");
+    
+    // 停止后台线程前写出队列中剩余的日志，之后的日志在调用线程同步写出
+    // 队列内存不释放：其他线程可能仍持有刚领取的槽位
+    async_.store(false, std::memory_order_relaxed);
+    stopSink();
+    flush();
+
 #ifdef HAVE_SPDLOG
     if (logger_) {
-        logger_->info("Logger shutting down");
-        logger_->flush();
         spdlog::shutdown();
         logger_.reset();
     }
 #endif
-} 
\ No newline at end of file
+}
+
+uint64_t Logger::getWrittenCount() {
+    return queue.written.load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::getDroppedCount() {
+    return queue.dropped.load(std::memory_order_relaxed);
+}
+
+log_detail::Record* Logger::beginRecord() {
+    if (!queue.running.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    
+    size_t pos = queue.enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+        LogSlot& slot = queue.slots[pos & queue.mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (queue.enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.record.position = pos;
+                slot.record.thread_id = currentThreadId();
+                return &slot.record;
+            }
+        } else if (diff < 0) {
+            return nullptr;  // 队列满
+        } else {
+            pos = queue.enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::commitRecord(log_detail::Record* record) {
+    // 发布之后槽位可能立即被后台线程消费并被其他生产者重用，record不能再访问
+    size_t pos = record->position;
+    int level = record->level;
+    queue.slots[pos & queue.mask].sequence.store(pos + 1, std::memory_order_release);
+    
+    // 只有warn及以上或队列过半时才唤醒后台线程，其余等待下一次轮询
+    // 后台线程可能已经越过本条，此时差值为负，按有符号比较
+    intptr_t backlog = (intptr_t)pos - (intptr_t)queue.dequeue_pos.load(std::memory_order_relaxed);
+    if (level >= LOG_LEVEL_WARN || backlog >= (intptr_t)(queue.mask + 1) / 2) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (queue.sleeping.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.cond.notify_one();
+        }
+    }
+}
+
+bool Logger::acceptDirect(int level) {
+    if (!async_.load(std::memory_order_relaxed) || level >= LOG_LEVEL_WARN) {
+        return true;
+    }
+    queue.dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void Logger::writeDirect(int level, const std::string& message) {
+    write(level, std::chrono::system_clock::now(), currentThreadId(), message);
+}
+
+void Logger::write(int level, std::chrono::system_clock::time_point time, uint32_t thread_id,
+                   const std::string& message) {
+#ifdef HAVE_SPDLOG
+    if (!logger_) {
+        return;
+    }
+    // 直接交给sinks，保留调用线程的时间戳和线程号
+    auto spd_level = static_cast<spdlog::level::level_enum>(level);
+    spdlog::details::log_msg msg(time, spdlog::source_loc{}, logger_->name(), spd_level, message);
+    msg.thread_id = thread_id;
+    for (auto& sink : logger_->sinks()) {
+        if (sink->should_log(spd_level)) {
+            sink->log(msg);
+        }
+    }
+    if (spd_level >= spdlog::level::warn) {
+        logger_->flush();
+    }
+#else
+    if (!config_.enable_console) {
+        return;
+    }
+    std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+    int millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+        time.time_since_epoch()).count() % 1000;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+    fprintf(stdout, "[%s.%03d] [%s] [%u] %s\n", stamp, millis, levelName(level), thread_id, message.c_str());
+    if (level >= LOG_LEVEL_WARN) {
+        fflush(stdout);
+    }
+#endif
+}
+
+void Logger::flush() {
+#ifdef HAVE_SPDLOG
+    if (logger_) {
+        logger_->flush();
+    }
+#else
+    fflush(stdout);
+#endif
+}
+
+void Logger::startSink() {
+    if (!async_.load(std::memory_order_relaxed) || !queue.slots || queue.thread.joinable()) {
+        return;
+    }
+    queue.running.store(true, std::memory_order_release);
+    queue.thread = std::thread(&Logger::sinkLoop);
+}
+
+void Logger::restartInChild() {
+    // 子进程中fork的线程号不同
+    cached_thread_id = 0;
+    startSink();
+}
+
+void Logger::stopSink() {
+    if (!queue.thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.running.store(false, std::memory_order_release);
+    }
+    queue.cond.notify_one();
+    queue.thread.join();
+}
+
+size_t Logger::drainQueue(std::string& message) {
+    size_t count = 0;
+    size_t pos = queue.dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+        LogSlot& slot = queue.slots[pos & queue.mask];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            break;
+        }
+        
+        log_detail::Record& record = slot.record;
+        record.render(record, message);
+        record.destroy(record);
+        write(record.level, record.time, record.thread_id, message);
+        
+        slot.sequence.store(pos + queue.mask + 1, std::memory_order_release);
+        pos++;
+        queue.dequeue_pos.store(pos, std::memory_order_relaxed);
+        count++;
+    }
+    return count;
+}
+
+void Logger::sinkLoop() {
+    pthread_setname_np(pthread_self(), "log-sink");
+    
+    std::string message;
+    uint64_t reported_drops = queue.dropped.load(std::memory_order_relaxed);
+    auto last_flush = std::chrono::steady_clock::now();
+    
+    for (;;) {
+        size_t count = drainQueue(message);
+        if (count) {
+            queue.written.fetch_add(count, std::memory_order_relaxed);
+        }
+        
+        uint64_t drops = queue.dropped.load(std::memory_order_relaxed);
+        if (drops != reported_drops) {
+            write(LOG_LEVEL_WARN, std::chrono::system_clock::now(), currentThreadId(),
+                  "Log queue full, dropped " + std::to_string(drops - reported_drops) + " messages");
+            reported_drops = drops;
+        }
+        
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_flush >= kFlushInterval) {
+            flush();
+            last_flush = now;
+        }
+        
+        if (count) {
+            continue;
+        }
+        
+        if (!queue.running.load(std::memory_order_acquire)) {
+            // 已领取但尚未提交的槽位：等生产者写完
+            if (queue.enqueue_pos.load(std::memory_order_acquire) ==
+                queue.dequeue_pos.load(std::memory_order_relaxed)) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t pos = queue.dequeue_pos.load(std::memory_order_relaxed);
+        if (queue.running.load(std::memory_order_relaxed) &&
+            queue.slots[pos & queue.mask].sequence.load(std::memory_order_acquire) != pos + 1) {
+            queue.cond.wait_for(lock, kSinkPollInterval);
+        }
+        queue.sleeping.store(false, std::memory_order_relaxed);
+    }
+    
+    flush();
+}
@@ -7,8 +7,17 @@
 #include <spdlog/sinks/basic_file_sink.h>
 #endif
 
-#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 struct LogConfig {
     std::string log_file_path = "./rk3588_multi_display.log"; // 默认当前文件夹
@@ -17,87 +26,267 @@ struct LogConfig {
     int log_level = 2; // 0=trace, 1=debug, 2=info, 3=warn, 4=error, 5=critical
     size_t max_file_size = 20 * 1024 * 1024; // 20MB
     size_t max_files = 7; // 7 days rotation
+    bool async = true;         // 由后台线程格式化和写出
+    size_t queue_size = 4096;  // 异步队列容量 (条)，向上取2的幂
+};
+
+// 日志级别，与LogConfig::log_level和spdlog的级别一致
+// 不用DEBUG/ERROR等短名字：LOG_EVERY_N(severity, ...)通过拼接LOG_LEVEL_前缀引用级别
+enum LogLevel : int {
+    LOG_LEVEL_TRACE = 0,
+    LOG_LEVEL_DEBUG = 1,
+    LOG_LEVEL_INFO = 2,
+    LOG_LEVEL_WARN = 3,
+    LOG_LEVEL_ERROR = 4,
+    LOG_LEVEL_CRITICAL = 5,
+    LOG_LEVEL_OFF = 6
 };
 
+namespace log_detail {
+
+// 延迟格式化时参数按值保存；C字符串可能指向调用者的临时缓冲区 (strerror等)，需要复制
+template<typename T> struct StoredArg { using type = T; };
+template<> struct StoredArg<const char*> { using type = std::string; };
+template<> struct StoredArg<char*> { using type = std::string; };
+template<> struct StoredArg<std::string_view> { using type = std::string; };
+template<typename T> using StoredArgT = typename StoredArg<std::decay_t<T>>::type;
+
+// 队列中的一条日志：参数包直接构造在payload中，由后台线程格式化后析构
+constexpr size_t kRecordPayloadSize = 160;
+
+struct Record {
+    size_t position;  // 在队列中的位置，提交时使用
+    int level;
+    uint32_t thread_id;
+    std::chrono::system_clock::time_point time;
+    const char* format;  // 必须是字符串字面量
+    void (*render)(const Record& record, std::string& out);
+    void (*destroy)(Record& record);
+    alignas(std::max_align_t) unsigned char payload[kRecordPayloadSize];
+};
+
+#ifdef HAVE_SPDLOG
+template<typename... Args>
+void formatArgs(std::string& out, const char* format, const Args&... args) {
+    try {
+        out = fmt::vformat(format, fmt::make_format_args(args...));
+    } catch (const std::exception& ex) {
+        out = format;
+        out += " [format error: ";
+        out += ex.what();
+        out += "]";
+    }
+}
+#else
+// 没有spdlog时的格式化：支持{}和{:[0][宽度][.精度][类型]}，类型为d/x/X/f/e/g/s/p
+struct LogValue {
+    enum Type { NONE, BOOL, CHAR, INT, UINT, DOUBLE, STRING, POINTER } type = NONE;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void* p;
+        struct { const char* data; size_t size; } s;
+    };
+    LogValue() : u(0) {}
+};
+
+template<typename T>
+LogValue makeLogValue(const T& value) {
+    LogValue v;
+    if constexpr (std::is_same_v<T, bool>) {
+        v.type = LogValue::BOOL;
+        v.u = value;
+    } else if constexpr (std::is_same_v<T, char>) {
+        v.type = LogValue::CHAR;
+        v.i = value;
+    } else if constexpr (std::is_enum_v<T>) {
+        v.type = LogValue::INT;
+        v.i = static_cast<int64_t>(value);
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        v.type = LogValue::INT;
+        v.i = value;
+    } else if constexpr (std::is_integral_v<T>) {
+        v.type = LogValue::UINT;
+        v.u = value;
+    } else if constexpr (std::is_floating_point_v<T>) {
+        v.type = LogValue::DOUBLE;
+        v.d = value;
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        std::string_view view = value;
+        v.type = LogValue::STRING;
+        v.s.data = view.data();
+        v.s.size = view.size();
+    } else if constexpr (std::is_pointer_v<T>) {
+        v.type = LogValue::POINTER;
+        v.p = value;
+    } else {
+        static_assert(sizeof(T) == 0, "unsupported log argument type");
+    }
+    return v;
+}
+
+void formatValues(std::string& out, const char* format, const LogValue* values, size_t count);
+
+template<typename... Args>
+void formatArgs(std::string& out, const char* format, const Args&... args) {
+    const LogValue values[] = { makeLogValue(args)..., LogValue() };
+    formatValues(out, format, values, sizeof...(Args));
+}
+#endif
+
+template<typename Pack>
+void renderPack(const Record& record, std::string& out) {
+    const Pack& pack = *std::launder(reinterpret_cast<const Pack*>(record.payload));
+    std::apply([&](const auto&... args) { formatArgs(out, record.format, args...); }, pack);
+}
+
+template<typename T>
+void destroyPayload(Record& record) {
+    std::launder(reinterpret_cast<T*>(record.payload))->~T();
+}
+
+void renderText(const Record& record, std::string& out);
+
+}  // namespace log_detail
+
+// 日志调用方只做级别判断、取时间戳和把参数复制进无锁队列，格式化和写出由后台线程完成
+// 被级别过滤掉的调用只有一次relaxed原子读
 class Logger {
 public:
     static bool initialize(const LogConfig& config);
     static void cleanup();
     
+    static bool shouldLog(int level) {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+    
+    template<typename... Args>
+    static void log(int level, const char* format, Args&&... args) {
+        using Pack = std::tuple<log_detail::StoredArgT<Args>...>;
+        
+        log_detail::Record* record = beginRecord();
+        if (!record) {
+            // 队列满或没有后台线程：warn及以上在调用线程同步写出，其余丢弃并计数
+            if (acceptDirect(level)) {
+                std::string message;
+                log_detail::formatArgs(message, format, args...);
+                writeDirect(level, message);
+            }
+            return;
+        }
+        
+        record->level = level;
+        record->format = format;
+        record->time = std::chrono::system_clock::now();
+        if constexpr (sizeof(Pack) <= log_detail::kRecordPayloadSize &&
+                      alignof(Pack) <= alignof(std::max_align_t)) {
+            new (record->payload) Pack(std::forward<Args>(args)...);
+            record->render = &log_detail::renderPack<Pack>;
+            record->destroy = &log_detail::destroyPayload<Pack>;
+        } else {
+            // 参数包放不下时在调用线程格式化，只排队结果
+            std::string* text = new (record->payload) std::string();
+            log_detail::formatArgs(*text, format, args...);
+            record->render = &log_detail::renderText;
+            record->destroy = &log_detail::destroyPayload<std::string>;
+        }
+        commitRecord(record);
+    }
+    
     // 日志宏定义
     template<typename... Args>
     static void trace(const char* fmt, Args&&... args) {
-#ifdef HAVE_SPDLOG
-        if (logger_) logger_->trace(fmt, std::forward<Args>(args)...);
-#endif
+        if (shouldLog(LOG_LEVEL_TRACE)) log(LOG_LEVEL_TRACE, fmt, std::forward<Args>(args)...);
     }
     
     template<typename... Args>
     static void debug(const char* fmt, Args&&... args) {
-#ifdef HAVE_SPDLOG
-        if (logger_) logger_->debug(fmt, std::forward<Args>(args)...);
-#else
-        printf("[DEBUG] ");
-        printf(fmt, std::forward<Args>(args)...);
-        printf("\n");
-#endif
+        if (shouldLog(LOG_LEVEL_DEBUG)) log(LOG_LEVEL_DEBUG, fmt, std::forward<Args>(args)...);
     }
     
     template<typename... Args>
     static void info(const char* fmt, Args&&... args) {
-#ifdef HAVE_SPDLOG
-        if (logger_) logger_->info(fmt, std::forward<Args>(args)...);
-#else
-        printf("[INFO] ");
-        printf(fmt, std::forward<Args>(args)...);
-        printf("\n");
-#endif
+        if (shouldLog(LOG_LEVEL_INFO)) log(LOG_LEVEL_INFO, fmt, std::forward<Args>(args)...);
     }
     
     template<typename... Args>
     static void warn(const char* fmt, Args&&... args) {
-#ifdef HAVE_SPDLOG
-        if (logger_) logger_->warn(fmt, std::forward<Args>(args)...);
-#else
-        printf("[WARN] ");
-        printf(fmt, std::forward<Args>(args)...);
-        printf("\n");
-#endif
+        if (shouldLog(LOG_LEVEL_WARN)) log(LOG_LEVEL_WARN, fmt, std::forward<Args>(args)...);
     }
     
     template<typename... Args>
     static void error(const char* fmt, Args&&... args) {
-#ifdef HAVE_SPDLOG
-        if (logger_) logger_->error(fmt, std::forward<Args>(args)...);
-#else
-        printf("[ERROR] ");
-        printf(fmt, std::forward<Args>(args)...);
-        printf("\n");
-#endif
+        if (shouldLog(LOG_LEVEL_ERROR)) log(LOG_LEVEL_ERROR, fmt, std::forward<Args>(args)...);
     }
     
     template<typename... Args>
     static void critical(const char* fmt, Args&&... args) {
-#ifdef HAVE_SPDLOG
-        if (logger_) logger_->critical(fmt, std::forward<Args>(args)...);
-#else
-        printf("[CRITICAL] ");
-        printf(fmt, std::forward<Args>(args)...);
-        printf("\n");
-#endif
+        if (shouldLog(LOG_LEVEL_CRITICAL)) log(LOG_LEVEL_CRITICAL, fmt, std::forward<Args>(args)...);
     }
+    
+    // 后台线程写出和丢弃的日志条数
+    static uint64_t getWrittenCount();
+    static uint64_t getDroppedCount();
 
 private:
 #ifdef HAVE_SPDLOG
     static std::shared_ptr<spdlog::logger> logger_;
 #endif
     static LogConfig config_;
+    static std::atomic<int> level_;
+    static std::atomic<bool> async_;   // cleanup在其他线程仍在记录日志时关闭异步模式
+    
+    static log_detail::Record* beginRecord();
+    static void commitRecord(log_detail::Record* record);
+    static bool acceptDirect(int level);
+    static void writeDirect(int level, const std::string& message);
+    static void write(int level, std::chrono::system_clock::time_point time, uint32_t thread_id,
+                      const std::string& message);
+    static void flush();
+    static void startSink();
+    static void stopSink();
+    static void restartInChild();
+    static void sinkLoop();
+    static size_t drainQueue(std::string& message);
 };
 
-// 便捷宏
-#define LOG_TRACE(...) Logger::trace(__VA_ARGS__)
-#define LOG_DEBUG(...) Logger::debug(__VA_ARGS__)
-#define LOG_INFO(...) Logger::info(__VA_ARGS__)
-#define LOG_WARN(...) Logger::warn(__VA_ARGS__)
-#define LOG_ERROR(...) Logger::error(__VA_ARGS__)
-#define LOG_CRITICAL(...) Logger::critical(__VA_ARGS__) 
\ No newline at end of file
+// 便捷宏：先在调用处判断级别，被过滤时不求值参数
+#define LOG_AT(level, ...) \
+    do { \
+        if (Logger::shouldLog(level)) Logger::log(level, __VA_ARGS__); \
+    } while (0)
+
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_CRITICAL(...) LOG_AT(LOG_LEVEL_CRITICAL, __VA_ARGS__)
+
+// 限频日志，severity为TRACE/DEBUG/INFO/WARN/ERROR/CRITICAL，计数器在每个调用点独立
+// LOG_EVERY_N：第1、N+1、2N+1...次调用时输出
+#define LOG_EVERY_N(severity, n, ...) \
+    do { \
+        static std::atomic<uint64_t> log_occurrences_{0}; \
+        if (Logger::shouldLog(LOG_LEVEL_##severity) && \
+            log_occurrences_.fetch_add(1, std::memory_order_relaxed) % (n) == 0) { \
+            Logger::log(LOG_LEVEL_##severity, __VA_ARGS__); \
+        } \
+    } while (0)
+
+// LOG_EVERY_MS：距同一调用点上一次输出至少ms毫秒才输出 (首次调用总是输出)
+#define LOG_EVERY_MS(severity, ms, ...) \
+    do { \
+        static std::atomic<int64_t> log_last_ns_{0}; \
+        if (Logger::shouldLog(LOG_LEVEL_##severity)) { \
+            int64_t log_now_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>( \
+                std::chrono::steady_clock::now().time_since_epoch()).count(); \
+            int64_t log_prev_ns_ = log_last_ns_.load(std::memory_order_relaxed); \
+            if ((log_prev_ns_ == 0 || log_now_ns_ - log_prev_ns_ >= int64_t(ms) * 1000000) && \
+                log_last_ns_.compare_exchange_strong(log_prev_ns_, log_now_ns_, \
+                                                     std::memory_order_relaxed)) { \
+                Logger::log(LOG_LEVEL_##severity, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
@@ -1,24 +1,15 @@
+#include "config_file.h"
 #include "display_manager.h"
 #include "frame_copier.h"
 #include "logger.h"
 #include "system_checker.h"
+#include <chrono>
 #include <iostream>
+#include <cstdio>
+#include <pthread.h>
 #include <signal.h>
 #include <unistd.h>
 
-static DisplayManager* g_display_manager = nullptr;
-
-void signal_handler(int signal) {
-    LOG_INFO("Received signal {}, shutting down...", signal);
-    
-    if (g_display_manager) {
-        g_display_manager->stop();
-    }
-    
-    Logger::cleanup();
-    exit(0);
-}
-
 void print_usage(const char* program_name) {
     std::cout << "Usage: " << program_name << " [options]" << std::endl;
     std::cout << "Options:" << std::endl;
@@ -29,6 +20,40 @@ void print_usage(const char* program_name) {
     std::cout << "  --scale-mode MODE   Scaling mode: stretch|keep-aspect (default: stretch)" << std::endl;
     std::cout << "  --rotation DEGREES  Rotation angle: 0|90|180|270 (default: 90)" << std::endl;
     std::cout << "  --quality QUALITY   Image quality: fast|good (default: good)" << std::endl;
+    std::cout << "  --output-format [CONNECTOR=]FORMAT" << std::endl;
+    std::cout << "                      Scanout format: xrgb8888|rgb565|nv12 (default: xrgb8888)," << std::endl;
+    std::cout << "                      e.g. --output-format card0-HDMIA-1=nv12" << std::endl;
+    std::cout << "  --mode-policy P     Secondary mode policy: efficient|preferred (default: efficient)" << std::endl;
+    std::cout << "  --min-mode WxH      Minimum secondary resolution for the efficient policy" << std::endl;
+    std::cout << "  --pixel-budget MPS  Max transform throughput in megapixels/s (default: unlimited)" << std::endl;
+    std::cout << "  --no-hw-clone       Never share the DSI CRTC with secondary displays" << std::endl;
+    std::cout << "  --no-fast-boot      Don't show the first DSI frame at modeset or keep the firmware's CRTC mode" << std::endl;
+    std::cout << "  --zero-copy         Scan out the DSI framebuffer directly on secondary planes (atomic only)" << std::endl;
+    std::cout << "  --buffers N         Swapchain depth per display: 2-8 (default: 3)" << std::endl;
+    std::cout << "  --swapchain-cache N Swapchains kept for reconnects: 0-8 (default: 2)" << std::endl;
+    std::cout << "  --profile-cache PATH  EDID-keyed display profile cache" << std::endl;
+    std::cout << "                      (default: /var/cache/rk3588-multi-display/display-profiles)" << std::endl;
+    std::cout << "  --no-profile-cache  Keep display profiles in memory only" << std::endl;
+    std::cout << "  --control-socket PATH  Unix socket for Prometheus metrics and runtime commands" << std::endl;
+    std::cout << "                      (default: /run/rk3588-multi-display/control.sock)" << std::endl;
+    std::cout << "  --no-control-socket Do not create the control socket" << std::endl;
+    std::cout << "  --config PATH       Settings file reloaded on SIGHUP; command line options override it at startup" << std::endl;
+    std::cout << "                      (default: /etc/rk3588-multi-display.conf, skipped if missing)" << std::endl;
+    std::cout << "  --no-config         Do not read a settings file" << std::endl;
+    std::cout << "  --max-fps N         Capture frame rate with moving content (default: 60)" << std::endl;
+    std::cout << "  --min-fps N         Frame rate the governor drops to on static content (default: 10)" << std::endl;
+    std::cout << "  --thermal-limit C   Temperature at which the governor reduces quality and FPS (default: 85)" << std::endl;
+    std::cout << "  --no-governor       Always capture at --max-fps with the configured quality" << std::endl;
+    std::cout << "  --rt-priority N     Run capture/present threads as SCHED_FIFO at priority 1-99 (default: off)" << std::endl;
+    std::cout << "  --cpus LIST         Pin the copy pipeline to CPUs, e.g. 4-7 or 4,5; 'all' disables pinning" << std::endl;
+    std::cout << "                      (default: the highest-capacity cores, the A76 cluster on RK3588)" << std::endl;
+    std::cout << "  --mlock             Lock and prefault process memory" << std::endl;
+    std::cout << "  --device PATH       DRM device (default: /dev/dri/card0)" << std::endl;
+    std::cout << "  --kms BACKEND       KMS backend: auto|atomic|legacy (default: auto)" << std::endl;
+    std::cout << "  --trace FILE        Record per-frame pipeline spans and write Chrome trace JSON to FILE" << std::endl;
+    std::cout << "                      on exit or SIGUSR2 (open in ui.perfetto.dev)" << std::endl;
+    std::cout << "  --trace-on-signal   Only record between two SIGUSR2 signals" << std::endl;
+    std::cout << "  --trace-buffer N    Trace ring buffer size in events (default: 65536)" << std::endl;
     std::cout << "  --debug             Enable debug mode" << std::endl;
     std::cout << "Logging Options:" << std::endl;
     std::cout << "  --log-level LEVEL   Log level: 0=trace,1=debug,2=info,3=warn,4=error,5=critical (default: 2)" << std::endl;
@@ -46,11 +71,33 @@ void print_version() {
 }
 
 int main(int argc, char* argv[]) {
+    // 启动指标 (到第一帧镜像画面的时间) 从这里开始计时
+    auto process_start = std::chrono::steady_clock::now();
+    
     bool run_as_daemon = false;
     bool verbose = false;
     DisplayConfig config; // 默认配置
     LogConfig log_config; // 默认日志配置
     
+    // 配置文件先于其他命令行选项应用，命令行选项优先 (SIGHUP重新加载时以文件为准)
+    bool explicit_config = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--config" && i + 1 < argc) {
+            config.config_file = argv[++i];
+            explicit_config = true;
+        } else if (arg == "--no-config") {
+            config.config_file.clear();
+        }
+    }
+    if (!config.config_file.empty() && (explicit_config || access(config.config_file.c_str(), F_OK) == 0)) {
+        std::string error;
+        if (!loadConfigFile(config.config_file, config, error)) {
+            std::cerr << "Invalid configuration file: " << error << std::endl;
+            return 1;
+        }
+    }
+    
     // 解析命令行参数
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
@@ -98,6 +145,154 @@ int main(int argc, char* argv[]) {
                 print_usage(argv[0]);
                 return 1;
             }
+        } else if (arg == "--output-format" && i + 1 < argc) {
+            std::string value = argv[++i];
+            std::string connector;
+            size_t eq = value.find('=');
+            if (eq != std::string::npos) {
+                connector = value.substr(0, eq);
+                value = value.substr(eq + 1);
+            }
+            uint32_t format;
+            if (!parseOutputFormat(value, format)) {
+                std::cerr << "Invalid output format: " << value << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            if (connector.empty()) {
+                config.output_format = format;
+            } else {
+                config.display_formats[connector] = format;
+            }
+        } else if (arg == "--mode-policy" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "efficient") {
+                config.mode_selection.policy = ModePolicy::EFFICIENT;
+            } else if (policy == "preferred") {
+                config.mode_selection.policy = ModePolicy::PREFERRED;
+            } else {
+                std::cerr << "Invalid mode policy: " << policy << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--min-mode" && i + 1 < argc) {
+            unsigned int width = 0, height = 0;
+            if (sscanf(argv[++i], "%ux%u", &width, &height) != 2) {
+                std::cerr << "Invalid minimum mode: " << argv[i] << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            config.mode_selection.min_width = width;
+            config.mode_selection.min_height = height;
+        } else if (arg == "--pixel-budget" && i + 1 < argc) {
+            double mps = std::stod(argv[++i]);
+            if (mps <= 0) {
+                std::cerr << "Invalid pixel budget: " << mps << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            config.mode_selection.pixel_budget = (uint64_t)(mps * 1000000.0);
+        } else if (arg == "--no-hw-clone") {
+            config.hw_clone = false;
+        } else if (arg == "--no-fast-boot") {
+            config.fast_boot = false;
+            config.mode_selection.adopt_boot_mode = false;
+        } else if (arg == "--zero-copy") {
+            config.zero_copy = true;
+        } else if (arg == "--buffers" && i + 1 < argc) {
+            int depth = std::stoi(argv[++i]);
+            if (depth >= 2 && depth <= 8) {
+                config.swapchain_depth = depth;
+            } else {
+                std::cerr << "Invalid swapchain depth: " << depth << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--profile-cache" && i + 1 < argc) {
+            config.profile_cache = argv[++i];
+        } else if (arg == "--no-profile-cache") {
+            config.profile_cache.clear();
+        } else if (arg == "--control-socket" && i + 1 < argc) {
+            config.control_socket = argv[++i];
+        } else if (arg == "--no-control-socket") {
+            config.control_socket.clear();
+        } else if (arg == "--config" && i + 1 < argc) {
+            i++;  // 已在上面读取
+        } else if (arg == "--no-config") {
+            // 已在上面处理
+        } else if (arg == "--swapchain-cache" && i + 1 < argc) {
+            int count = std::stoi(argv[++i]);
+            if (count >= 0 && count <= 8) {
+                config.swapchain_cache_size = count;
+            } else {
+                std::cerr << "Invalid swapchain cache size: " << count << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if ((arg == "--max-fps" || arg == "--min-fps") && i + 1 < argc) {
+            int fps = std::stoi(argv[++i]);
+            if (fps < 1 || fps > 240) {
+                std::cerr << "Invalid frame rate: " << fps << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            (arg == "--max-fps" ? config.governor.max_fps : config.governor.min_fps) = fps;
+        } else if (arg == "--thermal-limit" && i + 1 < argc) {
+            int limit = std::stoi(argv[++i]);
+            if (limit < 40 || limit > 125) {
+                std::cerr << "Invalid thermal limit: " << limit << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            config.governor.thermal_limit_c = limit;
+            config.governor.thermal_resume_c = limit - 10;
+        } else if (arg == "--no-governor") {
+            config.governor.enabled = false;
+        } else if (arg == "--rt-priority" && i + 1 < argc) {
+            int priority = std::stoi(argv[++i]);
+            if (priority >= 1 && priority <= 99) {
+                config.realtime.priority = priority;
+            } else {
+                std::cerr << "Invalid real-time priority: " << priority << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--cpus" && i + 1 < argc) {
+            if (!parseCpuList(argv[++i], config.realtime)) {
+                std::cerr << "Invalid CPU list: " << argv[i] << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--mlock") {
+            config.realtime.lock_memory = true;
+        } else if (arg == "--device" && i + 1 < argc) {
+            config.drm_device = argv[++i];
+        } else if (arg == "--kms" && i + 1 < argc) {
+            std::string backend = argv[++i];
+            if (backend == "auto") {
+                config.kms_backend = KmsBackend::AUTO;
+            } else if (backend == "atomic") {
+                config.kms_backend = KmsBackend::ATOMIC;
+            } else if (backend == "legacy") {
+                config.kms_backend = KmsBackend::LEGACY;
+            } else {
+                std::cerr << "Invalid KMS backend: " << backend << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--trace" && i + 1 < argc) {
+            config.trace.file = argv[++i];
+        } else if (arg == "--trace-on-signal") {
+            config.trace.on_signal = true;
+        } else if (arg == "--trace-buffer" && i + 1 < argc) {
+            int events = std::stoi(argv[++i]);
+            if (events >= 1024 && events <= (1 << 24)) {
+                config.trace.events = events;
+            } else {
+                std::cerr << "Invalid trace buffer size: " << events << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
         } else if (arg == "--log-level" && i + 1 < argc) {
             int level = std::stoi(argv[++i]);
             if (level >= 0 && level <= 5) {
@@ -120,6 +315,16 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    // 在创建任何线程之前屏蔽退出、重新加载和统计信号，由显示管理器的事件循环通过signalfd接收
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    
     // 初始化日志系统
     if (!Logger::initialize(log_config)) {
         std::cerr << "Failed to initialize logger" << std::endl;
@@ -134,20 +339,22 @@ int main(int argc, char* argv[]) {
     }
     
     // 系统条件检查
+    auto checks_start = std::chrono::steady_clock::now();
     SystemChecker system_checker;
     if (!system_checker.checkStartupConditions()) {
         LOG_ERROR("System startup conditions not met, exiting");
         Logger::cleanup();
         return 1;
     }
-    
-    // 设置信号处理器
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    LOG_INFO("System checks took {} ms", std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - checks_start).count());
     
     // 创建显示管理器
     DisplayManager display_manager;
-    g_display_manager = &display_manager;
+    display_manager.setStartTime(process_start);
+    
+    // 应用配置 (需在初始化前设置，启动时创建的缓冲区才会使用配置的输出格式)
+    display_manager.setDisplayConfig(config);
     
     // 初始化显示管理器
     if (!display_manager.initialize()) {
@@ -156,9 +363,6 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    // 应用配置
-    display_manager.setDisplayConfig(config);
-    
     // 如果以守护进程模式运行
     if (run_as_daemon) {
         LOG_INFO("Running as daemon...");
@@ -171,10 +375,11 @@ int main(int argc, char* argv[]) {
         }
         
         if (pid > 0) {
-            // 父进程退出
+            // 父进程退出：用_exit跳过DisplayManager的析构，framebuffer和DRM状态属于与子进程共享的
+            // DRM文件描述，析构中的drmModeRmFB会移除子进程正在扫描输出的缓冲区
             LOG_INFO("Daemon started with PID: {}", pid);
             Logger::cleanup();
-            return 0;
+            _exit(0);
         }
         
         // 子进程继续运行
@@ -193,15 +398,13 @@ int main(int argc, char* argv[]) {
     
     LOG_INFO("Display manager is running. Press Ctrl+C to stop.");
     
-    // 主循环 - 等待信号
-    while (true) {
-        sleep(1);
-    }
+    // 等待SIGINT/SIGTERM
+    display_manager.wait();
     
     // 清理资源
     LOG_INFO("Shutting down display manager...");
+    display_manager.stop();
     display_manager.cleanup();
-    g_display_manager = nullptr;
     
     // 清理日志系统
     Logger::cleanup();
@@ -0,0 +1,200 @@
+#include "output_worker.h"
+#include "logger.h"
+
+OutputWorker::OutputWorker(std::shared_ptr<OutputSlot> slot, std::shared_ptr<FrameCopier> frame_copier,
+                           std::function<void()> on_rendered)
+    : slot_(slot), frame_copier_(frame_copier), on_rendered_(on_rendered),
+      stopping_(false), needs_capture_(true), presented_(0), dropped_(0),
+      presented_start_(0), dropped_start_(0) {
+}
+
+OutputWorker::~OutputWorker() {
+    stop();
+}
+
+void OutputWorker::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+
+    stopping_ = false;
+    report_start_ = std::chrono::steady_clock::now();
+    thread_ = std::thread(&OutputWorker::run, this);
+}
+
+void OutputWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cond_.notify_one();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    // 工作线程已退出，由这里代替消费者归还队列中的帧，捕获缓冲区之后才能被释放
+    StageFrame item;
+    while (input_.pop(item)) {
+    }
+}
+
+void OutputWorker::post(const FrameRef& frame, std::shared_ptr<const DisplayInfo> primary) {
+    // 队列满说明工作线程落后了两帧以上，本帧对该显示器丢弃
+    bool has_frame = static_cast<bool>(frame);
+    if (!input_.push({frame, std::move(primary)})) {
+        if (has_frame) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    // 空的临界区保证唤醒不会丢失
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    cond_.notify_one();
+}
+
+void OutputWorker::run() {
+    LOG_INFO("Output worker for {} started", slot_->display.name);
+    
+    // 变换线程只绑定CPU，保持SCHED_OTHER，避免RGA回退到CPU复制时饿死捕获和呈现线程
+    std::string thread_name = "Transform " + slot_->display.name;
+    applyThreadScheduling(frame_copier_->getConfig().realtime, thread_name.c_str(), false);
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return stopping_ || input_.size() > 0; });
+            if (stopping_) {
+                break;
+            }
+        }
+
+        // 最新帧优先：跳过积压的旧帧
+        input_occupancy_.sample(input_.size());
+        StageFrame item;
+        StageFrame newer;
+        if (!input_.pop(item)) {
+            continue;
+        }
+        while (input_.pop(newer)) {
+            if (item.frame) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+            item = std::move(newer);
+        }
+
+        transformFrame(item);
+
+        // 每5分钟独立报告一次本显示器的帧率
+        auto now = std::chrono::steady_clock::now();
+        if (now - report_start_ >= std::chrono::seconds(300)) {
+            reportStats();
+        }
+    }
+
+    LOG_INFO("Output worker for {} stopped", slot_->display.name);
+}
+
+void OutputWorker::transformFrame(StageFrame& item) {
+    OutputSlot& slot = *slot_;
+    if (!item.primary) {
+        return;
+    }
+    ScopedTraceSpan trace_span(slot.stages.traceTrack(), item.frame ? "transform" : "mirror");
+    if (item.frame) {
+        trace_span.setFrame(item.frame.get()->sequence);
+    }
+
+    // 帧边界：锁存运行时修改的变换参数，处理重新校准请求
+    if (slot.settings_generation != frame_copier_->settingsGeneration()) {
+        frame_copier_->applySettings(slot);
+    }
+    if (slot.recalibrate.exchange(false, std::memory_order_relaxed)) {
+        frame_copier_->resetCalibration(slot);
+    }
+
+    // 零拷贝镜像的显示器直接跟随主显示器翻转，其余显示器走复制路径
+    uint32_t fb_id = 0;
+    if (frame_copier_->mirrorToDisplay(*item.primary, slot, fb_id)) {
+        needs_capture_.store(false, std::memory_order_relaxed);
+    } else {
+        needs_capture_.store(true, std::memory_order_relaxed);
+        if (item.frame) {
+            fb_id = frame_copier_->renderToDisplay(item.frame.buffer(), slot);
+        }
+    }
+
+    // 渲染完成后立即归还捕获缓冲区，不等待翻转
+    item.frame.reset();
+    if (!fb_id) {
+        return;
+    }
+
+    if (!rendered_.push(fb_id)) {
+        frame_copier_->discardFrame(slot, fb_id);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (on_rendered_) {
+        on_rendered_();
+    }
+}
+
+uint32_t OutputWorker::takeLatest() {
+    // 呈现线程落后时只提交最新的帧，更旧的帧归还交换链
+    rendered_occupancy_.sample(rendered_.size());
+    uint32_t fb_id = 0;
+    uint32_t newer = 0;
+    while (rendered_.pop(newer)) {
+        if (fb_id) {
+            frame_copier_->discardFrame(*slot_, fb_id);
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        fb_id = newer;
+    }
+    return fb_id;
+}
+
+void OutputWorker::onPresented(const PageFlipRequest& flip) {
+    frame_copier_->onFlipSubmitted(*slot_, flip);
+    if (flip.submitted) {
+        presented_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void OutputWorker::reportStats() {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - report_start_).count();
+    uint64_t presented = presented_.load(std::memory_order_relaxed);
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+
+    uint64_t flips, max_interval_us, stalls;
+    double jitter_mean_us, jitter_stddev_us;
+    {
+        std::lock_guard<std::mutex> lock(slot_->mutex);
+        flips = slot_->stats.flips;
+        max_interval_us = slot_->stats.max_interval_us;
+        jitter_mean_us = slot_->stats.vblank_jitter.meanUs();
+        jitter_stddev_us = slot_->stats.vblank_jitter.stddevUs();
+        slot_->stats.vblank_jitter.reset();
+        stalls = slot_->swapchain.starvationStalls();
+    }
+
+    LOG_INFO("{}{}: {:.1f} FPS (avg over {:.0f}s), {} dropped frames, {} flips, {} buffer starvation stalls ({} buffers), max vblank interval {} us",
+             slot_->display.name, slot_->mirror.active ? " (zero-copy)" : "",
+             (presented - presented_start_) / seconds, seconds, dropped - dropped_start_,
+             flips, stalls, slot_->swapchain.depth(), max_interval_us);
+    LOG_INFO("  {} flip interval: mean {:.0f} us, jitter (stddev) {:.0f} us",
+             slot_->display.name, jitter_mean_us, jitter_stddev_us);
+    LOG_INFO("  {} queue occupancy: transform avg {:.2f} (max {}), present avg {:.2f} (max {}) of {}",
+             slot_->display.name, input_occupancy_.average(), input_occupancy_.peak.load(),
+             rendered_occupancy_.average(), rendered_occupancy_.peak.load(), input_.capacity());
+    slot_->stages.report(slot_->display.name, true);
+
+    report_start_ = now;
+    presented_start_ = presented;
+    dropped_start_ = dropped;
+}
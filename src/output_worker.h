@@ -0,0 +1,76 @@
+#pragma once
+
+#include "drm_manager.h"
+#include "frame_copier.h"
+#include "frame_pool.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// 流水线的变换级：每个副显示器一个工作线程，慢的显示器不会拖慢其他显示器
+// 捕获线程 -> (SPSC队列) -> 工作线程渲染 -> (SPSC队列) -> 呈现线程统一提交翻转
+// 两个队列都是最新帧优先：积压的旧帧被跳过并计为丢帧
+class OutputWorker {
+public:
+    OutputWorker(std::shared_ptr<OutputSlot> slot, std::shared_ptr<FrameCopier> frame_copier,
+                 std::function<void()> on_rendered);
+    ~OutputWorker();
+
+    void start();
+    void stop();
+
+    // 捕获级投递新帧 (捕获线程调用，不阻塞)，frame为空时只跟随主显示器做零拷贝镜像
+    void post(const FrameRef& frame, std::shared_ptr<const DisplayInfo> primary);
+
+    // 呈现级取出最新渲染完成的帧 (呈现线程调用)，没有新帧时返回0
+    uint32_t takeLatest();
+    void onPresented(const PageFlipRequest& flip);
+
+    // 该显示器走复制路径，需要捕获线程捕获帧
+    bool needsCapture() const { return needs_capture_.load(std::memory_order_relaxed); }
+
+    // 累计提交和丢弃的帧数 (任意线程读取)
+    uint64_t presentedFrames() const { return presented_.load(std::memory_order_relaxed); }
+    uint64_t droppedFrames() const { return dropped_.load(std::memory_order_relaxed); }
+
+    OutputSlot& slot() { return *slot_; }
+    uint32_t connectorId() const { return slot_->display.connector_id; }
+
+private:
+    struct StageFrame {
+        FrameRef frame;
+        std::shared_ptr<const DisplayInfo> primary;
+    };
+
+    std::shared_ptr<OutputSlot> slot_;
+    std::shared_ptr<FrameCopier> frame_copier_;
+    std::function<void()> on_rendered_;           // 通知呈现线程
+
+    SpscQueue<StageFrame, 2> input_;               // 捕获线程 -> 工作线程
+    SpscQueue<uint32_t, 2> rendered_;              // 工作线程 -> 呈现线程 (framebuffer ID)
+    StageOccupancy input_occupancy_;
+    StageOccupancy rendered_occupancy_;
+
+    std::thread thread_;
+    std::mutex mutex_;                             // 只用于休眠/唤醒，数据通过队列传递
+    std::condition_variable cond_;
+    bool stopping_;
+
+    std::atomic<bool> needs_capture_;
+    std::atomic<uint64_t> presented_;
+    std::atomic<uint64_t> dropped_;                // 各级因最新帧优先或队列满而丢弃的帧
+
+    // 以下只由工作线程访问
+    std::chrono::steady_clock::time_point report_start_;
+    uint64_t presented_start_;
+    uint64_t dropped_start_;
+
+    void run();
+    void transformFrame(StageFrame& item);
+    void reportStats();
+};
@@ -0,0 +1,174 @@
+#include "realtime.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+
+// 实时线程预先触碰的栈大小
+static const size_t kPrefaultStackBytes = 256 * 1024;
+
+bool parseCpuList(const std::string& value, RealtimeConfig& config) {
+    config.cpus.clear();
+    if (value == "all") {
+        config.pin_big_cores = false;
+        return true;
+    }
+
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int first = 0, last = 0;
+        char dash = 0;
+        std::stringstream range(item);
+        if (!(range >> first)) {
+            return false;
+        }
+        last = first;
+        if (range >> dash) {
+            if (dash != '-' || !(range >> last) || last < first) {
+                return false;
+            }
+        }
+        if (first < 0 || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            config.cpus.push_back(cpu);
+        }
+    }
+    return !config.cpus.empty();
+}
+
+std::string formatCpuList(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return "all";
+    }
+    std::string result;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        if (i) {
+            result += ",";
+        }
+        result += std::to_string(cpus[i]);
+    }
+    return result;
+}
+
+std::vector<int> detectBigCores() {
+    std::vector<std::pair<int, int>> capacities;  // (cpu, capacity)
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    for (int cpu = 0; cpu < count; cpu++) {
+        std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpu_capacity");
+        int capacity = 0;
+        if (file >> capacity) {
+            capacities.push_back({cpu, capacity});
+        }
+    }
+
+    std::vector<int> big;
+    if (capacities.empty()) {
+        return big;
+    }
+
+    auto by_capacity = [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+        return a.second < b.second;
+    };
+    int max_capacity = std::max_element(capacities.begin(), capacities.end(), by_capacity)->second;
+    int min_capacity = std::min_element(capacities.begin(), capacities.end(), by_capacity)->second;
+    if (max_capacity == min_capacity) {
+        return big;
+    }
+
+    for (const auto& [cpu, capacity] : capacities) {
+        if (capacity == max_capacity) {
+            big.push_back(cpu);
+        }
+    }
+    return big;
+}
+
+std::vector<int> resolveCpus(const RealtimeConfig& config) {
+    if (!config.cpus.empty()) {
+        return config.cpus;
+    }
+    return config.pin_big_cores ? detectBigCores() : std::vector<int>();
+}
+
+static void prefaultStack() {
+    // 栈在MCL_FUTURE下也只在首次访问时分配，提前触碰避免热路径上的缺页
+    volatile char stack[kPrefaultStackBytes];
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    for (size_t i = 0; i < sizeof(stack); i += page) {
+        stack[i] = 0;
+    }
+}
+
+void applyThreadScheduling(const RealtimeConfig& config, const char* thread_name, bool realtime) {
+    std::vector<int> cpus = resolveCpus(config);
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &set);
+        }
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret) {
+            LOG_WARN("Failed to pin {} thread to CPUs {}: {}", thread_name, formatCpuList(cpus), strerror(ret));
+        }
+    }
+
+    if (realtime && config.priority > 0) {
+        sched_param param = {};
+        param.sched_priority = std::clamp(config.priority, sched_get_priority_min(SCHED_FIFO),
+                                          sched_get_priority_max(SCHED_FIFO));
+        int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret) {
+            LOG_WARN("Failed to set SCHED_FIFO priority {} for {} thread: {}",
+                     param.sched_priority, thread_name, strerror(ret));
+            realtime = false;
+        }
+    } else {
+        realtime = false;
+    }
+
+    if (config.lock_memory) {
+        prefaultStack();
+    }
+
+    LOG_INFO("{} thread: {}, CPUs {}", thread_name,
+             realtime ? "SCHED_FIFO priority " + std::to_string(config.priority) : std::string("SCHED_OTHER"),
+             formatCpuList(cpus));
+}
+
+bool lockProcessMemory() {
+    // MCL_CURRENT立即映射所有现有页，MCL_FUTURE使之后分配的缓冲区在分配时即被映射
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        LOG_WARN("mlockall failed: {} (check RLIMIT_MEMLOCK / CAP_IPC_LOCK)", strerror(errno));
+        return false;
+    }
+    LOG_INFO("Process memory locked");
+    return true;
+}
+
+void IntervalJitter::add(uint64_t interval_us) {
+    count_++;
+    double delta = interval_us - mean_;
+    mean_ += delta / count_;
+    m2_ += delta * (interval_us - mean_);
+    min_ = std::min(min_, interval_us);
+    max_ = std::max(max_, interval_us);
+}
+
+void IntervalJitter::reset() {
+    *this = IntervalJitter();
+}
+
+double IntervalJitter::stddevUs() const {
+    return count_ > 1 ? std::sqrt(m2_ / (count_ - 1)) : 0.0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 复制路径线程的实时调度配置
+struct RealtimeConfig {
+    int priority = 0;                 // SCHED_FIFO优先级 (1-99)，0表示保持SCHED_OTHER
+    bool pin_big_cores = true;        // cpus为空时绑定到容量最大的核心 (RK3588上为A76集群)
+    std::vector<int> cpus;            // 显式指定的CPU列表
+    bool lock_memory = false;         // mlockall并预先触碰线程栈，避免热路径上的缺页
+};
+
+// 解析"4-7"、"4,5,6"或"all"形式的CPU列表 ("all"表示不绑定)
+bool parseCpuList(const std::string& value, RealtimeConfig& config);
+std::string formatCpuList(const std::vector<int>& cpus);
+
+// 根据/sys/devices/system/cpu/cpu*/cpu_capacity找出大核，所有核心相同时返回空
+std::vector<int> detectBigCores();
+
+// 实际生效的CPU列表 (可能为空，表示不绑定)
+std::vector<int> resolveCpus(const RealtimeConfig& config);
+
+// 对调用线程应用调度策略和CPU亲和性，失败 (通常是缺少CAP_SYS_NICE) 时记录警告并继续运行
+// realtime为false时只设置亲和性
+void applyThreadScheduling(const RealtimeConfig& config, const char* thread_name, bool realtime);
+
+// 锁定进程的当前和将来的内存 (缓冲区在分配时即被预先映射)
+bool lockProcessMemory();
+
+// 帧间隔抖动统计 (Welford算法，不保存样本)
+class IntervalJitter {
+public:
+    void add(uint64_t interval_us);
+    void reset();
+
+    uint64_t count() const { return count_; }
+    double meanUs() const { return mean_; }
+    double stddevUs() const;
+    uint64_t minUs() const { return count_ ? min_ : 0; }
+    uint64_t maxUs() const { return max_; }
+
+private:
+    uint64_t count_ = 0;
+    double mean_ = 0.0;
+    double m2_ = 0.0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
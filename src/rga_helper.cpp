@@ -3,7 +3,12 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <linux/udmabuf.h>
 #include <cstring>
+#include <cerrno>
 #include <iostream>
 
 #ifdef HAVE_RGA
@@ -56,10 +61,42 @@ rga_buffer_t wrapbuffer_handle(rga_buffer_handle_t handle, int width, int height
     buffer.format = format;
     return buffer;
 }
+
+rga_buffer_t wrapbuffer_handle(rga_buffer_handle_t handle, int width, int height, int wstride, int hstride, int format) {
+    rga_buffer_t buffer = wrapbuffer_handle(handle, width, height, format);
+    buffer.wstride = wstride;
+    buffer.hstride = hstride;
+    return buffer;
+}
 #endif
 
+namespace {
+
+// dma-heap设备按优先级排列：system堆带CPU缓存，cma堆物理连续
+const char* const kDmaHeapPaths[] = {
+    "/dev/dma_heap/system",
+    "/dev/dma_heap/cma",
+    "/dev/dma_heap/linux,cma",
+};
+
+size_t pageAlign(size_t size) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (size + page - 1) & ~(page - 1);
+}
+
+} // namespace
+
+const char* bufferBackendName(BufferBackend backend) {
+    switch (backend) {
+        case BufferBackend::DMA_HEAP: return "dma-heap";
+        case BufferBackend::UDMABUF:  return "udmabuf";
+        default:                      return "anonymous";
+    }
+}
+
 RGAHelper::RGAHelper() 
-    : rga_initialized_(false) {
+    : rga_initialized_(false), dma_heap_fd_(-1), udmabuf_fd_(-1),
+      backend_(BufferBackend::ANONYMOUS) {
 }
 
 RGAHelper::~RGAHelper() {
@@ -72,73 +109,103 @@ bool RGAHelper::initialize() {
     }
     
     // IM2D API不需要显式初始化
+    openAllocators();
+    
     rga_initialized_ = true;
-    LOG_INFO("RGA IM2D helper initialized successfully");
+    LOG_INFO("RGA IM2D helper initialized successfully (buffer backend: {})",
+             bufferBackendName(backend_));
     return true;
 }
 
+bool RGAHelper::openAllocators() {
+    for (const char* path : kDmaHeapPaths) {
+        dma_heap_fd_ = open(path, O_RDWR | O_CLOEXEC);
+        if (dma_heap_fd_ >= 0) {
+            LOG_INFO("Using dma-heap {} for intermediate buffers", path);
+            backend_ = BufferBackend::DMA_HEAP;
+            break;
+        }
+    }
+    
+    // udmabuf 作为后备，普通Linux开发机上也可用
+    udmabuf_fd_ = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if (backend_ != BufferBackend::DMA_HEAP && udmabuf_fd_ >= 0) {
+        LOG_INFO("Using memfd + udmabuf for intermediate buffers");
+        backend_ = BufferBackend::UDMABUF;
+    }
+    
+    if (backend_ == BufferBackend::ANONYMOUS) {
+        LOG_WARN("No dma-heap or udmabuf available, intermediate buffers are not DMA-capable");
+    }
+    return backend_ != BufferBackend::ANONYMOUS;
+}
+
 void RGAHelper::cleanup() {
     if (!rga_initialized_) {
         return;
     }
     
     // IM2D API不需要显式清理
+    if (dma_heap_fd_ >= 0) {
+        close(dma_heap_fd_);
+        dma_heap_fd_ = -1;
+    }
+    if (udmabuf_fd_ >= 0) {
+        close(udmabuf_fd_);
+        udmabuf_fd_ = -1;
+    }
+    backend_ = BufferBackend::ANONYMOUS;
+    
     rga_initialized_ = false;
 }
 
 bool RGAHelper::scaleAndCopy(const FrameBuffer& src, FrameBuffer& dst,
                             uint32_t src_x, uint32_t src_y, uint32_t src_w, uint32_t src_h,
                             uint32_t dst_x, uint32_t dst_y, uint32_t dst_w, uint32_t dst_h,
-                            int rotation_degrees) {
+                            int rotation_degrees, StageHistograms* stages) {
     if (!rga_initialized_) {
         LOG_ERROR("RGA not initialized");
         return false;
     }
     
-    // 强制内存同步，确保源数据是最新的
-    if (src.virtual_addr) {
+    // 匿名内存没有dma-buf同步语义，只能强制刷新
+    if (src.dma_fd < 0 && src.virtual_addr) {
         msync(src.virtual_addr, src.size, MS_SYNC);
         __sync_synchronize(); // 内存屏障
     }
     
     // 每次重新创建源和目标RGA buffer以确保获取最新数据
-    rga_buffer_handle_t src_handle, dst_handle;
-    
-    // 优先使用virtual address，确保获取最新内容
-    if (src.virtual_addr) {
-        src_handle = importbuffer_virtualaddr(src.virtual_addr, src.width, src.height, 
-                                            drmFormatToRgaFormat(src.format));
-    } else if (src.dma_fd >= 0) {
-        src_handle = importbuffer_fd(src.dma_fd, src.width, src.height, 
-                                   drmFormatToRgaFormat(src.format));
-    } else {
+    // 优先使用dma-buf fd实现零拷贝，缓存一致性由DMA_BUF_IOCTL_SYNC保证
+    ScopedStageTimer import_timer(stages, PipelineStage::IMPORT);
+    rga_buffer_handle_t src_handle = importFrameBuffer(src);
+    if (!src_handle) {
         LOG_ERROR("Invalid source buffer: no valid handle");
         return false;
     }
-    
-    if (dst.virtual_addr) {
-        dst_handle = importbuffer_virtualaddr(dst.virtual_addr, dst.width, dst.height, 
-                                            drmFormatToRgaFormat(dst.format));
-    } else if (dst.dma_fd >= 0) {
-        dst_handle = importbuffer_fd(dst.dma_fd, dst.width, dst.height, 
-                                   drmFormatToRgaFormat(dst.format));
-    } else {
+    rga_buffer_handle_t dst_handle = importFrameBuffer(dst);
+    if (!dst_handle) {
         LOG_ERROR("Invalid destination buffer: no valid handle");
         releasebuffer_handle(src_handle);
         return false;
     }
     
-    // 包装为RGA buffers
-    rga_buffer_t src_rga = wrapbuffer_handle(src_handle, src.width, src.height, 
+    // 包装为RGA buffers (GBM填充的行距和NV12的UV偏移都通过wstride/hstride传给RGA)
+    int src_wstride, src_hstride, dst_wstride, dst_hstride;
+    rgaStrides(src, src_wstride, src_hstride);
+    rgaStrides(dst, dst_wstride, dst_hstride);
+    rga_buffer_t src_rga = wrapbuffer_handle(src_handle, src.width, src.height, src_wstride, src_hstride,
                                            drmFormatToRgaFormat(src.format));
-    rga_buffer_t dst_rga = wrapbuffer_handle(dst_handle, dst.width, dst.height, 
+    rga_buffer_t dst_rga = wrapbuffer_handle(dst_handle, dst.width, dst.height, dst_wstride, dst_hstride,
                                            drmFormatToRgaFormat(dst.format));
     
     // 设置源和目标区域
     im_rect src_rect = {(int)src_x, (int)src_y, (int)src_w, (int)src_h};
     im_rect dst_rect = {(int)dst_x, (int)dst_y, (int)dst_w, (int)dst_h};
     
+    import_timer.stop();
+    
     // 配置旋转参数
+    ScopedStageTimer blit_timer(stages, PipelineStage::BLIT);
     IM_STATUS ret;
     if (rotation_degrees == 90) {
         ret = imrotate(src_rga, dst_rga, 1);
@@ -155,17 +222,19 @@ bool RGAHelper::scaleAndCopy(const FrameBuffer& src, FrameBuffer& dst,
         return false;
     }
     
+    blit_timer.stop();
+    
     // 释放handles
     releasebuffer_handle(src_handle);
     releasebuffer_handle(dst_handle);
     
     if (ret != IM_STATUS_SUCCESS) {
-        LOG_ERROR("IM2D operation failed: {} (rotation: {}°)", ret, rotation_degrees);
+        LOG_EVERY_MS(ERROR, 1000, "IM2D operation failed: {} (rotation: {}°)", ret, rotation_degrees);
         return false;
     }
     
     // 强制同步目标缓冲区
-    if (dst.virtual_addr) {
+    if (dst.dma_fd < 0 && dst.virtual_addr) {
         msync(dst.virtual_addr, dst.size, MS_SYNC);
         __sync_synchronize();
     }
@@ -186,7 +255,7 @@ bool RGAHelper::copy(const FrameBuffer& src, FrameBuffer& dst) {
     // 使用IM2D API进行复制
     IM_STATUS ret = imcopy(src_rga, dst_rga);
     if (ret != IM_STATUS_SUCCESS) {
-        LOG_ERROR("IM2D copy failed: {}", ret);
+        LOG_EVERY_MS(ERROR, 1000, "IM2D copy failed: {}", ret);
         return false;
     }
     
@@ -197,11 +266,92 @@ bool RGAHelper::allocateBuffer(FrameBuffer& buffer, uint32_t width, uint32_t hei
     // 计算缓冲区大小和步长
     uint32_t bpp = 4; // 假设RGBA格式，4字节每像素
     buffer.stride = width * bpp;
+    buffer.height_stride = height;
     buffer.size = buffer.stride * height;
     buffer.width = width;
     buffer.height = height;
     buffer.format = format;
+    buffer.virtual_addr = nullptr;
+    buffer.dma_fd = -1;
+    buffer.physical_addr = 0;
+    
+    // 按优先级尝试：dma-heap -> memfd+udmabuf -> 匿名内存
+    if (dma_heap_fd_ >= 0 && allocateFromDmaHeap(buffer)) {
+        return true;
+    }
+    if (udmabuf_fd_ >= 0 && allocateFromUdmabuf(buffer)) {
+        return true;
+    }
+    return allocateAnonymous(buffer);
+}
+
+bool RGAHelper::allocateFromDmaHeap(FrameBuffer& buffer) {
+    struct dma_heap_allocation_data alloc = {};
+    alloc.len = pageAlign(buffer.size);
+    alloc.fd_flags = O_RDWR | O_CLOEXEC;
+    
+    if (ioctl(dma_heap_fd_, DMA_HEAP_IOCTL_ALLOC, &alloc) < 0) {
+        LOG_WARN("dma-heap allocation of {} bytes failed: {}", alloc.len, strerror(errno));
+        return false;
+    }
+    
+    int fd = static_cast<int>(alloc.fd);
+    void* addr = mmap(nullptr, alloc.len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        LOG_WARN("Failed to map dma-heap buffer: {}", strerror(errno));
+        close(fd);
+        return false;
+    }
+    
+    buffer.dma_fd = fd;
+    buffer.virtual_addr = addr;
+    return true;
+}
+
+bool RGAHelper::allocateFromUdmabuf(FrameBuffer& buffer) {
+    size_t len = pageAlign(buffer.size);
+    
+    int memfd = memfd_create("rk3588-frame", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        LOG_WARN("memfd_create failed: {}", strerror(errno));
+        return false;
+    }
+    
+    // udmabuf要求memfd大小固定 (F_SEAL_SHRINK)
+    if (ftruncate(memfd, len) < 0 || fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        LOG_WARN("Failed to prepare memfd for udmabuf: {}", strerror(errno));
+        close(memfd);
+        return false;
+    }
+    
+    struct udmabuf_create create = {};
+    create.memfd = memfd;
+    create.flags = UDMABUF_FLAGS_CLOEXEC;
+    create.offset = 0;
+    create.size = len;
+    
+    int fd = ioctl(udmabuf_fd_, UDMABUF_CREATE, &create);
+    if (fd < 0) {
+        LOG_WARN("UDMABUF_CREATE failed: {}", strerror(errno));
+        close(memfd);
+        return false;
+    }
+    
+    // 映射memfd本身，页面与dma-buf共享；udmabuf持有memfd引用，可直接关闭
+    void* addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    close(memfd);
+    if (addr == MAP_FAILED) {
+        LOG_WARN("Failed to map udmabuf memory: {}", strerror(errno));
+        close(fd);
+        return false;
+    }
     
+    buffer.dma_fd = fd;
+    buffer.virtual_addr = addr;
+    return true;
+}
+
+bool RGAHelper::allocateAnonymous(FrameBuffer& buffer) {
     // 分配内存
     buffer.virtual_addr = mmap(nullptr, buffer.size, PROT_READ | PROT_WRITE,
                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
@@ -212,7 +362,7 @@ bool RGAHelper::allocateBuffer(FrameBuffer& buffer, uint32_t width, uint32_t hei
         return false;
     }
     
-    // 对于RGA，我们需要DMA缓冲区，这里简化处理
+    // 匿名内存没有dma-buf，RGA只能通过虚拟地址导入
     buffer.dma_fd = -1;
     buffer.physical_addr = 0;
     
@@ -221,7 +371,7 @@ bool RGAHelper::allocateBuffer(FrameBuffer& buffer, uint32_t width, uint32_t hei
 
 void RGAHelper::freeBuffer(FrameBuffer& buffer) {
     if (buffer.virtual_addr && buffer.virtual_addr != MAP_FAILED) {
-        munmap(buffer.virtual_addr, buffer.size);
+        munmap(buffer.virtual_addr, buffer.dma_fd >= 0 ? pageAlign(buffer.size) : buffer.size);
         buffer.virtual_addr = nullptr;
     }
     
@@ -237,6 +387,30 @@ void RGAHelper::freeBuffer(FrameBuffer& buffer) {
     buffer.physical_addr = 0;
 }
 
+void RGAHelper::beginCpuAccess(const FrameBuffer& buffer, bool write) {
+    if (buffer.dma_fd < 0) {
+        return;
+    }
+    
+    struct dma_buf_sync sync = {};
+    sync.flags = DMA_BUF_SYNC_START | (write ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ);
+    while (ioctl(buffer.dma_fd, DMA_BUF_IOCTL_SYNC, &sync) < 0 && 
+           (errno == EINTR || errno == EAGAIN)) {
+    }
+}
+
+void RGAHelper::endCpuAccess(const FrameBuffer& buffer, bool write) {
+    if (buffer.dma_fd < 0) {
+        return;
+    }
+    
+    struct dma_buf_sync sync = {};
+    sync.flags = DMA_BUF_SYNC_END | (write ? DMA_BUF_SYNC_RW : DMA_BUF_SYNC_READ);
+    while (ioctl(buffer.dma_fd, DMA_BUF_IOCTL_SYNC, &sync) < 0 && 
+           (errno == EINTR || errno == EAGAIN)) {
+    }
+}
+
 uint32_t RGAHelper::drmFormatToRgaFormat(uint32_t drm_format) {
     // 使用GBM格式常量代替DRM格式常量
     switch (drm_format) {
@@ -269,19 +443,52 @@ uint32_t RGAHelper::drmFormatToRgaFormat(uint32_t drm_format) {
     }
 }
 
-rga_buffer_t RGAHelper::createRgaBuffer(const FrameBuffer& fb) {
-    rga_buffer_handle_t handle;
-    
+void RGAHelper::rgaStrides(const FrameBuffer& fb, int& wstride, int& hstride) {
+    // NV12的行距是Y plane每行的字节数，即每像素1字节
+    uint32_t bytes_per_pixel;
+    switch (fb.format) {
+        case 0x36314752:  // DRM_FORMAT_RGB565
+            bytes_per_pixel = 2;
+            break;
+        case 0x33524742:  // DRM_FORMAT_RGB888
+        case 0x33524247:  // DRM_FORMAT_BGR888
+            bytes_per_pixel = 3;
+            break;
+        case 0x3231564e:  // DRM_FORMAT_NV12
+        case 0x3132564e:  // DRM_FORMAT_NV21
+            bytes_per_pixel = 1;
+            break;
+        default:
+            bytes_per_pixel = 4;
+            break;
+    }
+    wstride = fb.stride ? fb.stride / bytes_per_pixel : fb.width;
+    hstride = fb.height_stride ? fb.height_stride : fb.height;
+}
+
+rga_buffer_handle_t RGAHelper::importFrameBuffer(const FrameBuffer& fb) {
+    // 按行距和行数导入，填充部分也在导入范围内
+    int wstride, hstride;
+    rgaStrides(fb, wstride, hstride);
     if (fb.dma_fd >= 0) {
-        handle = importbuffer_fd(fb.dma_fd, fb.width, fb.height, drmFormatToRgaFormat(fb.format));
-    } else if (fb.virtual_addr) {
-        handle = importbuffer_virtualaddr(fb.virtual_addr, fb.width, fb.height, drmFormatToRgaFormat(fb.format));
-    } else {
+        return importbuffer_fd(fb.dma_fd, wstride, hstride, drmFormatToRgaFormat(fb.format));
+    }
+    if (fb.virtual_addr) {
+        return importbuffer_virtualaddr(fb.virtual_addr, wstride, hstride, drmFormatToRgaFormat(fb.format));
+    }
+    return 0;
+}
+
+rga_buffer_t RGAHelper::createRgaBuffer(const FrameBuffer& fb) {
+    rga_buffer_handle_t handle = importFrameBuffer(fb);
+    if (!handle) {
         std::cerr << "Invalid frame buffer: no valid handle" << std::endl;
         return {};
     }
     
-    return wrapbuffer_handle(handle, fb.width, fb.height, drmFormatToRgaFormat(fb.format));
+    int wstride, hstride;
+    rgaStrides(fb, wstride, hstride);
+    return wrapbuffer_handle(handle, fb.width, fb.height, wstride, hstride, drmFormatToRgaFormat(fb.format));
 }
 
 rga_buffer_t RGAHelper::createRgaBuffer(const FrameBuffer& fb, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "stage_timing.h"
 #include <cstdint>
 #include <memory>
 
@@ -19,6 +20,7 @@ rga_buffer_handle_t importbuffer_fd(int fd, int width, int height, int format);
 rga_buffer_handle_t importbuffer_virtualaddr(void* va, int width, int height, int format);
 IM_STATUS releasebuffer_handle(rga_buffer_handle_t handle);
 rga_buffer_t wrapbuffer_handle(rga_buffer_handle_t handle, int width, int height, int format);
+rga_buffer_t wrapbuffer_handle(rga_buffer_handle_t handle, int width, int height, int wstride, int hstride, int format);
 #endif
 
 struct FrameBuffer {
@@ -27,11 +29,21 @@ struct FrameBuffer {
     int dma_fd;
     uint32_t width;
     uint32_t height;
-    uint32_t stride;
+    uint32_t stride;         // 行距 (字节)，GBM可能按对齐要求填充
+    uint32_t height_stride;  // 分配的行数 (NV12时UV plane从第height_stride行开始)，0表示等于height
     uint32_t format;
     uint32_t size;
 };
 
+// 中间缓冲区的内存来源
+enum class BufferBackend {
+    DMA_HEAP,   // /dev/dma_heap/{system,cma}
+    UDMABUF,    // memfd + /dev/udmabuf
+    ANONYMOUS   // 普通匿名内存，RGA/KMS无法直接访问
+};
+
+const char* bufferBackendName(BufferBackend backend);
+
 class RGAHelper {
 public:
     RGAHelper();
@@ -40,25 +52,44 @@ public:
     bool initialize();
     void cleanup();
     
-    // 缩放和格式转换 - 使用IM2D API
+    // 缩放和格式转换 - 使用IM2D API，stages非空时记录导入和blit的耗时
     bool scaleAndCopy(const FrameBuffer& src, FrameBuffer& dst, 
                      uint32_t src_x, uint32_t src_y, uint32_t src_w, uint32_t src_h,
                      uint32_t dst_x, uint32_t dst_y, uint32_t dst_w, uint32_t dst_h,
-                     int rotation_degrees = 0);
+                     int rotation_degrees = 0, StageHistograms* stages = nullptr);
     
     // 简单复制
     bool copy(const FrameBuffer& src, FrameBuffer& dst);
     
-    // 分配DMA缓冲区
+    // 分配DMA缓冲区 (dma-heap -> udmabuf -> 匿名内存)
     bool allocateBuffer(FrameBuffer& buffer, uint32_t width, uint32_t height, uint32_t format);
     void freeBuffer(FrameBuffer& buffer);
     
+    // CPU访问dma-buf前后的缓存同步 (DMA_BUF_IOCTL_SYNC)
+    void beginCpuAccess(const FrameBuffer& buffer, bool write);
+    void endCpuAccess(const FrameBuffer& buffer, bool write);
+    
+    BufferBackend getBufferBackend() const { return backend_; }
+    
     // 格式转换
     uint32_t drmFormatToRgaFormat(uint32_t drm_format);
     
 private:
     bool rga_initialized_;
     
+    int dma_heap_fd_;   // 打开的dma-heap设备
+    int udmabuf_fd_;    // /dev/udmabuf
+    BufferBackend backend_;
+    
+    bool openAllocators();
+    bool allocateFromDmaHeap(FrameBuffer& buffer);
+    bool allocateFromUdmabuf(FrameBuffer& buffer);
+    bool allocateAnonymous(FrameBuffer& buffer);
+    
+    // 按缓冲区实际的行距和行数导入/包装 (wstride、hstride以像素和行为单位)，返回0表示失败
+    static void rgaStrides(const FrameBuffer& fb, int& wstride, int& hstride);
+    rga_buffer_handle_t importFrameBuffer(const FrameBuffer& fb);
+    
     // 创建RGA buffer
     rga_buffer_t createRgaBuffer(const FrameBuffer& fb);
     rga_buffer_t createRgaBuffer(const FrameBuffer& fb, uint32_t x, uint32_t y, uint32_t w, uint32_t h);
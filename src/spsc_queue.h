@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// 有界无锁单生产者单消费者队列，连接流水线的相邻两级
+// push只能在生产者线程调用，pop只能在消费者线程调用；满时push失败由调用者决定丢弃策略
+template <typename T, size_t Capacity>
+class SpscQueue {
+public:
+    bool push(T item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % kSlots;
+        if (next == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        items_[tail] = std::move(item);
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(items_[head]);
+        items_[head] = T();
+        head_.store((head + 1) % kSlots, std::memory_order_release);
+        return true;
+    }
+
+    // 近似的占用数，只用于统计
+    size_t size() const {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return (tail + kSlots - head) % kSlots;
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    static constexpr size_t kSlots = Capacity + 1;  // 留一个空位区分满和空
+
+    T items_[kSlots];
+    alignas(64) std::atomic<size_t> head_{0};  // 消费者位置
+    alignas(64) std::atomic<size_t> tail_{0};  // 生产者位置
+};
+
+// 流水线一级的输入队列占用统计，由该级的消费者采样，报告线程读取
+struct StageOccupancy {
+    std::atomic<uint64_t> samples{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> peak{0};
+
+    void sample(size_t depth) {
+        samples.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(depth, std::memory_order_relaxed);
+        if (depth > peak.load(std::memory_order_relaxed)) {
+            peak.store(depth, std::memory_order_relaxed);
+        }
+    }
+
+    double average() const {
+        uint64_t n = samples.load(std::memory_order_relaxed);
+        return n ? (double)total.load(std::memory_order_relaxed) / n : 0.0;
+    }
+};
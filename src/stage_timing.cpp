@@ -0,0 +1,98 @@
+#include "stage_timing.h"
+#include "logger.h"
+
+const char* pipelineStageName(PipelineStage stage) {
+    switch (stage) {
+        case PipelineStage::VBLANK_WAIT:   return "vblank wait";
+        case PipelineStage::MAP:           return "fb map";
+        case PipelineStage::CAPTURE_COPY:  return "capture copy";
+        case PipelineStage::IMPORT:        return "rga import";
+        case PipelineStage::BLIT:          return "rga blit";
+        case PipelineStage::CPU_FALLBACK:  return "cpu fallback";
+        case PipelineStage::FLIP_SUBMIT:   return "flip submit";
+        case PipelineStage::FLIP_COMPLETE: return "flip complete";
+        default:                           return "unknown";
+    }
+}
+
+LatencyHistogram::LatencyHistogram() : sum_us_(0), max_us_(0) {
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t us) {
+    if (us < kLinearBuckets) {
+        return us;
+    }
+    // 最高位决定指数，其后的kSubBucketBits位决定子桶
+    size_t msb = 63 - __builtin_clzll(us);
+    size_t sub = (us >> (msb - kSubBucketBits)) & ((1 << kSubBucketBits) - 1);
+    size_t index = kLinearBuckets + (msb - 4) * (1 << kSubBucketBits) + sub;
+    return index < kBuckets ? index : kBuckets - 1;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    if (index < kLinearBuckets) {
+        return index;
+    }
+    size_t offset = index - kLinearBuckets;
+    size_t msb = 4 + (offset >> kSubBucketBits);
+    uint64_t sub = offset & ((1 << kSubBucketBits) - 1);
+    uint64_t lower = ((1ULL << kSubBucketBits) + sub) << (msb - kSubBucketBits);
+    return lower + (1ULL << (msb - kSubBucketBits)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t us) {
+    buckets_[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = max_us_.load(std::memory_order_relaxed);
+    while (us > max && !max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot(bool reset) {
+    Snapshot result;
+    for (size_t i = 0; i < kBuckets; i++) {
+        result.buckets[i] = reset ? buckets_[i].exchange(0, std::memory_order_relaxed)
+                                  : buckets_[i].load(std::memory_order_relaxed);
+        result.count += result.buckets[i];
+    }
+    // 计数以桶为准，与总和/最大值之间可能差几个并发写入的样本
+    result.sum_us = reset ? sum_us_.exchange(0, std::memory_order_relaxed)
+                          : sum_us_.load(std::memory_order_relaxed);
+    result.max_us = reset ? max_us_.exchange(0, std::memory_order_relaxed)
+                          : max_us_.load(std::memory_order_relaxed);
+    return result;
+}
+
+uint64_t LatencyHistogram::Snapshot::percentileUs(double p) const {
+    if (!count) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p * count + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = bucketUpperBound(i);
+            return (max_us && upper > max_us) ? max_us : upper;
+        }
+    }
+    return max_us;
+}
+
+void StageHistograms::report(const std::string& name, bool reset) {
+    for (size_t i = 0; i < histograms_.size(); i++) {
+        LatencyHistogram::Snapshot snapshot = histograms_[i].snapshot(reset);
+        if (!snapshot.count) {
+            continue;
+        }
+        LOG_INFO("  {} {}: p50 {} us, p99 {} us, max {} us, mean {:.0f} us ({} samples)",
+                 name, pipelineStageName((PipelineStage)i), snapshot.percentileUs(0.50),
+                 snapshot.percentileUs(0.99), snapshot.max_us, snapshot.meanUs(), snapshot.count);
+    }
+}
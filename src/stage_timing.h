@@ -0,0 +1,113 @@
+#pragma once
+
+#include "frame_trace.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 帧流水线的各个阶段
+enum class PipelineStage {
+    VBLANK_WAIT,     // 捕获节拍到DSI的vblank事件
+    MAP,             // 读取CRTC当前fb并映射 (GetCrtc/GetFB/MAP_DUMB/mmap)
+    CAPTURE_COPY,    // 从DSI framebuffer复制到捕获缓冲区
+    IMPORT,          // RGA导入源和目标缓冲区
+    BLIT,            // RGA缩放/旋转
+    CPU_FALLBACK,    // RGA失败时的CPU变换
+    FLIP_SUBMIT,     // 翻转提交 (atomic下所有显示器一次提交的耗时)
+    FLIP_COMPLETE,   // 提交到该帧开始扫描输出 (vblank时间戳)
+    COUNT
+};
+
+const char* pipelineStageName(PipelineStage stage);
+
+// 对数-线性直方图 (微秒)：16以下每个值一个桶，之后每个2的幂分8个桶，相对误差不超过12.5%
+// record只有几次relaxed原子操作，可以从任意线程调用；读取时不需要停止写入者
+class LatencyHistogram {
+public:
+    static constexpr size_t kLinearBuckets = 16;
+    static constexpr size_t kSubBucketBits = 3;
+    static constexpr size_t kMaxExponent = 24;  // 约16.7秒，更大的值计入最后一个桶
+    static constexpr size_t kBuckets =
+        kLinearBuckets + (kMaxExponent - 4) * (1 << kSubBucketBits);
+
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sum_us = 0;
+        uint64_t max_us = 0;
+        std::array<uint64_t, kBuckets> buckets{};
+
+        // 第p百分位所在桶的上界 (不超过最大值)
+        uint64_t percentileUs(double p) const;
+        double meanUs() const { return count ? (double)sum_us / count : 0.0; }
+    };
+
+    LatencyHistogram();
+
+    void record(uint64_t us);
+
+    // reset为true时读取的同时清零 (周期报告)，并发写入的样本计入下一个周期
+    Snapshot snapshot(bool reset);
+
+    static size_t bucketIndex(uint64_t us);
+    static uint64_t bucketUpperBound(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_;
+    std::atomic<uint64_t> sum_us_;
+    std::atomic<uint64_t> max_us_;
+};
+
+// 一个显示器的各阶段直方图
+class StageHistograms {
+public:
+    void record(PipelineStage stage, uint64_t us) { histograms_[(size_t)stage].record(us); }
+    LatencyHistogram::Snapshot snapshot(PipelineStage stage, bool reset) {
+        return histograms_[(size_t)stage].snapshot(reset);
+    }
+
+    // 输出有样本的阶段的p50/p99/max，reset为true时开始新的统计周期
+    void report(const std::string& name, bool reset);
+    
+    // 启用逐帧跟踪时，计时器的区间写入该轨道
+    void setTraceTrack(uint32_t track) { trace_track_ = track; }
+    uint32_t traceTrack() const { return trace_track_; }
+
+private:
+    std::array<LatencyHistogram, (size_t)PipelineStage::COUNT> histograms_;
+    uint32_t trace_track_ = 0;
+};
+
+// 作用域计时器：析构或stop()时把经过的时间记入直方图 (跟踪中时同时写入跟踪区间)，histograms为空时不计时
+class ScopedStageTimer {
+public:
+    ScopedStageTimer(StageHistograms* histograms, PipelineStage stage)
+        : histograms_(histograms), stage_(stage) {
+        if (histograms_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+    ~ScopedStageTimer() { stop(); }
+
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+    void stop() {
+        if (!histograms_) {
+            return;
+        }
+        auto end = std::chrono::steady_clock::now();
+        histograms_->record(stage_, std::chrono::duration_cast<std::chrono::microseconds>(end - start_).count());
+        if (FrameTrace::active()) {
+            FrameTrace::span(histograms_->traceTrack(), pipelineStageName(stage_), start_, end);
+        }
+        histograms_ = nullptr;
+    }
+
+private:
+    StageHistograms* histograms_;
+    PipelineStage stage_;
+    std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,88 @@
+#include "swapchain.h"
+
+Swapchain::Swapchain(std::vector<GBMBuffer> buffers)
+    : buffers_(std::move(buffers)) {
+}
+
+GBMBuffer* Swapchain::acquire() {
+    // 从上次的位置开始轮询，保证各缓冲区轮流使用
+    for (size_t i = 0; i < buffers_.size(); i++) {
+        GBMBuffer& buffer = buffers_[(next_index_ + i) % buffers_.size()];
+        if (buffer.state == BufferState::FREE) {
+            buffer.state = BufferState::RENDERING;
+            next_index_ = (next_index_ + i + 1) % buffers_.size();
+            return &buffer;
+        }
+    }
+    
+    starvation_stalls_++;
+    return nullptr;
+}
+
+void Swapchain::release(GBMBuffer* buffer) {
+    if (buffer && buffer->state == BufferState::RENDERING) {
+        buffer->state = BufferState::FREE;
+    }
+}
+
+void Swapchain::markQueued(GBMBuffer* buffer) {
+    if (buffer) {
+        buffer->state = BufferState::QUEUED;
+    }
+}
+
+void Swapchain::markScanout(uint32_t fb_id) {
+    for (auto& buffer : buffers_) {
+        if (buffer.fb_id == fb_id) {
+            buffer.state = BufferState::SCANOUT;
+        } else if (buffer.state == BufferState::SCANOUT) {
+            buffer.state = BufferState::FREE;
+        }
+    }
+}
+
+void Swapchain::releaseAll() {
+    for (auto& buffer : buffers_) {
+        buffer.state = BufferState::FREE;
+    }
+}
+
+void Swapchain::onFlipComplete(uint32_t fb_id, uint32_t released_fb_id) {
+    if (GBMBuffer* released = findByFb(released_fb_id)) {
+        released->state = BufferState::FREE;
+    }
+    if (GBMBuffer* shown = findByFb(fb_id)) {
+        shown->state = BufferState::SCANOUT;
+    }
+}
+
+GBMBuffer* Swapchain::getScanoutBuffer() {
+    for (auto& buffer : buffers_) {
+        if (buffer.state == BufferState::SCANOUT) {
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+size_t Swapchain::countInState(BufferState state) const {
+    size_t count = 0;
+    for (const auto& buffer : buffers_) {
+        if (buffer.state == state) {
+            count++;
+        }
+    }
+    return count;
+}
+
+GBMBuffer* Swapchain::findByFb(uint32_t fb_id) {
+    if (!fb_id) {
+        return nullptr;
+    }
+    for (auto& buffer : buffers_) {
+        if (buffer.fb_id == fb_id) {
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "rga_helper.h"
+#include <cstdint>
+#include <vector>
+#include <gbm.h>
+
+// 缓冲区状态：FREE -> RENDERING -> QUEUED -> SCANOUT -> FREE
+enum class BufferState {
+    FREE,       // 可以渲染
+    RENDERING,  // 正在被RGA/CPU写入
+    QUEUED,     // 已提交翻转，等待vblank
+    SCANOUT     // 正在被显示硬件扫描输出
+};
+
+struct GBMBuffer {
+    struct gbm_bo* bo;
+    uint32_t fb_id;
+    FrameBuffer frame_buffer;
+    bool valid;
+    BufferState state;
+    uint32_t pitches[4];   // 每个plane的步长 (NV12有两个plane)
+    uint32_t offsets[4];
+};
+
+// 单个显示器的N缓冲交换链，只管理缓冲区状态，分配和释放由FrameCopier负责
+class Swapchain {
+public:
+    Swapchain() = default;
+    explicit Swapchain(std::vector<GBMBuffer> buffers);
+    
+    // 取一个空闲缓冲区开始渲染，没有空闲缓冲区时返回nullptr并计入饥饿次数
+    GBMBuffer* acquire();
+    // 渲染失败，归还缓冲区
+    void release(GBMBuffer* buffer);
+    // 渲染完成并已提交翻转
+    void markQueued(GBMBuffer* buffer);
+    // modeset直接扫描输出 (不经过翻转)
+    void markScanout(uint32_t fb_id);
+    // 显示硬件不再使用任何缓冲区 (如切换到零拷贝镜像)
+    void releaseAll();
+    // 翻转完成：fb_id开始扫描输出，released_fb_id回到空闲状态
+    void onFlipComplete(uint32_t fb_id, uint32_t released_fb_id);
+    
+    GBMBuffer* getScanoutBuffer();
+    GBMBuffer* findByFb(uint32_t fb_id);
+    std::vector<GBMBuffer>& buffers() { return buffers_; }
+    
+    size_t depth() const { return buffers_.size(); }
+    size_t countInState(BufferState state) const;
+    uint64_t starvationStalls() const { return starvation_stalls_; }
+    
+private:
+    std::vector<GBMBuffer> buffers_;
+    size_t next_index_ = 0;
+    uint64_t starvation_stalls_ = 0;
+};
@@ -9,12 +9,37 @@
 #include <dirent.h>
 #include <fstream>
 #include <iostream>
+#include <climits>
+#include <cstring>
+#ifdef HAVE_SYSTEMD
+#include <systemd/sd-bus.h>
+#endif
 
+// systemctl get-default读取的位置，按优先级排列
+static const char* const kDefaultTargetPaths[] = {
+    "/etc/systemd/system/default.target",
+    "/run/systemd/system/default.target",
+    "/usr/local/lib/systemd/system/default.target",
+    "/usr/lib/systemd/system/default.target",
+    "/lib/systemd/system/default.target",
+};
+
+#ifdef HAVE_SYSTEMD
+SystemChecker::SystemChecker() : bus_(nullptr) {
+}
+
+SystemChecker::~SystemChecker() {
+    if (bus_) {
+        sd_bus_flush_close_unref(bus_);
+    }
+}
+#else
 SystemChecker::SystemChecker() {
 }
 
 SystemChecker::~SystemChecker() {
 }
+#endif
 
 bool SystemChecker::checkStartupConditions() {
     LOG_INFO("Checking system startup conditions...");
@@ -46,13 +71,7 @@ bool SystemChecker::isMultiUserTarget() {
     LOG_INFO("Current default target: {}", current_target);
     
     // 检查默认目标是否为multi-user.target
-    bool is_multi_user = (current_target.find("multi-user.target") != std::string::npos);
-    
-    // 还要检查当前运行级别
-    std::string active_target = executeCommand("systemctl get-default");
-    if (!active_target.empty() && active_target.find("multi-user.target") != std::string::npos) {
-        is_multi_user = true;
-    }
+    bool is_multi_user = (current_target == "multi-user.target");
     
     LOG_INFO("Multi-user target check: {}", is_multi_user ? "PASS" : "FAIL");
     return is_multi_user;
@@ -105,6 +124,7 @@ bool SystemChecker::hasDSIDisplay() {
     return found_dsi;
 }
 
+#ifndef HAVE_SYSTEMD
 std::string SystemChecker::executeCommand(const std::string& command) {
     std::array<char, 128> buffer;
     std::string result;
@@ -127,9 +147,44 @@ std::string SystemChecker::executeCommand(const std::string& command) {
     return result;
 }
 
+#endif
+
 bool SystemChecker::isUnitActive(const std::string& unit_name) {
+#ifdef HAVE_SYSTEMD
+    // 直接读取单元对象的ActiveState属性，未加载的单元也会返回inactive
+    if (!bus_) {
+        int ret = sd_bus_open_system(&bus_);
+        if (ret < 0) {
+            LOG_ERROR("Failed to connect to system bus: {}", strerror(-ret));
+            bus_ = nullptr;
+            return false;
+        }
+    }
+    
+    char* path = nullptr;
+    int ret = sd_bus_path_encode("/org/freedesktop/systemd1/unit", unit_name.c_str(), &path);
+    if (ret < 0) {
+        LOG_ERROR("Invalid unit name {}: {}", unit_name, strerror(-ret));
+        return false;
+    }
+    
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    char* state = nullptr;
+    ret = sd_bus_get_property_string(bus_, "org.freedesktop.systemd1", path,
+                                     "org.freedesktop.systemd1.Unit", "ActiveState", &error, &state);
+    free(path);
+    if (ret < 0) {
+        LOG_ERROR("Failed to query {} state: {}", unit_name, error.message ? error.message : strerror(-ret));
+        sd_bus_error_free(&error);
+        return false;
+    }
+    
+    std::string result = state;
+    free(state);
+#else
     std::string command = "systemctl is-active " + unit_name + " 2>/dev/null";
     std::string result = executeCommand(command);
+#endif
     
     bool is_active = (result == "active");
     LOG_DEBUG("Unit {} status: {}", unit_name, result);
@@ -137,10 +192,16 @@ bool SystemChecker::isUnitActive(const std::string& unit_name) {
 }
 
 std::string SystemChecker::getCurrentTarget() {
-    std::string result = executeCommand("systemctl get-default 2>/dev/null");
-    if (result.empty()) {
-        // 备用方法：检查当前运行的目标
-        result = executeCommand("systemctl list-units --type=target --state=active | grep -E '(multi-user|graphical)' | head -1 | awk '{print $1}'");
+    // 与systemctl get-default相同：第一个存在的default.target符号链接指向的单元
+    for (const char* path : kDefaultTargetPaths) {
+        char target[PATH_MAX];
+        ssize_t length = readlink(path, target, sizeof(target) - 1);
+        if (length <= 0) {
+            continue;
+        }
+        target[length] = '\0';
+        const char* name = strrchr(target, '/');
+        return name ? name + 1 : target;
     }
-    return result;
+    return "";
 } 
\ No newline at end of file
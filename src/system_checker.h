@@ -20,12 +20,16 @@ public:
     bool hasDSIDisplay();
     
 private:
-    // 执行systemctl命令并获取结果
+#ifdef HAVE_SYSTEMD
+    struct sd_bus* bus_;  // 系统总线连接，首次查询单元状态时打开
+#else
+    // 没有libsystemd时通过systemctl查询单元状态
     std::string executeCommand(const std::string& command);
+#endif
     
-    // 检查systemd单元状态
+    // 检查systemd单元状态 (ActiveState)
     bool isUnitActive(const std::string& unit_name);
     
-    // 检查当前默认目标
+    // 检查当前默认目标 (default.target符号链接指向的单元)
     std::string getCurrentTarget();
 }; 
\ No newline at end of file